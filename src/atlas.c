@@ -0,0 +1,131 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Helpers for the RGB texture atlases. Every image occupies a square,
+ * power of two sized tile, so tile borders stay aligned to 2x2 blocks
+ * on every mip level down to one texel per tile, and a box filter
+ * never mixes two tiles. The gutter halves with every level, where it
+ * is under a texel wide the fragment shader keeps the filter inside
+ * the tile instead.
+ **/
+
+#include <string.h>
+
+#include "atlas.h"
+#include "worker.h"
+
+/**
+ * Number of mip levels for the given tile size, including the base
+ * level, ending with one texel per tile.
+ **/
+int
+atlas_num_levels(int tile_size)
+{
+    int n = 1;
+    while (tile_size > 1) {
+        tile_size >>= 1;
+        n ++;
+    }
+    return n;
+}
+
+size_t
+atlas_level_size(int texture_width, int texture_height, int level)
+{
+    size_t w = texture_width >> level, h = texture_height >> level;
+    return 3 * (w ? w : 1) * (h ? h : 1);
+}
+
+/**
+ * Replicate the outermost pixels of the image placed inside the tile
+ * at (x, y) into the tile's gutter, so that bilinear filtering at the
+ * tile border does not pick up texels from the neighbouring tile.
+ **/
+void
+atlas_fill_gutter(unsigned char *pbuf, int texture_width, int x, int y, int tile_size, int gutter)
+{
+    int stride = texture_width * 3;
+    unsigned char *tile = pbuf + y * stride + x * 3;
+
+    if (gutter <= 0) {
+        return;
+    }
+
+    for (int r=gutter; r<tile_size-gutter; r++) {
+        unsigned char *row = tile + r * stride;
+        for (int c=0; c<gutter; c++) {
+            memcpy(row + c*3, row + gutter*3, 3);
+            memcpy(row + (tile_size-1-c)*3, row + (tile_size-1-gutter)*3, 3);
+        }
+    }
+
+    for (int r=0; r<gutter; r++) {
+        memcpy(tile + r * stride, tile + gutter * stride, tile_size * 3);
+        memcpy(tile + (tile_size-1-r) * stride, tile + (tile_size-1-gutter) * stride, tile_size * 3);
+    }
+}
+
+struct mipmap_job {
+    unsigned char **levels;
+    int             num_levels;
+    int             texture_width;
+    int             tile_size;
+    int             gutter;
+};
+
+/* 2x2 box filter of rows [begin, end) of dst from the rows above them in src */
+static void
+downsample_rows(const unsigned char *src, unsigned char *dst, int dst_width, size_t begin, size_t end)
+{
+    size_t src_stride = (size_t)dst_width * 6;
+
+    for (size_t y=begin; y<end; y++) {
+        const unsigned char *r0 = src + (2*y) * src_stride;
+        const unsigned char *r1 = r0 + src_stride;
+        unsigned char *d = dst + y * dst_width * 3;
+
+        for (int x=0; x<dst_width; x++) {
+            for (int c=0; c<3; c++) {
+                d[x*3+c] = (r0[x*6+c] + r0[x*6+3+c] + r1[x*6+c] + r1[x*6+3+c] + 2) >> 2;
+            }
+        }
+    }
+}
+
+/* the whole chain for the tiles of rows [begin, end), which depend on nothing else */
+static void
+mipmap_tile_rows(void *arg, size_t begin, size_t end)
+{
+    struct mipmap_job *j = (struct mipmap_job*)arg;
+
+    for (int l=1; l<j->num_levels; l++) {
+        int tile = j->tile_size >> l, gutter = j->gutter >> l, width = j->texture_width >> l;
+
+        downsample_rows(j->levels[l-1], j->levels[l], width, begin * tile, end * tile);
+
+        /* the filter blends the gutter into the image's edge, pad it
+         * again from this level's edge */
+        for (size_t y=begin; y<end; y++) {
+            for (int x=0; x<width; x+=tile) {
+                atlas_fill_gutter(j->levels[l], width, x, (int)y * tile, tile, gutter);
+            }
+        }
+    }
+}
+
+/**
+ * Fill levels[1] to levels[num_levels-1] of an RGB atlas from
+ * levels[0], each from the one before with a 2x2 box filter, and pad
+ * every tile's gutter again on each level it is still a texel wide.
+ * The work is split over the worker threads by rows of tiles, which
+ * each go through the whole chain, num_levels must not go below one
+ * texel per tile.
+ **/
+void
+atlas_mipmap(unsigned char **levels, int num_levels, int texture_width, int texture_height,
+             int tile_size, int gutter)
+{
+    struct mipmap_job j = {levels, num_levels, texture_width, tile_size, gutter};
+    worker_parallel_for(texture_height / tile_size, mipmap_tile_rows, &j);
+}
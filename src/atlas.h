@@ -0,0 +1,12 @@
+#ifndef _ATLAS__H_
+#define _ATLAS__H_
+
+#include <stddef.h>
+
+int atlas_num_levels(int tile_size);
+size_t atlas_level_size(int texture_width, int texture_height, int level);
+void atlas_fill_gutter(unsigned char *pbuf, int texture_width, int x, int y, int tile_size, int gutter);
+void atlas_mipmap(unsigned char **levels, int num_levels, int texture_width, int texture_height,
+                  int tile_size, int gutter);
+
+#endif
@@ -0,0 +1,316 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Camera path files have one keyframe per line, the time in seconds
+ * followed by a camera as accepted by view_parse():
+ *
+ *   # time camera
+ *   0   0,120
+ *   4.5 1.57,40,10,0,-5
+ *
+ * The camera is interpolated linearly between keyframes. Lines
+ * starting with # are ignored.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "megagraph.h"
+#include "bench.h"
+
+/**
+ * Read a camera path, keyframes must be sorted by time.
+ *
+ * Returns 0 on success.
+ **/
+int
+bench_load(struct bench *b, const char *filename)
+{
+    char line[512], spec[512];
+    int lineno = 0;
+    FILE *fp;
+
+    memset(b, 0, sizeof(struct bench));
+
+    if (!(fp = fopen(filename, "r"))) {
+        LOG_E("could not open %s", filename);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        struct bench_key k;
+        char *p = line;
+
+        lineno ++;
+
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') {
+            continue;
+        }
+
+        if (sscanf(p, "%lf %511s", &k.time, spec) != 2 || view_parse(&k.view, spec) != 0) {
+            LOG_E("%s:%d: invalid keyframe", filename, lineno);
+            fclose(fp);
+            bench_free(b);
+            return 1;
+        }
+
+        if (b->num_keys > 0 && k.time < b->keys[b->num_keys-1].time) {
+            LOG_E("%s:%d: keyframes are not sorted by time", filename, lineno);
+            fclose(fp);
+            bench_free(b);
+            return 1;
+        }
+
+        if (b->num_keys == b->cap_keys) {
+            b->cap_keys = b->cap_keys ? b->cap_keys * 2 : 64;
+            b->keys = realloc(b->keys, b->cap_keys * sizeof(struct bench_key));
+            if (!b->keys) {
+                LOG_E("out of mem");
+                exit(1);
+            }
+        }
+
+        b->keys[b->num_keys++] = k;
+    }
+
+    fclose(fp);
+
+    if (b->num_keys == 0) {
+        LOG_E("%s: no keyframes", filename);
+        return 1;
+    }
+
+    b->time = b->keys[0].time;
+
+    return 0;
+}
+
+void
+bench_free(struct bench *b)
+{
+    free(b->keys);
+    free(b->frames);
+    memset(b, 0, sizeof(struct bench));
+}
+
+/**
+ * Get the view of the next frame and advance the simulated time by
+ * BENCH_DT.
+ *
+ * Returns 0 once the path has ended.
+ **/
+int
+bench_next(struct bench *b, struct view *v)
+{
+    const struct bench_key *k = b->keys;
+    double t = b->time;
+
+    if (t > k[b->num_keys-1].time) {
+        return 0;
+    }
+
+    size_t x = 0;
+    while (x + 1 < b->num_keys && k[x+1].time <= t) {
+        x ++;
+    }
+
+    if (x + 1 == b->num_keys) {
+        *v = k[x].view;
+    } else {
+        double span = k[x+1].time - k[x].time;
+        view_lerp(v, &k[x].view, &k[x+1].view, span > 0.0 ? (float)((t - k[x].time) / span) : 1.f);
+    }
+
+    b->time += BENCH_DT;
+
+    return 1;
+}
+
+/**
+ * Add the measurements of a frame.
+ **/
+void
+bench_frame(struct bench *b, double seconds, uint64_t draws, uint64_t points)
+{
+    if (b->num_frames == b->cap_frames) {
+        b->cap_frames = b->cap_frames ? b->cap_frames * 2 : 1024;
+        b->frames = realloc(b->frames, b->cap_frames * sizeof(double));
+        if (!b->frames) {
+            LOG_E("out of mem");
+            exit(1);
+        }
+    }
+
+    b->frames[b->num_frames++] = seconds;
+    b->draws += draws;
+    b->points += points;
+    if (draws > b->max_draws) b->max_draws = draws;
+    if (points > b->max_points) b->max_points = points;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double
+percentile(const double *sorted, size_t n, int p)
+{
+    size_t x = (n * p) / 100;
+    return sorted[x < n ? x : n-1];
+}
+
+static double*
+sort_frames(const struct bench *b)
+{
+    double *sorted = malloc(b->num_frames * sizeof(double));
+    if (!sorted) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+    memcpy(sorted, b->frames, b->num_frames * sizeof(double));
+    qsort(sorted, b->num_frames, sizeof(double), cmp_double);
+
+    return sorted;
+}
+
+void
+bench_report(const struct bench *b)
+{
+    size_t n = b->num_frames;
+
+    if (n == 0) {
+        LOG_I("Benchmark:\tno frames");
+        return;
+    }
+
+    double *sorted = sort_frames(b);
+
+    double sum = 0.0;
+    for (size_t x=0; x<n; x++) {
+        sum += sorted[x];
+    }
+
+    LOG_I("Benchmark:\t%zu frames, %.2f s, %.1f fps", n, sum, (double)n / sum);
+    LOG_I("Frame time:\tmin %.2f, p50 %.2f, p90 %.2f, p95 %.2f, p99 %.2f, max %.2f ms",
+          sorted[0] * 1000.0,
+          percentile(sorted, n, 50) * 1000.0,
+          percentile(sorted, n, 90) * 1000.0,
+          percentile(sorted, n, 95) * 1000.0,
+          percentile(sorted, n, 99) * 1000.0,
+          sorted[n-1] * 1000.0);
+    LOG_I("Draws/frame:\tavg %.1f, max %llu", (double)b->draws / n, (unsigned long long)b->max_draws);
+    LOG_I("Points/frame:\tavg %.0f, max %llu", (double)b->points / n, (unsigned long long)b->max_points);
+
+    free(sorted);
+}
+
+/**
+ * Write the same numbers as bench_report(), frame times in
+ * milliseconds.
+ **/
+void
+bench_report_json(const struct bench *b, FILE *fp)
+{
+    size_t n = b->num_frames;
+
+    if (n == 0) {
+        fprintf(fp, "{\n  \"frames\": 0\n}\n");
+        return;
+    }
+
+    double *sorted = sort_frames(b);
+
+    double sum = 0.0;
+    for (size_t x=0; x<n; x++) {
+        sum += sorted[x];
+    }
+
+    fprintf(fp, "{\n  \"frames\": %zu,\n  \"seconds\": %.6f,\n", n, sum);
+    fprintf(fp, "  \"frame_ms\": {\"min\": %.3f, \"avg\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+            "\"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+            sorted[0] * 1000.0, sum / n * 1000.0,
+            percentile(sorted, n, 50) * 1000.0,
+            percentile(sorted, n, 90) * 1000.0,
+            percentile(sorted, n, 95) * 1000.0,
+            percentile(sorted, n, 99) * 1000.0,
+            sorted[n-1] * 1000.0);
+    fprintf(fp, "  \"draws\": {\"avg\": %.3f, \"max\": %llu},\n",
+            (double)b->draws / n, (unsigned long long)b->max_draws);
+    fprintf(fp, "  \"points\": {\"avg\": %.3f, \"max\": %llu}\n}\n",
+            (double)b->points / n, (unsigned long long)b->max_points);
+
+    free(sorted);
+}
+
+/**
+ * Start recording a camera path.
+ *
+ * Returns 0 on success.
+ **/
+int
+bench_record_open(struct bench_recorder *r, const char *filename, double now)
+{
+    memset(r, 0, sizeof(struct bench_recorder));
+
+    if (!(r->fp = fopen(filename, "w"))) {
+        LOG_E("could not open %s", filename);
+        return 1;
+    }
+
+    fprintf(r->fp, "# time camera\n");
+    r->start = now;
+
+    return 0;
+}
+
+static void
+write_key(struct bench_recorder *r, double t, const struct view *v)
+{
+    char spec[256];
+
+    view_format(v, spec, sizeof(spec));
+    fprintf(r->fp, "%.4f %s\n", t - r->start, spec);
+    r->last_time = t;
+}
+
+/**
+ * Record the view of a frame starting at `now`, dt after the previous
+ * one. Only changes are written, if the view was at rest the previous
+ * view is repeated at the start of the frame so that playback holds
+ * it instead of interpolating through the pause.
+ **/
+void
+bench_record(struct bench_recorder *r, double now, double dt, const struct view *v)
+{
+    if (!r->fp) return;
+
+    if (r->has_last && memcmp(&r->last, v, sizeof(struct view)) == 0) {
+        return;
+    }
+
+    if (r->has_last && now - dt > r->last_time + 1e-6) {
+        write_key(r, now - dt, &r->last);
+    }
+
+    write_key(r, now, v);
+    r->last = *v;
+    r->has_last = 1;
+}
+
+void
+bench_record_close(struct bench_recorder *r, double now)
+{
+    if (!r->fp) return;
+
+    if (r->has_last && now > r->last_time) {
+        write_key(r, now, &r->last);
+    }
+
+    fclose(r->fp);
+    r->fp = 0;
+}
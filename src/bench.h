@@ -0,0 +1,58 @@
+#ifndef _BENCH__H_
+#define _BENCH__H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "view.h"
+
+#define BENCH_DT (1.0/60.0) /* simulated seconds per benchmark frame */
+
+struct bench_key {
+    double      time;
+    struct view view;
+};
+
+/**
+ * Camera path played back by --bench, along with the measurements
+ * taken while playing it.
+ **/
+struct bench {
+    struct bench_key *keys;
+    size_t            num_keys;
+    size_t            cap_keys;
+
+    double            time; /* simulated time of the current frame */
+
+    double           *frames; /* frame times in seconds */
+    size_t            num_frames;
+    size_t            cap_frames;
+    uint64_t          draws;
+    uint64_t          max_draws;
+    uint64_t          points;
+    uint64_t          max_points;
+};
+
+/**
+ * Writes the camera path of a live session, see --record.
+ **/
+struct bench_recorder {
+    FILE        *fp;
+    double       start;
+    double       last_time;
+    struct view  last;
+    int          has_last;
+};
+
+int bench_load(struct bench *b, const char *filename);
+void bench_free(struct bench *b);
+int bench_next(struct bench *b, struct view *v);
+void bench_frame(struct bench *b, double seconds, uint64_t draws, uint64_t points);
+void bench_report(const struct bench *b);
+void bench_report_json(const struct bench *b, FILE *fp);
+
+int bench_record_open(struct bench_recorder *r, const char *filename, double now);
+void bench_record(struct bench_recorder *r, double now, double dt, const struct view *v);
+void bench_record_close(struct bench_recorder *r, double now);
+
+#endif
@@ -0,0 +1,127 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Compact vertices, 8 bytes per point instead of the 16 of a tvec4.
+ * Every COMPACT_BLOCK consecutive vertices share an origin, the
+ * corner of their bounding box, and a step, its longest side over
+ * COMPACT_MAX, and each position is stored as three 16 bit multiples
+ * of the step from the origin. A position is then off by at most half
+ * a step along each axis. Points near each other in space should be
+ * near each other in the vertex buffer for the steps to be small,
+ * which --reorder takes care of.
+ **/
+
+#include <stdlib.h>
+#include <float.h>
+#include <math.h>
+
+#include "compact.h"
+#include "trace.h"
+#include "worker.h"
+
+#define ENCODE_BLOCKS 256 /* blocks per unit of work handed to a thread */
+
+struct encode_job {
+    const tvec4           *points;
+    size_t                 num_points;
+    struct compact_vertex *vertices;
+    struct compact_block  *blocks;
+    float                 *errors; /* largest error of every unit of work */
+};
+
+static void
+encode_block(const struct encode_job *j, size_t b, float *max_error)
+{
+    size_t first = b * COMPACT_BLOCK;
+    size_t last = first + COMPACT_BLOCK < j->num_points ? first + COMPACT_BLOCK : j->num_points;
+    float min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    for (size_t x=first; x<last; x++) {
+        const float p[3] = {j->points[x].x, j->points[x].y, j->points[x].z};
+        for (int a=0; a<3; a++) {
+            if (p[a] < min[a]) min[a] = p[a];
+            if (p[a] > max[a]) max[a] = p[a];
+        }
+    }
+
+    float extent = 0.f;
+    for (int a=0; a<3; a++) {
+        if (max[a] - min[a] > extent) extent = max[a] - min[a];
+    }
+
+    struct compact_block *blk = &j->blocks[b];
+    blk->origin[0] = min[0];
+    blk->origin[1] = min[1];
+    blk->origin[2] = min[2];
+    blk->step = extent / (float)COMPACT_MAX;
+
+    for (size_t x=first; x<last; x++) {
+        const float p[3] = {j->points[x].x, j->points[x].y, j->points[x].z};
+        uint16_t q[3] = {0, 0, 0};
+
+        for (int a=0; a<3; a++) {
+            if (blk->step > 0.f) {
+                float s = roundf((p[a] - min[a]) / blk->step);
+                q[a] = (uint16_t)(s < 0.f ? 0.f : (s > COMPACT_MAX ? COMPACT_MAX : s));
+            }
+
+            /* the same sum the vertex shader makes */
+            float e = fabsf(min[a] + (float)q[a] * blk->step - p[a]);
+            if (e > *max_error) *max_error = e;
+        }
+
+        /* the slot fits, an atlas holds far fewer than 65536 images */
+        j->vertices[x] = (struct compact_vertex){q[0], q[1], q[2], (uint16_t)j->points[x].w};
+    }
+}
+
+static void
+encode_blocks(void *arg, size_t begin, size_t end)
+{
+    TRACE_SCOPE("compact encode");
+    struct encode_job *j = (struct encode_job*)arg;
+    size_t num_blocks = compact_num_blocks(j->num_points);
+
+    for (size_t u=begin; u<end; u++) {
+        size_t last = (u+1) * ENCODE_BLOCKS < num_blocks ? (u+1) * ENCODE_BLOCKS : num_blocks;
+
+        j->errors[u] = 0.f;
+        for (size_t b=u * ENCODE_BLOCKS; b<last; b++) {
+            encode_block(j, b, &j->errors[u]);
+        }
+    }
+}
+
+/**
+ * Quantize points into vertices, which gets num_points entries, with
+ * the origin and step of every block of them in blocks, which gets
+ * compact_num_blocks(num_points) entries. The slot is taken from w.
+ *
+ * Returns the largest distance along any axis between a point and its
+ * quantized position, or -1 if out of memory.
+ **/
+float
+compact_encode(const tvec4 *points, size_t num_points,
+               struct compact_vertex *vertices, struct compact_block *blocks)
+{
+    size_t num_units = (compact_num_blocks(num_points) + ENCODE_BLOCKS - 1) / ENCODE_BLOCKS;
+    struct encode_job j = {points, num_points, vertices, blocks,
+                           (float*)malloc(num_units * sizeof(float) + 1)};
+
+    if (!j.errors) {
+        return -1.f;
+    }
+
+    worker_parallel_for(num_units, encode_blocks, &j);
+
+    float max_error = 0.f;
+    for (size_t u=0; u<num_units; u++) {
+        if (j.errors[u] > max_error) max_error = j.errors[u];
+    }
+
+    free(j.errors);
+
+    return max_error;
+}
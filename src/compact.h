@@ -0,0 +1,45 @@
+#ifndef _COMPACT__H_
+#define _COMPACT__H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "math/vector.h"
+
+#define COMPACT_BLOCK 256   /* vertices sharing an origin and a step */
+#define COMPACT_MAX   65535 /* largest quantized coordinate */
+
+/* largest position error accepted, as a fraction of a sprite, which is
+ * 2 units wide; beyond it the points are kept as floats */
+#define COMPACT_MAX_ERROR 0.01f
+
+/**
+ * A point in 8 bytes, its position in steps from the origin of its
+ * block and its slot in the atlas. Read by the vertex shader as one
+ * integer vec4.
+ **/
+struct compact_vertex {
+    uint16_t x, y, z;
+    uint16_t slot;
+};
+
+/**
+ * Origin and step of the vertices [i*COMPACT_BLOCK, (i+1)*COMPACT_BLOCK),
+ * one RGBA32F texel of a texture buffer. The step is the same along
+ * every axis.
+ **/
+struct compact_block {
+    float origin[3];
+    float step;
+};
+
+static inline size_t
+compact_num_blocks(size_t num_points)
+{
+    return (num_points + COMPACT_BLOCK - 1) / COMPACT_BLOCK;
+}
+
+float compact_encode(const tvec4 *points, size_t num_points,
+                     struct compact_vertex *vertices, struct compact_block *blocks);
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ **/
+
+#include <math.h>
+#include <string.h>
+
+#include "megagraph.h"
+#include "dynres.h"
+
+#define DYNRES_SMOOTHING 0.2f  /* weight of a new sample in the average */
+#define DYNRES_HIGH      1.05f /* lower the scale above target * HIGH */
+#define DYNRES_LOW       0.80f /* raise the scale below target * LOW */
+#define DYNRES_SETTLE    8     /* frames to wait after changing the scale */
+#define DYNRES_STEP      0.0625f
+
+void
+dynres_init(struct dynres *d, float target)
+{
+    memset(d, 0, sizeof(struct dynres));
+
+    d->target = target;
+    d->scale = 1.f;
+    d->min_scale = 0.25f;
+    d->gpu_timer = GLAD_GL_VERSION_3_3;
+
+    if (d->gpu_timer) {
+        glGenQueries(DYNRES_QUERIES, d->queries);
+    }
+
+    LOG_I("Dynamic resolution:\t%.1f ms target, %s timing",
+          target * 1000.f, d->gpu_timer ? "gpu" : "cpu");
+}
+
+/**
+ * Give up on the gpu timer after a GL error and time frames on the
+ * cpu from then on.
+ **/
+static void
+gpu_timer_failed(struct dynres *d, const char *what)
+{
+    LOG_E("dynamic resolution: %s, falling back to cpu timing", what);
+
+    glDeleteQueries(DYNRES_QUERIES, d->queries);
+    d->gpu_timer = 0;
+    d->query_count = 0;
+    d->query_active = 0;
+    d->avg = 0.f;
+}
+
+/**
+ * Start timing the frame's rendering. Queries are kept in a ring so
+ * a result is only read once the gpu has finished with it. Only one
+ * GL_TIME_ELAPSED query can be active at a time, so stats.c times its
+ * stages with timestamps instead.
+ **/
+void
+dynres_begin(struct dynres *d)
+{
+    if (!d->gpu_timer || d->query_count == DYNRES_QUERIES) {
+        return;
+    }
+
+    GLint active = 0;
+    glGetQueryiv(GL_TIME_ELAPSED, GL_CURRENT_QUERY, &active);
+    if (active != 0) {
+        gpu_timer_failed(d, "another GL_TIME_ELAPSED query is active");
+        return;
+    }
+
+    /* errors left by earlier calls are not ours to report */
+    while (glGetError() != GL_NO_ERROR) {
+    }
+
+    int q = (d->query_head + d->query_count) % DYNRES_QUERIES;
+    glBeginQuery(GL_TIME_ELAPSED, d->queries[q]);
+    if (glGetError() != GL_NO_ERROR) {
+        gpu_timer_failed(d, "glBeginQuery failed");
+        return;
+    }
+    d->query_count ++;
+    d->query_active = 1;
+}
+
+/**
+ * End the frame and feed the controller. cpu_time is used if gpu
+ * timer queries are not available.
+ *
+ * Returns non-zero if the scale changed.
+ **/
+int
+dynres_end(struct dynres *d, float cpu_time)
+{
+    float sample = -1.f;
+
+    if (d->gpu_timer) {
+        if (d->query_active) {
+            glEndQuery(GL_TIME_ELAPSED);
+            d->query_active = 0;
+            if (glGetError() != GL_NO_ERROR) {
+                gpu_timer_failed(d, "glEndQuery failed");
+                return 0;
+            }
+        }
+
+        /* leave the newest query for the next frame */
+        while (d->query_count > 1) {
+            GLint available = 0;
+            glGetQueryObjectiv(d->queries[d->query_head], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(d->queries[d->query_head], GL_QUERY_RESULT, &ns);
+            sample = (float)ns * 1e-9f;
+
+            d->query_head = (d->query_head + 1) % DYNRES_QUERIES;
+            d->query_count --;
+        }
+    } else {
+        sample = cpu_time;
+    }
+
+    if (sample < 0.f) {
+        return 0;
+    }
+
+    d->avg = d->avg > 0.f ? d->avg + (sample - d->avg) * DYNRES_SMOOTHING : sample;
+
+    if (d->settle > 0) {
+        d->settle --;
+        return 0;
+    }
+
+    float scale = d->scale;
+
+    if (d->avg > d->target * DYNRES_HIGH || d->avg < d->target * DYNRES_LOW) {
+        /* frame time is roughly proportional to the pixel count */
+        scale = d->scale * sqrtf(d->target / d->avg);
+        scale = roundf(scale / DYNRES_STEP) * DYNRES_STEP;
+    }
+
+    if (scale > 1.f) scale = 1.f;
+    if (scale < d->min_scale) scale = d->min_scale;
+
+    if (scale == d->scale) {
+        return 0;
+    }
+
+    d->scale = scale;
+    d->settle = DYNRES_SETTLE;
+    d->avg = 0.f;
+
+    return 1;
+}
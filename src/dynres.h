@@ -0,0 +1,30 @@
+#ifndef _DYNRES__H_
+#define _DYNRES__H_
+
+#include "glad/glad.h"
+
+#define DYNRES_QUERIES 4
+
+/**
+ * Dynamic resolution controller. Picks the scale of the offscreen
+ * render target so that the measured frame time stays near a target.
+ **/
+struct dynres {
+    float  target;      /* target frame time in seconds */
+    float  scale;       /* current scale of each framebuffer axis */
+    float  min_scale;
+    float  avg;         /* smoothed frame time in seconds, 0 if unknown */
+    int    settle;      /* frames left before the scale may change again */
+
+    int    gpu_timer;   /* GL_TIME_ELAPSED queries are available */
+    GLuint queries[DYNRES_QUERIES];
+    int    query_head;
+    int    query_count;
+    int    query_active;
+};
+
+void dynres_init(struct dynres *d, float target);
+void dynres_begin(struct dynres *d);
+int dynres_end(struct dynres *d, float cpu_time);
+
+#endif
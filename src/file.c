@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "file.h"
+
 #define BLOCKSIZE (1024*1024)
 
 /** 
@@ -10,13 +12,13 @@
  * of BLOCKSIZE and count each occurence of the 
  * given char.
  **/
-int file_count_occurrences(FILE *fp, char c) {
+size_t file_count_occurrences(FILE *fp, char c) {
     char buf[BLOCKSIZE];
-    int count = 0;
+    size_t count = 0;
     size_t n;
 
     while (!feof(fp) && (n = fread(buf, sizeof(char), BLOCKSIZE, fp)) > 0) {
-        int x;
+        size_t x;
         for (x=0; x<n; x++) {
             if (buf[x] == c) {
                 count ++;
@@ -26,3 +28,47 @@ int file_count_occurrences(FILE *fp, char c) {
 
     return count;
 }
+
+/**
+ * Append the offset of the next indexed line, line number
+ * l->num * FILE_LINE_STRIDE. Returns 0 on success.
+ **/
+int file_lines_add(struct file_lines *l, long offset) {
+    if (l->num == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 1024;
+        long *o = realloc(l->offsets, cap * sizeof(long));
+        if (!o) return -1;
+        l->offsets = o;
+        l->cap = cap;
+    }
+    l->offsets[l->num++] = offset;
+
+    return 0;
+}
+
+/**
+ * Read line number line of fp into buf, seeking to the nearest indexed
+ * line before it and skipping at most FILE_LINE_STRIDE-1 lines.
+ * Returns 0 on success.
+ **/
+int file_read_line(FILE *fp, const struct file_lines *l, size_t line, char *buf, int size) {
+    size_t block = line / FILE_LINE_STRIDE;
+
+    if (block >= l->num || fseek(fp, l->offsets[block], SEEK_SET) != 0) {
+        return -1;
+    }
+
+    for (size_t x=0; x<=line % FILE_LINE_STRIDE; x++) {
+        if (fgets(buf, size, fp) != buf) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void file_lines_free(struct file_lines *l) {
+    free(l->offsets);
+    l->offsets = 0;
+    l->num = l->cap = 0;
+}
@@ -2,7 +2,26 @@
 #define _FILE__H_
 
 #include <stdio.h>
+#include <stddef.h>
 
-int file_count_occurrences(FILE *fp, char c);
+/* a line offset is kept for every FILE_LINE_STRIDE lines */
+#define FILE_LINE_STRIDE 64
+
+/**
+ * Sparse index of where lines start, so that a line can be read back
+ * by its number without keeping the file in memory or reading it
+ * from the start.
+ **/
+struct file_lines {
+    long   *offsets; /* offsets[i] is where line i*FILE_LINE_STRIDE starts */
+    size_t  num;
+    size_t  cap;
+};
+
+size_t file_count_occurrences(FILE *fp, char c);
+
+int file_lines_add(struct file_lines *l, long offset);
+int file_read_line(FILE *fp, const struct file_lines *l, size_t line, char *buf, int size);
+void file_lines_free(struct file_lines *l);
 
 #endif
@@ -0,0 +1,184 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * OpenGL context without a window, through EGL surfaceless contexts
+ * (Mesa's llvmpipe on machines without a gpu). Everything is rendered
+ * into framebuffer objects.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <vips/vips.h>
+
+#include "megagraph.h"
+#include "headless.h"
+
+#ifdef MG_HEADLESS
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+
+static EGLDisplay
+get_display(void)
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    if (get_platform_display) {
+        EGLDisplay d = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+        if (d != EGL_NO_DISPLAY) {
+            return d;
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+/**
+ * Create an OpenGL 3.3 core context without any surface and make it
+ * current.
+ *
+ * Returns 0 on success.
+ **/
+int
+headless_init(void)
+{
+    EGLint major, minor, num_configs;
+    EGLConfig config;
+
+    static const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+
+    static const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    if ((display = get_display()) == EGL_NO_DISPLAY) {
+        LOG_E("No EGL display");
+        return 1;
+    }
+
+    if (!eglInitialize(display, &major, &minor)) {
+        LOG_E("eglInitialize failed: 0x%x", eglGetError());
+        return 1;
+    }
+
+    LOG_I("EGL %d.%d, %s", major, minor, eglQueryString(display, EGL_VENDOR));
+
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs < 1) {
+        /* surfaceless displays may not offer pbuffer configs */
+        static const EGLint any_attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        if (!eglChooseConfig(display, any_attribs, &config, 1, &num_configs) || num_configs < 1) {
+            LOG_E("No suitable EGL config");
+            return 1;
+        }
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        LOG_E("eglBindAPI failed: 0x%x", eglGetError());
+        return 1;
+    }
+
+    if ((context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs)) == EGL_NO_CONTEXT) {
+        LOG_E("eglCreateContext failed: 0x%x", eglGetError());
+        return 1;
+    }
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        LOG_E("eglMakeCurrent failed: 0x%x", eglGetError());
+        return 1;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        LOG_E("GLAD failed");
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+headless_shutdown(void)
+{
+    if (display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT) {
+            eglDestroyContext(display, context);
+        }
+        eglTerminate(display);
+    }
+
+    display = EGL_NO_DISPLAY;
+    context = EGL_NO_CONTEXT;
+}
+
+#else
+
+int
+headless_init(void)
+{
+    LOG_E("Built without headless support");
+    return 1;
+}
+
+void
+headless_shutdown(void)
+{
+}
+
+#endif
+
+/**
+ * Read back the bound read framebuffer and save it, the format is
+ * chosen by libvips from the file name.
+ *
+ * Returns 0 on success.
+ **/
+int
+headless_write_image(const char *filename, int width, int height)
+{
+    size_t stride = (size_t)width * 3;
+    unsigned char *pixels = malloc(stride * height);
+    unsigned char *flipped = malloc(stride * height);
+
+    if (!pixels || !flipped) {
+        free(pixels);
+        free(flipped);
+        LOG_E("out of mem");
+        return 1;
+    }
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+
+    /* opengl rows start at the bottom */
+    for (int y=0; y<height; y++) {
+        memcpy(flipped + y * stride, pixels + (height-1-y) * stride, stride);
+    }
+    free(pixels);
+
+    VipsImage *img = vips_image_new_from_memory(flipped, stride * height, width, height, 3, VIPS_FORMAT_UCHAR);
+    int r = 1;
+
+    if (img) {
+        r = vips_image_write_to_file(img, filename, NULL);
+        g_object_unref(img);
+    }
+
+    if (r != 0) {
+        LOG_E("could not write %s: %s", filename, vips_error_buffer());
+    }
+
+    free(flipped);
+    return r;
+}
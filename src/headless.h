@@ -0,0 +1,8 @@
+#ifndef _HEADLESS__H_
+#define _HEADLESS__H_
+
+int headless_init(void);
+void headless_shutdown(void);
+int headless_write_image(const char *filename, int width, int height);
+
+#endif
@@ -0,0 +1,256 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Text overlay drawn with a built-in 3x5 pixel font. Text is queued
+ * with hud_printf() on a grid of character cells and drawn, on top
+ * of a translucent background, by hud_draw().
+ **/
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "megagraph.h"
+#include "hud.h"
+
+#define GLYPH_W      3
+#define GLYPH_H      5
+#define CELL_W       (GLYPH_W+1)
+#define CELL_H       (GLYPH_H+1)
+#define FONT_FIRST   32
+#define FONT_COLS    16
+#define FONT_ROWS    4 /* ascii 32 to 95, lower case is drawn as upper case */
+#define HUD_SCALE    3 /* screen pixels per font pixel */
+#define HUD_MARGIN   8
+
+#define G(a,b,c,d,e) ((a<<12)|(b<<9)|(c<<6)|(d<<3)|(e))
+
+/* five rows of three bits per glyph, most significant bit to the left */
+static const unsigned short glyphs[FONT_COLS*FONT_ROWS] = {
+    [' '-32] = 0,
+    ['%'-32] = G(05,01,02,04,05),
+    ['('-32] = G(01,02,02,02,01),
+    [')'-32] = G(04,02,02,02,04),
+    ['+'-32] = G(00,02,07,02,00),
+    [','-32] = G(00,00,00,02,04),
+    ['-'-32] = G(00,00,07,00,00),
+    ['.'-32] = G(00,00,00,00,02),
+    ['/'-32] = G(01,01,02,04,04),
+    ['0'-32] = G(07,05,05,05,07),
+    ['1'-32] = G(02,06,02,02,07),
+    ['2'-32] = G(07,01,07,04,07),
+    ['3'-32] = G(07,01,07,01,07),
+    ['4'-32] = G(05,05,07,01,01),
+    ['5'-32] = G(07,04,07,01,07),
+    ['6'-32] = G(07,04,07,05,07),
+    ['7'-32] = G(07,01,01,01,01),
+    ['8'-32] = G(07,05,07,05,07),
+    ['9'-32] = G(07,05,07,01,07),
+    [':'-32] = G(00,02,00,02,00),
+    ['<'-32] = G(01,02,04,02,01),
+    ['='-32] = G(00,07,00,07,00),
+    ['>'-32] = G(04,02,01,02,04),
+    ['?'-32] = G(07,01,02,00,02),
+    ['A'-32] = G(02,05,07,05,05),
+    ['B'-32] = G(06,05,06,05,06),
+    ['C'-32] = G(03,04,04,04,03),
+    ['D'-32] = G(06,05,05,05,06),
+    ['E'-32] = G(07,04,06,04,07),
+    ['F'-32] = G(07,04,06,04,04),
+    ['G'-32] = G(03,04,05,05,03),
+    ['H'-32] = G(05,05,07,05,05),
+    ['I'-32] = G(07,02,02,02,07),
+    ['J'-32] = G(01,01,01,05,02),
+    ['K'-32] = G(05,05,06,05,05),
+    ['L'-32] = G(04,04,04,04,07),
+    ['M'-32] = G(05,07,07,05,05),
+    ['N'-32] = G(06,05,05,05,05),
+    ['O'-32] = G(02,05,05,05,02),
+    ['P'-32] = G(06,05,06,04,04),
+    ['Q'-32] = G(02,05,05,06,03),
+    ['R'-32] = G(06,05,06,05,05),
+    ['S'-32] = G(03,04,02,01,06),
+    ['T'-32] = G(07,02,02,02,02),
+    ['U'-32] = G(05,05,05,05,07),
+    ['V'-32] = G(05,05,05,05,02),
+    ['W'-32] = G(05,05,07,07,05),
+    ['X'-32] = G(05,05,02,05,05),
+    ['Y'-32] = G(05,05,02,02,02),
+    ['Z'-32] = G(07,01,02,04,07),
+    ['['-32] = G(03,02,02,02,03),
+    [']'-32] = G(06,02,02,02,06),
+    ['_'-32] = G(00,00,00,00,07),
+};
+
+extern GLuint g_hud_program; /* shaders.c */
+extern GLuint g_hud_uniform_screen; /* shaders.c */
+extern GLuint g_hud_uniform_font; /* shaders.c */
+extern GLuint g_hud_uniform_color; /* shaders.c */
+
+static GLuint  font_tex;
+static GLuint  vao;
+static GLuint  vbo;
+
+static float  *verts; /* x, y, u, v per vertex, six vertices per character */
+static size_t  num_verts;
+static size_t  cap_verts;
+static int     max_col;
+static int     max_row;
+
+/**
+ * Create the font texture and vertex buffer, requires compile_shaders().
+ *
+ * Returns 0 on success.
+ **/
+int
+hud_init(void)
+{
+    unsigned char pixels[FONT_ROWS*CELL_H][FONT_COLS*CELL_W];
+
+    memset(pixels, 0, sizeof(pixels));
+
+    for (int g=0; g<FONT_COLS*FONT_ROWS; g++) {
+        int gx = (g % FONT_COLS) * CELL_W;
+        int gy = (g / FONT_COLS) * CELL_H;
+
+        for (int y=0; y<GLYPH_H; y++) {
+            int bits = (glyphs[g] >> ((GLYPH_H-1-y) * GLYPH_W)) & 7;
+            for (int x=0; x<GLYPH_W; x++) {
+                pixels[gy+y][gx+x] = (bits & (4 >> x)) ? 255 : 0;
+            }
+        }
+    }
+
+    glGenTextures(1, &font_tex);
+    glBindTexture(GL_TEXTURE_2D, font_tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, FONT_COLS*CELL_W, FONT_ROWS*CELL_H, 0,
+                 GL_RED, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+
+    return 0;
+}
+
+void
+hud_free(void)
+{
+    glDeleteTextures(1, &font_tex);
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+    free(verts);
+    verts = 0;
+    num_verts = cap_verts = 0;
+}
+
+static void
+push_quad(float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1)
+{
+    if (num_verts + 6 > cap_verts) {
+        cap_verts = cap_verts ? cap_verts * 2 : 6 * 256;
+        verts = realloc(verts, cap_verts * 4 * sizeof(float));
+        if (!verts) {
+            LOG_E("out of mem");
+            exit(1);
+        }
+    }
+
+    float q[6][4] = {
+        {x0, y0, u0, v0}, {x1, y0, u1, v0}, {x0, y1, u0, v1},
+        {x1, y0, u1, v0}, {x1, y1, u1, v1}, {x0, y1, u0, v1},
+    };
+
+    memcpy(verts + num_verts * 4, q, sizeof(q));
+    num_verts += 6;
+}
+
+/**
+ * Queue text at the given character cell, counted from the top left
+ * corner of the screen.
+ **/
+void
+hud_printf(int col, int row, const char *fmt, ...)
+{
+    char text[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(text, sizeof(text), fmt, ap);
+    va_end(ap);
+
+    float tw = FONT_COLS*CELL_W, th = FONT_ROWS*CELL_H;
+
+    for (const char *c=text; *c; c++, col++) {
+        int ch = *c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c;
+
+        if (col > max_col) max_col = col;
+        if (row > max_row) max_row = row;
+
+        if (ch <= FONT_FIRST || ch >= FONT_FIRST + FONT_COLS*FONT_ROWS) {
+            continue;
+        }
+
+        int g = ch - FONT_FIRST;
+        float x = HUD_MARGIN + col * CELL_W * HUD_SCALE;
+        float y = HUD_MARGIN + row * CELL_H * HUD_SCALE;
+        float u = (g % FONT_COLS) * CELL_W, v = (g / FONT_COLS) * CELL_H;
+
+        push_quad(x, y, x + GLYPH_W*HUD_SCALE, y + GLYPH_H*HUD_SCALE,
+                  u / tw, v / th, (u + GLYPH_W) / tw, (v + GLYPH_H) / th);
+    }
+}
+
+/**
+ * Draw and clear the queued text into the bound framebuffer.
+ **/
+void
+hud_draw(int width, int height)
+{
+    if (num_verts == 0) {
+        return;
+    }
+
+    size_t num_text = num_verts;
+
+    /* the background goes last in the buffer but is drawn first */
+    push_quad(0, 0, 2*HUD_MARGIN + (max_col+1) * CELL_W * HUD_SCALE,
+              2*HUD_MARGIN + (max_row+1) * CELL_H * HUD_SCALE, -1, -1, -1, -1);
+
+    glViewport(0, 0, width, height);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, num_verts * 4 * sizeof(float), verts, GL_STREAM_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, font_tex);
+
+    glUseProgram(g_hud_program);
+    glUniform2f(g_hud_uniform_screen, (float)width, (float)height);
+    glUniform1i(g_hud_uniform_font, 0);
+
+    glUniform4f(g_hud_uniform_color, 0.f, 0.f, 0.f, .6f);
+    glDrawArrays(GL_TRIANGLES, (GLint)num_text, 6);
+    glUniform4f(g_hud_uniform_color, 1.f, 1.f, 1.f, 1.f);
+    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)num_text);
+
+    glDisableVertexAttribArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_BLEND);
+
+    num_verts = 0;
+    max_col = max_row = 0;
+}
@@ -0,0 +1,9 @@
+#ifndef _HUD__H_
+#define _HUD__H_
+
+int hud_init(void);
+void hud_free(void);
+void hud_printf(int col, int row, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+void hud_draw(int width, int height);
+
+#endif
@@ -11,23 +11,63 @@ void on_glfw_key(GLFWwindow *win, int key, int scancode, int action, int mods) {
             case GLFW_KEY_ESCAPE:
                 glfwSetWindowShouldClose(win, 1);
                 break;
+
+            case GLFW_KEY_H:
+                mg.hud = !mg.hud;
+                break;
         }
     } else if (action == GLFW_RELEASE) {
         key_down[key] = 0;
     }
+
+    mg.redraw = 1;
+}
+
+/**
+ * A left click picks the sprite under the cursor, see pick().
+ **/
+void on_glfw_mouse_button(GLFWwindow *win, int button, int action, int mods) {
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        double x, y;
+        int w, h;
+
+        glfwGetCursorPos(win, &x, &y);
+        glfwGetWindowSize(win, &w, &h);
+
+        if (w > 0 && h > 0) {
+            mg.pick = 1;
+            mg.pick_x = (float)(x / w);
+            mg.pick_y = 1.f - (float)(y / h);
+            mg.redraw = 1;
+        }
+    }
 }
 
-void input_tick(double dt) {
+/**
+ * Returns non-zero while a key that moves the camera is held down.
+ **/
+int input_active(void) {
+    return key_down[GLFW_KEY_A] || key_down[GLFW_KEY_D]
+        || key_down[GLFW_KEY_S] || key_down[GLFW_KEY_W];
+}
+
+/**
+ * Move the camera according to the keys held down, returns non-zero
+ * if the camera changed.
+ **/
+int input_tick(double dt) {
     if (key_down[GLFW_KEY_A]) {
-        mg.cam_angle += 1.0 * dt;
+        mg.view.angle += 1.0 * dt;
     }
     if (key_down[GLFW_KEY_D]) {
-        mg.cam_angle -= 1.0 * dt;
+        mg.view.angle -= 1.0 * dt;
     }
     if (key_down[GLFW_KEY_S]) {
-        mg.cam_dist -= 30.0 * dt;
+        mg.view.dist -= 30.0 * dt;
     }
     if (key_down[GLFW_KEY_W]) {
-        mg.cam_dist += 30.0 * dt;
+        mg.view.dist += 30.0 * dt;
     }
+
+    return input_active();
 }
@@ -0,0 +1,379 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Nearest neighbours of points and positions. The points are copied
+ * into a KD-tree that splits every range at its median along the
+ * widest axis, found by quickselect, so the tree needs no pointers and
+ * the points of a leaf lie next to each other. The first levels are
+ * split serially and the subtrees below them in parallel. A query
+ * walks the tree nearest side first and keeps the k best in a heap,
+ * skipping every side farther away than the k-th best so far.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "knn.h"
+#include "trace.h"
+#include "worker.h"
+
+#define COPY_BLOCK   65536 /* points per unit of work while copying */
+#define SPLIT_LEVELS 6     /* levels split before the subtrees go to the threads */
+#define SELECT_SMALL 8     /* ranges this short are insertion sorted */
+#define BOUNDS_SAMPLES 4096  /* points looked at to pick the axis to split */
+
+/* a query pushes at most two entries per level */
+#define QUERY_STACK (2 * 64)
+
+struct copy_job {
+    const tvec4      *in;
+    struct knn_point *out;
+    size_t            num_points;
+};
+
+struct build_job {
+    struct knn *t;
+    int         level; /* of the subtree roots */
+};
+
+struct query_job {
+    const struct knn *t;
+    const tvec3      *queries;
+    const uint32_t   *skip;
+    size_t            num_queries;
+    int               k;
+    uint32_t         *indices;
+    float            *distances;
+    size_t            next; /* next block to answer */
+};
+
+struct query_entry {
+    size_t node;
+    size_t lo, hi;
+    float  d2; /* lower bound of the squared distance to any point below */
+};
+
+/* the k best so far, the farthest on top */
+struct heap {
+    float    d2[KNN_MAX_K];
+    uint32_t index[KNN_MAX_K];
+    int      num, k;
+};
+
+static void
+copy_points(void *arg, size_t begin, size_t end)
+{
+    struct copy_job *j = (struct copy_job*)arg;
+    size_t last = end * COPY_BLOCK < j->num_points ? end * COPY_BLOCK : j->num_points;
+
+    for (size_t x=begin * COPY_BLOCK; x<last; x++) {
+        j->out[x] = (struct knn_point){{j->in[x].x, j->in[x].y, j->in[x].z}, (uint32_t)x};
+    }
+}
+
+/**
+ * Reorder the n points so that the one at nth is where it would be if
+ * they were sorted along axis, with none larger before it and none
+ * smaller after it.
+ **/
+static void
+select_nth(struct knn_point *p, size_t n, size_t nth, int axis)
+{
+    size_t lo = 0, hi = n;
+
+    while (hi - lo > SELECT_SMALL) {
+        size_t mid = lo + (hi - lo) / 2;
+        float a = p[lo].p[axis], b = p[mid].p[axis], c = p[hi-1].p[axis];
+        float pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+
+        /* with the median of three as pivot, both sides keep at least one point */
+        size_t i = lo, j = hi - 1;
+        for (;;) {
+            while (p[i].p[axis] < pivot) i++;
+            while (p[j].p[axis] > pivot) j--;
+            if (i >= j) break;
+
+            struct knn_point tmp = p[i]; p[i] = p[j]; p[j] = tmp;
+            i++;
+            j--;
+        }
+
+        if (nth <= j) {
+            hi = j + 1;
+        } else {
+            lo = j + 1;
+        }
+    }
+
+    for (size_t x=lo+1; x<hi; x++) {
+        struct knn_point e = p[x];
+        size_t y = x;
+        for (; y > lo && p[y-1].p[axis] > e.p[axis]; y--) {
+            p[y] = p[y-1];
+        }
+        p[y] = e;
+    }
+}
+
+/**
+ * Split the points [lo, hi) of node and the nodes below it, down to
+ * level stop.
+ **/
+static void
+build_range(struct knn *t, size_t node, size_t lo, size_t hi, int level, int stop)
+{
+    if (level >= stop) {
+        return;
+    }
+
+    float min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    /* the extent of a large range is judged from a sample of it */
+    size_t step = (hi - lo) / BOUNDS_SAMPLES + 1;
+
+    for (size_t x=lo; x<hi; x+=step) {
+        for (int a=0; a<3; a++) {
+            float v = t->points[x].p[a];
+            if (v < min[a]) min[a] = v;
+            if (v > max[a]) max[a] = v;
+        }
+    }
+
+    int axis = 0;
+    for (int a=1; a<3; a++) {
+        if (max[a] - min[a] > max[axis] - min[axis]) axis = a;
+    }
+
+    size_t mid = lo + (hi - lo) / 2;
+    select_nth(t->points + lo, hi - lo, mid - lo, axis);
+    t->splits[node] = (struct knn_split){t->points[mid].p[axis], axis};
+
+    build_range(t, 2*node + 1, lo, mid, level + 1, stop);
+    build_range(t, 2*node + 2, mid, hi, level + 1, stop);
+}
+
+static void
+build_subtrees(void *arg, size_t begin, size_t end)
+{
+    TRACE_SCOPE("knn subtrees");
+    struct build_job *j = (struct build_job*)arg;
+
+    for (size_t x=begin; x<end; x++) {
+        /* the path from the root is in the bits of x, highest first */
+        size_t lo = 0, hi = j->t->num_points;
+        for (int b=j->level-1; b>=0; b--) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (x >> b & 1) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+
+        build_range(j->t, ((size_t)1 << j->level) - 1 + x, lo, hi, j->level, j->t->depth);
+    }
+}
+
+/**
+ * Build the tree over the positions of points, the w component is
+ * ignored.
+ *
+ * Returns 0 on success.
+ **/
+int
+knn_build(struct knn *t, const tvec4 *points, size_t num_points)
+{
+    TRACE_SCOPE("knn build");
+    memset(t, 0, sizeof(struct knn));
+
+    /* halve the ranges until the largest fits in a leaf */
+    while (((num_points + ((size_t)1 << t->depth) - 1) >> t->depth) > KNN_LEAF) {
+        t->depth ++;
+    }
+
+    t->num_points = num_points;
+    t->num_splits = ((size_t)1 << t->depth) - 1;
+    t->points = malloc(num_points * sizeof(struct knn_point) + 1);
+    t->splits = malloc(t->num_splits * sizeof(struct knn_split) + 1);
+
+    if (!t->points || !t->splits) {
+        knn_free(t);
+        return 1;
+    }
+
+    struct copy_job c = {points, t->points, num_points};
+    worker_parallel_for((num_points + COPY_BLOCK - 1) / COPY_BLOCK, copy_points, &c);
+
+    struct build_job j = {t, t->depth < SPLIT_LEVELS ? t->depth : SPLIT_LEVELS};
+
+    build_range(t, 0, 0, num_points, 0, j.level);
+    worker_parallel_for((size_t)1 << j.level, build_subtrees, &j);
+
+    return 0;
+}
+
+void
+knn_free(struct knn *t)
+{
+    free(t->points);
+    free(t->splits);
+    memset(t, 0, sizeof(struct knn));
+}
+
+/* put d2 and index at x, the top, and sift it down to its place */
+static void
+heap_sift_down(struct heap *h, float d2, uint32_t index)
+{
+    int x = 0;
+
+    for (;;) {
+        int c = 2*x + 1;
+        if (c >= h->num) break;
+        if (c + 1 < h->num && h->d2[c+1] > h->d2[c]) c++;
+        if (h->d2[c] <= d2) break;
+        h->d2[x] = h->d2[c];
+        h->index[x] = h->index[c];
+        x = c;
+    }
+
+    h->d2[x] = d2;
+    h->index[x] = index;
+}
+
+static void
+heap_push(struct heap *h, float d2, uint32_t index)
+{
+    if (h->num < h->k) {
+        int x = h->num++;
+        while (x > 0 && h->d2[(x-1)/2] < d2) {
+            h->d2[x] = h->d2[(x-1)/2];
+            h->index[x] = h->index[(x-1)/2];
+            x = (x-1)/2;
+        }
+        h->d2[x] = d2;
+        h->index[x] = index;
+    } else if (d2 < h->d2[0]) {
+        heap_sift_down(h, d2, index);
+    }
+}
+
+/**
+ * Find the k points nearest to p, leaving out point skip, which may be
+ * KNN_NONE. The indices of the points and their distances are written
+ * nearest first to indices and distances, which get k entries each,
+ * with KNN_NONE and -1 for the entries after the last point found. At
+ * most KNN_MAX_K neighbours are found. Returns the number found.
+ **/
+int
+knn_query(const struct knn *t, tvec3 p, uint32_t skip, int k, uint32_t *indices, float *distances)
+{
+    const float q[3] = {p.x, p.y, p.z};
+    struct query_entry stack[QUERY_STACK];
+    struct heap h;
+    int sp = 0;
+
+    h.num = 0;
+    h.k = k < KNN_MAX_K ? k : KNN_MAX_K;
+
+    if (h.k > 0) {
+        stack[sp++] = (struct query_entry){0, 0, t->num_points, 0.f};
+    }
+
+    while (sp > 0) {
+        struct query_entry e = stack[--sp];
+
+        if (h.num == h.k && e.d2 >= h.d2[0]) {
+            continue;
+        }
+
+        if (e.node >= t->num_splits) {
+            for (size_t x=e.lo; x<e.hi; x++) {
+                const struct knn_point *n = &t->points[x];
+                float dx = n->p[0] - q[0], dy = n->p[1] - q[1], dz = n->p[2] - q[2];
+                float d2 = dx*dx + dy*dy + dz*dz;
+
+                if (n->index != skip) {
+                    heap_push(&h, d2, n->index);
+                }
+            }
+            continue;
+        }
+
+        const struct knn_split *s = &t->splits[e.node];
+        float diff = q[s->axis] - s->value;
+        float far_d2 = diff*diff > e.d2 ? diff*diff : e.d2;
+        size_t mid = e.lo + (e.hi - e.lo) / 2;
+        struct query_entry left = {2*e.node + 1, e.lo, mid, e.d2};
+        struct query_entry right = {2*e.node + 2, mid, e.hi, e.d2};
+
+        /* the far side is pushed first, so the near side is walked next */
+        if (diff < 0.f) {
+            right.d2 = far_d2;
+            stack[sp++] = right;
+            stack[sp++] = left;
+        } else {
+            left.d2 = far_d2;
+            stack[sp++] = left;
+            stack[sp++] = right;
+        }
+    }
+
+    int found = h.num;
+
+    /* taking the farthest off the top fills the output from the back */
+    while (h.num > 0) {
+        int last = --h.num;
+
+        indices[last] = h.index[0];
+        distances[last] = sqrtf(h.d2[0]);
+        heap_sift_down(&h, h.d2[last], h.index[last]);
+    }
+
+    for (int x=found; x<k; x++) {
+        indices[x] = KNN_NONE;
+        distances[x] = -1.f;
+    }
+
+    return found;
+}
+
+/* every thread takes the next block of queries until none are left */
+static void
+query_blocks(void *arg, size_t begin, size_t end)
+{
+    TRACE_SCOPE("knn queries");
+    struct query_job *j = (struct query_job*)arg;
+    size_t num_blocks = (j->num_queries + KNN_BLOCK - 1) / KNN_BLOCK;
+    size_t b;
+
+    while ((b = __atomic_fetch_add(&j->next, 1, __ATOMIC_RELAXED)) < num_blocks) {
+        size_t last = (b+1) * KNN_BLOCK < j->num_queries ? (b+1) * KNN_BLOCK : j->num_queries;
+
+        for (size_t x=b * KNN_BLOCK; x<last; x++) {
+            knn_query(j->t, j->queries[x], j->skip ? j->skip[x] : KNN_NONE, j->k,
+                      j->indices + x * j->k, j->distances + x * j->k);
+        }
+    }
+}
+
+/**
+ * Answer n queries with knn_query() on the worker threads. skip is
+ * NULL or has the point to leave out for every query, and indices and
+ * distances get k entries per query.
+ **/
+void
+knn_query_batch(const struct knn *t, const tvec3 *queries, const uint32_t *skip, size_t n,
+                int k, uint32_t *indices, float *distances)
+{
+    struct query_job j = {t, queries, skip, n, k, indices, distances, 0};
+
+    if (n <= KNN_BLOCK) {
+        query_blocks(&j, 0, 1);
+    } else {
+        worker_parallel_for(worker_num_threads(), query_blocks, &j);
+    }
+}
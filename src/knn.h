@@ -0,0 +1,44 @@
+#ifndef _KNN__H_
+#define _KNN__H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "math/vector.h"
+
+#define KNN_LEAF  16         /* at most this many points per leaf */
+#define KNN_MAX_K 64
+#define KNN_NONE  UINT32_MAX /* no point, for skip and for missing neighbours */
+#define KNN_BLOCK 1024       /* queries per unit of work handed to a thread */
+
+struct knn_point {
+    float    p[3];
+    uint32_t index; /* of the point that was copied */
+};
+
+struct knn_split {
+    float value;
+    int   axis;
+};
+
+/**
+ * A balanced KD-tree over a copy of the points. Every split halves
+ * its range of points, so the tree is implicit: split i has children
+ * 2i+1 and 2i+2 and the leaves are the ranges below the last level.
+ **/
+struct knn {
+    struct knn_point *points;
+    size_t            num_points;
+
+    struct knn_split *splits;
+    size_t            num_splits;
+    int               depth;
+};
+
+int knn_build(struct knn *t, const tvec4 *points, size_t num_points);
+void knn_free(struct knn *t);
+int knn_query(const struct knn *t, tvec3 p, uint32_t skip, int k, uint32_t *indices, float *distances);
+void knn_query_batch(const struct knn *t, const tvec3 *queries, const uint32_t *skip, size_t n,
+                     int k, uint32_t *indices, float *distances);
+
+#endif
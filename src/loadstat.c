@@ -0,0 +1,220 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Load telemetry: time spent per stage of load() with log2 latency
+ * histograms, byte counters, failures by cause and a progress line.
+ *
+ * vips decodes lazily, pixels are only decoded when the scaled image
+ * is pulled into memory, so LOAD_DECODE covers opening the image and
+ * reading its header while LOAD_RESIZE includes decoding the pixels.
+ **/
+
+#include <string.h>
+#include <unistd.h>
+
+#include "megagraph.h"
+#include "loadstat.h"
+
+#define PROGRESS_INTERVAL_TTY  0.25 /* seconds between progress lines */
+#define PROGRESS_INTERVAL_FILE 5.0
+
+static const char *stage_names[LOAD_NUM_STAGES] = {
+    "parse", "fetch", "decode", "resize", "blit", "mipmap", "upload",
+};
+
+static const char *counter_names[LOAD_NUM_COUNTERS] = {
+    "fetched", "files", "uploaded",
+};
+
+static const char *failure_names[LOAD_NUM_FAILURES] = {
+    "parse", "fetch", "http", "decode",
+};
+
+struct stage {
+    double   total;
+    double   max;
+    uint64_t count;
+    uint64_t hist[LOADSTAT_BUCKETS];
+};
+
+static struct {
+    size_t   num_rows;
+    size_t   done;
+    double   start;
+    double   elapsed;
+    double   last_progress;
+    int      tty;
+    int      progress_shown;
+
+    struct stage stages[LOAD_NUM_STAGES];
+    uint64_t counters[LOAD_NUM_COUNTERS];
+    uint64_t failures[LOAD_NUM_FAILURES];
+} ls;
+
+void
+loadstat_begin(size_t num_rows)
+{
+    memset(&ls, 0, sizeof(ls));
+    ls.num_rows = num_rows;
+    ls.start = mg_time();
+    ls.last_progress = ls.start;
+    ls.tty = isatty(fileno(stdout));
+}
+
+void
+loadstat_end(size_t num_rows)
+{
+    ls.done = num_rows;
+    ls.elapsed = mg_time() - ls.start;
+
+    if (ls.progress_shown && ls.tty) {
+        fprintf(stdout, "\n");
+    }
+}
+
+static int
+bucket(double seconds)
+{
+    uint64_t us = (uint64_t)(seconds * 1e6);
+    int b = 0;
+
+    while (us > 0 && b < LOADSTAT_BUCKETS-1) {
+        us >>= 1;
+        b ++;
+    }
+
+    return b;
+}
+
+void
+loadstat_add(int stage, double seconds)
+{
+    struct stage *s = &ls.stages[stage];
+
+    s->total += seconds;
+    s->count ++;
+    if (seconds > s->max) s->max = seconds;
+    s->hist[bucket(seconds)] ++;
+}
+
+void
+loadstat_count(int counter, uint64_t n)
+{
+    ls.counters[counter] += n;
+}
+
+void
+loadstat_fail(int cause)
+{
+    ls.failures[cause] ++;
+}
+
+/**
+ * Print the progress line if enough time has passed since the last
+ * one, on a terminal the line is rewritten in place.
+ **/
+void
+loadstat_progress(size_t done)
+{
+    double now = mg_time();
+    double interval = ls.tty ? PROGRESS_INTERVAL_TTY : PROGRESS_INTERVAL_FILE;
+
+    if (now - ls.last_progress < interval && done < ls.num_rows) {
+        return;
+    }
+    ls.last_progress = now;
+
+    double elapsed = now - ls.start;
+    double rate = elapsed > 0.0 ? done / elapsed : 0.0;
+    double mb = (ls.counters[LOAD_BYTES_FETCHED] + ls.counters[LOAD_BYTES_FILES]) / (1024.0 * 1024.0);
+    int eta = rate > 0.0 ? (int)((ls.num_rows - done) / rate) : 0;
+
+    fprintf(stdout, "%sLoading %zu/%zu (%.1f%%), %.0f rows/s, %.1f MB/s, ETA %d:%02d:%02d%s",
+            ls.tty ? "\r" : "",
+            done, ls.num_rows, ls.num_rows ? 100.0 * done / ls.num_rows : 100.0,
+            rate, elapsed > 0.0 ? mb / elapsed : 0.0,
+            eta / 3600, (eta / 60) % 60, eta % 60,
+            ls.tty ? "   " : "\n");
+    fflush(stdout);
+
+    ls.progress_shown = 1;
+}
+
+/**
+ * Upper bound in milliseconds of the histogram bucket holding the
+ * given fraction of the samples.
+ **/
+static double
+quantile(const struct stage *s, double q)
+{
+    uint64_t target = (uint64_t)(q * s->count), n = 0;
+
+    for (int b=0; b<LOADSTAT_BUCKETS; b++) {
+        n += s->hist[b];
+        if (n > target) {
+            double bound = (double)(1ULL << b) / 1000.0;
+            return bound < s->max * 1000.0 ? bound : s->max * 1000.0;
+        }
+    }
+
+    return s->max * 1000.0;
+}
+
+void
+loadstat_report(FILE *fp)
+{
+    fprintf(fp, "Loaded %zu rows in %.2f s (%.0f rows/s)\n",
+            ls.done, ls.elapsed, ls.elapsed > 0.0 ? ls.done / ls.elapsed : 0.0);
+    fprintf(fp, "%-8s %10s %10s %10s %10s %10s %10s\n",
+            "stage", "count", "total s", "avg ms", "p50 ms<", "p99 ms<", "max ms");
+
+    for (int x=0; x<LOAD_NUM_STAGES; x++) {
+        const struct stage *s = &ls.stages[x];
+        if (s->count == 0) {
+            continue;
+        }
+        fprintf(fp, "%-8s %10llu %10.2f %10.3f %10.3f %10.3f %10.3f\n",
+                stage_names[x], (unsigned long long)s->count, s->total,
+                s->total * 1000.0 / s->count,
+                quantile(s, .5), quantile(s, .99), s->max * 1000.0);
+    }
+
+    for (int x=0; x<LOAD_NUM_COUNTERS; x++) {
+        fprintf(fp, "bytes %-10s %.1f MB\n", counter_names[x], ls.counters[x] / (1024.0 * 1024.0));
+    }
+
+    for (int x=0; x<LOAD_NUM_FAILURES; x++) {
+        if (ls.failures[x] > 0) {
+            fprintf(fp, "failed %-9s %llu\n", failure_names[x], (unsigned long long)ls.failures[x]);
+        }
+    }
+}
+
+void
+loadstat_report_json(FILE *fp)
+{
+    fprintf(fp, "{\n  \"rows\": %zu,\n  \"seconds\": %.6f,\n  \"stages\": {\n", ls.done, ls.elapsed);
+
+    for (int x=0; x<LOAD_NUM_STAGES; x++) {
+        const struct stage *s = &ls.stages[x];
+
+        fprintf(fp, "    \"%s\": {\"count\": %llu, \"total\": %.6f, \"max\": %.6f, \"histogram_us_log2\": [",
+                stage_names[x], (unsigned long long)s->count, s->total, s->max);
+        for (int b=0; b<LOADSTAT_BUCKETS; b++) {
+            fprintf(fp, "%s%llu", b ? ", " : "", (unsigned long long)s->hist[b]);
+        }
+        fprintf(fp, "]}%s\n", x < LOAD_NUM_STAGES-1 ? "," : "");
+    }
+
+    fprintf(fp, "  },\n  \"bytes\": {");
+    for (int x=0; x<LOAD_NUM_COUNTERS; x++) {
+        fprintf(fp, "%s\"%s\": %llu", x ? ", " : "", counter_names[x], (unsigned long long)ls.counters[x]);
+    }
+
+    fprintf(fp, "},\n  \"failures\": {");
+    for (int x=0; x<LOAD_NUM_FAILURES; x++) {
+        fprintf(fp, "%s\"%s\": %llu", x ? ", " : "", failure_names[x], (unsigned long long)ls.failures[x]);
+    }
+    fprintf(fp, "}\n}\n");
+}
@@ -0,0 +1,48 @@
+#ifndef _LOADSTAT__H_
+#define _LOADSTAT__H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+enum {
+    LOAD_PARSE,
+    LOAD_FETCH,
+    LOAD_DECODE,
+    LOAD_RESIZE,
+    LOAD_BLIT,
+    LOAD_MIPMAP,
+    LOAD_UPLOAD,
+
+    LOAD_NUM_STAGES
+};
+
+enum {
+    LOAD_BYTES_FETCHED, /* downloaded over http(s) */
+    LOAD_BYTES_FILES,   /* size of local image files */
+    LOAD_BYTES_UPLOADED,
+
+    LOAD_NUM_COUNTERS
+};
+
+enum {
+    LOAD_FAIL_PARSE,
+    LOAD_FAIL_FETCH,
+    LOAD_FAIL_HTTP,
+    LOAD_FAIL_DECODE,
+
+    LOAD_NUM_FAILURES
+};
+
+#define LOADSTAT_BUCKETS 32 /* latency histogram, bucket n counts times below 2^n microseconds */
+
+void loadstat_begin(size_t num_rows);
+void loadstat_end(size_t num_rows);
+void loadstat_add(int stage, double seconds);
+void loadstat_count(int counter, uint64_t n);
+void loadstat_fail(int cause);
+void loadstat_progress(size_t done);
+void loadstat_report(FILE *fp);
+void loadstat_report_json(FILE *fp);
+
+#endif
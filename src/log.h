@@ -0,0 +1,12 @@
+#ifndef _LOG__H_
+#define _LOG__H_
+
+#include <stdio.h>
+
+#define MG_NAME "MegaGraph"
+#define MG_VERSION "0.9"
+
+#define LOG_I(x, ...) fprintf(stdout, x "\n", ##__VA_ARGS__)
+#define LOG_E(x, ...) fprintf(stderr, x "\n", ##__VA_ARGS__)
+
+#endif
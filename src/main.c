@@ -3,10 +3,30 @@
 #include <vips/vips.h>
 #include <curl/curl.h>
 #include <argp.h>
+#include <sys/stat.h>
+#include <signal.h>
 
 #include "megagraph.h"
 
+#include "atlas.h"
+#include "bench.h"
+#include "dynres.h"
 #include "file.h"
+#include "headless.h"
+#include "loadstat.h"
+#include "memstat.h"
+#include "hud.h"
+#include "octree.h"
+#include "knn.h"
+#include "pick.h"
+#include "poster.h"
+#include "reorder.h"
+#include "compact.h"
+#include "offscreen.h"
+#include "stats.h"
+#include "synth.h"
+#include "trace.h"
+#include "worker.h"
 #include "math/glob.h"
 
 const int WIDTH = 1024*2;
@@ -15,27 +35,79 @@ const int HEIGHT = 768*2;
 #ifndef MIN
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #endif
+#ifndef MAX
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#endif
 
 #define MAX_LINE_LEN (8192*2)
 
+/* longest time to block waiting for events when idle, in seconds */
+#define IDLE_TIMEOUT 0.25
+
+#define MAX_CAMERAS 256
+#define MAX_PICKS 256
+
+/* stdio buffer for reading rows out of order, see --reorder */
+#define ROW_BUFFER_SIZE 1024
+
+/* rows queried at a time by --knn-dump */
+#define KNN_DUMP_BATCH 65536
+
+/* points per vertex buffer, 256 MB of tvec4, well below what drivers allow in one buffer */
+#define VERTEX_CHUNK (1 << 24)
+
 struct megagraph mg;
 
 GLFWwindow    *g_win = 0;
 
-GLuint g_vertex_buf;
-GLuint g_vao;
+/* the points are split over several vertex buffers, see bind_vertices() */
+GLuint *g_vertex_bufs;
+int     g_num_vertex_bufs;
+GLuint  g_index_buf;
+GLuint  g_vao;
+static int g_bound_vertex_buf = -1;
+
+/* the origin and step of every block of vertices with --compact-vertices, per vertex buffer */
+GLuint *g_block_bufs;
+GLuint *g_block_texs;
+
+tvec4         *g_points;
+struct octree  g_octree;
+
+/* where the rows of the data file start, for reporting picked rows */
+static struct file_lines g_lines;
+
+/* the file row of every vertex when --reorder changed the load order, else NULL */
+static uint32_t *g_rows;
+
+static inline uint32_t row_of(uint32_t vertex) {
+    return g_rows ? g_rows[vertex] : vertex;
+}
+
+/* nearest neighbours, see --knn; the picked point and its neighbours are highlighted */
+static struct knn g_knn;
+static uint32_t   g_highlight[KNN_MAX_K + 1];
+static int        g_num_highlight;
 
 extern GLuint g_program; /* shaders.c */
 extern GLuint g_uniform_mv; /* shaders.c */
 extern GLuint g_uniform_p; /* shaders.c */
 extern GLuint g_uniform_tex0; /* shaders.c */
+extern GLuint g_uniform_tile; /* shaders.c */
+extern GLuint g_uniform_tint; /* shaders.c */
+extern GLuint g_uniform_blocks; /* shaders.c */
+extern GLuint g_uniform_max_lod; /* shaders.c */
+extern GLuint g_uniform_viewport; /* shaders.c */
 
 int g_image_height = 64;
 int g_image_width = 64;
 int g_texture_width = 4096;
 int g_texture_height = 4096;
+int g_texture_levels = 1;
 GLint g_texture_format = GL_COMPRESSED_RGB;
 
+unsigned char **g_mip_bufs;
+
 GLuint *g_textures;
 int g_num_textures;
 
@@ -43,12 +115,78 @@ static inline int num_images_per_texture() {
     return (g_texture_width / g_image_width) * (g_texture_height / g_image_height);
 }
 
-int g_num_objects = 0;
+size_t g_num_objects = 0;
+
+/* vertex buffers hold whole atlases, so that a draw never spans two */
+static inline size_t vertices_per_buffer() {
+    return VERTEX_CHUNK / num_images_per_texture() * num_images_per_texture();
+}
+
+/* per-frame draw lists, see draw_lod() */
+static GLsizei       *g_draw_counts;
+static const GLvoid **g_draw_offsets;
+static GLint         *g_draw_base;
+static size_t         g_draw_cap;
+static size_t        *g_draw_texture_start;
+static size_t        *g_draw_texture_count;
+static int           *g_draw_texture_order;
+
+/* dynamic resolution, see --target-ms */
+static struct dynres    g_dynres;
+static struct offscreen g_offscreen;
+
+/* camera path playback and recording, see --bench and --record */
+static struct bench          g_bench;
+static struct bench_recorder g_recorder;
+
+/* work submitted by the last render() */
+static uint64_t g_frame_draws;
+static uint64_t g_frame_points;
+
+/* replaces the camera's projection while rendering poster tiles */
+static const float *g_tile_projection;
+
+/* set by SIGUSR1 to have the memory ledger printed */
+static volatile sig_atomic_t g_dump_memory = 0;
+
+/* overdraw measurement, see --overdraw */
+static GLuint   g_overdraw_query;
+static int      g_overdraw_pending = 0;
+static uint64_t g_overdraw_samples = 0;
+static uint64_t g_overdraw_pixels = 0;
+static double   g_overdraw_last_report = 0.0;
 
 static int frame();
+static void render(int w, int h);
+static void draw_highlight();
+static int run_headless();
+static int run_poster();
+static void finish_run();
+static void default_camera();
+static int estimate_memory(const char *filename);
+static size_t texture_gpu_size();
+static void on_sigusr1(int sig);
+static void account_index();
+static int run_headless_bench(struct offscreen *target);
+static void report_bench();
 static int load(const char *filename);
-int compile_shaders(); /* shaders.c */
+static size_t read_order(FILE *fp, size_t num_lines, long *offsets);
+static void upload_vertices(size_t num);
+static void bind_vertices(int b);
+static int build_lod();
+static int build_knn();
+static void neighbours(uint32_t row);
+static int dump_knn(const char *filename);
+static int pick(float x, float y);
+static void upload_texture(unsigned char *pbuf);
+static void draw_lod();
+static void overdraw_begin(int w, int h);
+static void overdraw_end();
+static void overdraw_finish();
+static void draw_hud(int w, int h);
+int compile_shaders(int compact); /* shaders.c */
 static void on_glfw_error(int error, const char *description);
+static void on_glfw_refresh(GLFWwindow *win);
 
 struct buf {
     char *ptr;
@@ -61,13 +199,14 @@ write_to_buf(void *contents, size_t size, size_t nmemb, void *userp) {
     size_t nbytes = size * nmemb;
     struct buf *b = (struct buf*)userp;
     if ((b->size + nbytes + 1) > b->alloc_size) {
-        size_t alloc_size = (size_t)(b->ptr + nbytes + 1024);
+        size_t alloc_size = b->size + nbytes + 1024;
         b->ptr = realloc(b->ptr, alloc_size);
         if (b->ptr == NULL) {
             LOG_E("out of mem");
             exit(1);
         }
         b->alloc_size = alloc_size;
+        mem_set(MEM_CURL, MEM_HOST, alloc_size);
     }
 
     memcpy(&(b->ptr[b->size]), contents, nbytes);
@@ -82,11 +221,69 @@ const char *argp_program_bug_address = "<megagraph@teorem.se>";
 static char doc[] = "MegaGraph -- big data visualization tool.";
 static char args_doc[] = "FILE";
 
+enum {
+    OPT_FRONT_TO_BACK = 0x100,
+    OPT_OVERDRAW,
+    OPT_GUTTER,
+    OPT_NO_MIPMAPS,
+    OPT_THREADS,
+    OPT_CONTINUOUS,
+    OPT_TARGET_MS,
+    OPT_HEADLESS,
+    OPT_CAMERA,
+    OPT_OUTPUT,
+    OPT_SIZE,
+    OPT_PICK,
+    OPT_HUD,
+    OPT_FRAME_CSV,
+    OPT_BENCH,
+    OPT_RECORD,
+    OPT_LOAD_JSON,
+    OPT_MEMORY_ESTIMATE,
+    OPT_POSTER,
+    OPT_POSTER_TILE,
+    OPT_TRACE,
+    OPT_BENCH_JSON,
+    OPT_NO_OCTREE_CACHE,
+    OPT_KNN,
+    OPT_KNN_DUMP,
+    OPT_REORDER,
+    OPT_COMPACT_VERTICES,
+};
+
 static struct argp_option options[] = {
     {"prefix", 'p', "PREFIX", 0, "Append PREFIX to all files."},
     {"scale", 's', "SCALE", 0, "Multiply input vectors with SCALE"},
     {"load-params", 'l', "PARAMS", 0, "Image parameters, i.e. shrink=2"},
     {"head", 'h', "N", 0, "Only load first N lines"},
+    {"lod", 'L', "PIXELS", 0, "Level of detail screen-space error threshold in pixels, 0 draws every point (default 4)"},
+    {"no-octree-cache", OPT_NO_OCTREE_CACHE, 0, 0, "Always build the octree, instead of reading it from or writing it to FILE.octree"},
+    {"reorder", OPT_REORDER, "CURVE", 0, "Load the rows along a morton or hilbert curve, so that nearby rows share atlases (default none)"},
+    {"compact-vertices", OPT_COMPACT_VERTICES, 0, 0, "Store points in 8 bytes instead of 16 on the gpu, with positions quantized to 16 bits"},
+    {"front-to-back", OPT_FRONT_TO_BACK, 0, 0, "Draw octree nodes and textures nearest first, for early depth rejection"},
+    {"overdraw", OPT_OVERDRAW, 0, 0, "Log the number of samples passing the depth test per pixel once per second"},
+    {"gutter", OPT_GUTTER, "N", 0, "Pad every image in the texture atlases with N edge pixels (default 2)"},
+    {"no-mipmaps", OPT_NO_MIPMAPS, 0, 0, "Sample the texture atlases without mipmaps"},
+    {"threads", OPT_THREADS, "N", 0, "Number of worker threads, default is one per cpu"},
+    {"continuous", OPT_CONTINUOUS, 0, 0, "Redraw every frame even if nothing changed, for benchmarks"},
+    {"target-ms", OPT_TARGET_MS, "MS", 0, "Scale the render resolution to keep frames within MS milliseconds"},
+    {"headless", OPT_HEADLESS, 0, 0, "Render without a window and write one image per --camera"},
+    {"camera", OPT_CAMERA, "SPEC", 0, "Camera as ANGLE,DIST or ANGLE,DIST,LX,LY,LZ or EX,EY,EZ,LX,LY,LZ, may be repeated"},
+    {"output", OPT_OUTPUT, "FILE", 0, "Headless output file name, may contain a %d for the camera number (default frame-%03d.png)"},
+    {"size", OPT_SIZE, "WxH", 0, "Headless image size (default 2048x1536)"},
+    {"pick", OPT_PICK, "X,Y", 0, "Log the row under pixel X,Y from the top left of every headless image, may be repeated"},
+    {"knn", OPT_KNN, "K", 0, "Find the K nearest rows of every picked row, and highlight them on screen"},
+    {"knn-dump", OPT_KNN_DUMP, "FILE", 0, "Write the --knn (default 10) nearest rows of every row to FILE, - for stdout, then exit"},
+    {"poster", OPT_POSTER, "WxH", 0, "Render one image of any size from the first --camera in tiles, at full detail, to --output and exit"},
+    {"poster-tile", OPT_POSTER_TILE, "N", 0, "Poster tile size in pixels (default 4096)"},
+    {"hud", OPT_HUD, 0, 0, "Show per-stage frame times on screen, toggled with H"},
+    {"frame-csv", OPT_FRAME_CSV, "FILE", 0, "Write per-stage frame times in milliseconds to FILE, one line per frame"},
+    {"bench", OPT_BENCH, "PATH", 0, "Play back the camera path in PATH without vsync and report frame times, then exit"},
+    {"bench-json", OPT_BENCH_JSON, "FILE", 0, "Also write the --bench results as JSON to FILE, - for stdout"},
+    {"record", OPT_RECORD, "PATH", 0, "Record the camera path of the session to PATH, for --bench"},
+    {"memory-estimate", OPT_MEMORY_ESTIMATE, 0, 0, "Print the memory needed for FILE per subsystem without loading it, then exit"},
+    {"load-json", OPT_LOAD_JSON, "FILE", 0, "Write load timings, histograms and failures as JSON to FILE, - for stdout"},
+    {"trace", OPT_TRACE, "FILE", 0, "Record loader and render thread activity and write it to FILE as Chrome trace JSON on exit"},
     {0}
 };
 
@@ -96,8 +293,70 @@ struct arguments {
     const char *load_params;
     int head;
     float scale;
+    float lod;
+    int front_to_back;
+    int overdraw;
+    int gutter;
+    int no_mipmaps;
+    int continuous;
+    float target_ms;
+    int headless;
+    struct view cameras[MAX_CAMERAS];
+    int num_cameras;
+    const char *output;
+    int width;
+    int height;
+    float picks[MAX_PICKS][2];
+    int num_picks;
+    int hud;
+    const char *frame_csv;
+    const char *bench;
+    const char *bench_json;
+    const char *record;
+    const char *load_json;
+    int memory_estimate;
+    int poster_width;
+    int poster_height;
+    int poster_tile;
+    const char *trace;
+    int no_octree_cache;
+    int knn;
+    const char *knn_dump;
+    enum reorder_curve reorder;
+    int compact_vertices;
 } arguments;
 
+/**
+ * The --output name is used as a printf format for the image number,
+ * so it may hold at most one %d or %i, with flags, width and
+ * precision, and no other conversion than %%. Returns 0 if valid.
+ **/
+static int check_output_pattern(const char *s) {
+    int conversions = 0;
+
+    for (; *s; s++) {
+        if (*s != '%') {
+            continue;
+        }
+        if (*++s == '%') {
+            continue;
+        }
+
+        s += strspn(s, "-+ #0");
+        s += strspn(s, "0123456789");
+        if (*s == '.') {
+            s ++;
+            s += strspn(s, "0123456789");
+        }
+
+        if ((*s != 'd' && *s != 'i') || ++conversions > 1) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 static error_t
 parse_opt(int key, char *arg, struct argp_state *state) {
     struct arguments *arguments = state->input;
@@ -119,6 +378,154 @@ parse_opt(int key, char *arg, struct argp_state *state) {
             arguments->load_params = arg;
             break;
 
+        case 'L':
+            arguments->lod = atof(arg);
+            break;
+
+        case OPT_FRONT_TO_BACK:
+            arguments->front_to_back = 1;
+            break;
+
+        case OPT_OVERDRAW:
+            arguments->overdraw = 1;
+            break;
+
+        case OPT_GUTTER:
+            arguments->gutter = atoi(arg);
+            break;
+
+        case OPT_NO_MIPMAPS:
+            arguments->no_mipmaps = 1;
+            break;
+
+        case OPT_THREADS:
+            worker_set_num_threads(atoi(arg));
+            break;
+
+        case OPT_CONTINUOUS:
+            arguments->continuous = 1;
+            break;
+
+        case OPT_TARGET_MS:
+            arguments->target_ms = atof(arg);
+            break;
+
+        case OPT_HEADLESS:
+            arguments->headless = 1;
+            break;
+
+        case OPT_CAMERA:
+            if (arguments->num_cameras >= MAX_CAMERAS) {
+                argp_error(state, "too many cameras");
+            }
+            if (view_parse(&arguments->cameras[arguments->num_cameras], arg) != 0) {
+                argp_error(state, "invalid camera '%s'", arg);
+            }
+            arguments->num_cameras ++;
+            break;
+
+        case OPT_OUTPUT:
+            if (check_output_pattern(arg) != 0) {
+                argp_error(state, "--output may hold one %%d for the image number and no other %% but %%%%");
+            }
+            arguments->output = arg;
+            break;
+
+        case OPT_SIZE:
+            if (sscanf(arg, "%dx%d", &arguments->width, &arguments->height) != 2
+                    || arguments->width <= 0 || arguments->height <= 0) {
+                argp_error(state, "invalid size '%s'", arg);
+            }
+            break;
+
+        case OPT_PICK:
+            if (arguments->num_picks >= MAX_PICKS) {
+                argp_error(state, "too many picks");
+            }
+            if (sscanf(arg, "%f,%f", &arguments->picks[arguments->num_picks][0],
+                       &arguments->picks[arguments->num_picks][1]) != 2) {
+                argp_error(state, "invalid pick '%s'", arg);
+            }
+            arguments->num_picks ++;
+            break;
+
+        case OPT_HUD:
+            arguments->hud = 1;
+            break;
+
+        case OPT_FRAME_CSV:
+            arguments->frame_csv = arg;
+            break;
+
+        case OPT_BENCH:
+            arguments->bench = arg;
+            break;
+
+        case OPT_BENCH_JSON:
+            arguments->bench_json = arg;
+            break;
+
+        case OPT_RECORD:
+            arguments->record = arg;
+            break;
+
+        case OPT_LOAD_JSON:
+            arguments->load_json = arg;
+            break;
+
+        case OPT_MEMORY_ESTIMATE:
+            arguments->memory_estimate = 1;
+            break;
+
+        case OPT_POSTER:
+            if (sscanf(arg, "%dx%d", &arguments->poster_width, &arguments->poster_height) != 2
+                    || arguments->poster_width <= 0 || arguments->poster_height <= 0) {
+                argp_error(state, "invalid poster size '%s'", arg);
+            }
+            break;
+
+        case OPT_POSTER_TILE:
+            arguments->poster_tile = atoi(arg);
+            if (arguments->poster_tile <= 0) {
+                argp_error(state, "invalid tile size '%s'", arg);
+            }
+            break;
+
+        case OPT_TRACE:
+            arguments->trace = arg;
+            break;
+
+        case OPT_NO_OCTREE_CACHE:
+            arguments->no_octree_cache = 1;
+            break;
+
+        case OPT_KNN:
+            arguments->knn = atoi(arg);
+            if (arguments->knn < 0 || arguments->knn > KNN_MAX_K) {
+                argp_error(state, "--knn must be 0 to %d", KNN_MAX_K);
+            }
+            break;
+
+        case OPT_KNN_DUMP:
+            arguments->knn_dump = arg;
+            break;
+
+        case OPT_REORDER:
+            if (strcmp(arg, "none") == 0) {
+                arguments->reorder = REORDER_NONE;
+            } else if (strcmp(arg, "morton") == 0) {
+                arguments->reorder = REORDER_MORTON;
+            } else if (strcmp(arg, "hilbert") == 0) {
+                arguments->reorder = REORDER_HILBERT;
+            } else {
+                argp_error(state, "unknown curve '%s'", arg);
+            }
+            break;
+
+        case OPT_COMPACT_VERTICES:
+            arguments->compact_vertices = 1;
+            break;
+
         case ARGP_KEY_ARG:
             if (state->arg_num > 1) {
                 argp_usage(state);
@@ -147,52 +554,94 @@ int main(int argc, char* argv[]) {
     arguments.scale = 1.0f;
     arguments.prefix = "";
     arguments.head = 0;
+    arguments.lod = 4.f;
+    arguments.gutter = 2;
+    arguments.output = "frame-%03d.png";
+    arguments.width = WIDTH;
+    arguments.height = HEIGHT;
+    arguments.poster_tile = 4096;
 
     argp_parse(&argp, argc, argv, 0, 0, &arguments);
 
+    if (arguments.bench && bench_load(&g_bench, arguments.bench) != 0) {
+        exit(1);
+    }
+
+    if (arguments.trace) {
+        if (trace_open(arguments.trace) != 0) {
+            exit(1);
+        }
+        trace_thread_name("main");
+    }
+
     VIPS_INIT(argv[0]);
     curl_global_init(CURL_GLOBAL_ALL);
 
-    glfwSetErrorCallback(on_glfw_error);
+    if (arguments.headless) {
+        if (headless_init() != 0) {
+            LOG_E("could not create headless context");
+            return 1;
+        }
+    } else {
+        glfwSetErrorCallback(on_glfw_error);
 
-    if (!glfwInit()) {
-        LOG_E("glfw init error");
-        return 1;
-    }
+        if (!glfwInit()) {
+            LOG_E("glfw init error");
+            return 1;
+        }
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
-    if (!(g_win = glfwCreateWindow(WIDTH, HEIGHT, "MegaGraph", NULL, NULL))) {
-        LOG_E("Could not create window");
-        return 1;
-    }
+        if (!(g_win = glfwCreateWindow(WIDTH, HEIGHT, "MegaGraph", NULL, NULL))) {
+            LOG_E("Could not create window");
+            return 1;
+        }
 
-    glfwMakeContextCurrent(g_win);
+        glfwMakeContextCurrent(g_win);
 
-    LOG_I("GLFW did its job.");
+        LOG_I("GLFW did its job.");
 
-    if (!gladLoadGL()) {
-        LOG_E("GLAD failed");
-        return 1;
-    }
+        if (!gladLoadGL()) {
+            LOG_E("GLAD failed");
+            return 1;
+        }
 
-    gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+        gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    }
 
     LOG_I("OpenGL %s, GLSL %s", glGetString(GL_VERSION), glGetString(GL_SHADING_LANGUAGE_VERSION));
 
     const char *filename = arguments.args[0];
 
-    if (compile_shaders() != 0) {
-        LOG_E("failed compiling shaders");
-        exit(1);
+    if (arguments.memory_estimate) {
+        return estimate_memory(filename);
     }
     if (load(filename) != 0) {
         LOG_E("loading data failed");
         exit(1);
     }
+    /* after loading, which may turn --compact-vertices off */
+    if (compile_shaders(arguments.compact_vertices) != 0) {
+        LOG_E("failed compiling shaders");
+        exit(1);
+    }
+    if (build_lod() != 0) {
+        LOG_E("building level of detail failed");
+        exit(1);
+    }
+    if ((arguments.knn > 0 || arguments.knn_dump) && build_knn() != 0) {
+        LOG_E("building nearest neighbours failed");
+        exit(1);
+    }
+
+    if (arguments.knn_dump) {
+        int r = dump_knn(arguments.knn_dump);
+        finish_run();
+        return r;
+    }
 
     mg.cam = tcam_alloc();
 
@@ -203,19 +652,78 @@ int main(int argc, char* argv[]) {
     tcam_set_position(mg.cam, 0.0f, 0.0f, 0.0f);
     tcam_set_direction(mg.cam, 0.0f, 0.0f, 1.0f);
 
+    if (arguments.hud || arguments.frame_csv) {
+        if (stats_init(arguments.frame_csv) != 0 || hud_init() != 0) {
+            exit(1);
+        }
+        mg.hud = arguments.hud;
+    }
+
+    if (arguments.poster_width > 0) {
+        int r = run_poster();
+        finish_run();
+        return r;
+    }
+
+    if (arguments.headless) {
+        int r = run_headless();
+        finish_run();
+        return r;
+    }
+
+    signal(SIGUSR1, on_sigusr1);
+
     glfwSetKeyCallback(g_win, on_glfw_key);
+    glfwSetMouseButtonCallback(g_win, on_glfw_mouse_button);
+    glfwSetWindowRefreshCallback(g_win, on_glfw_refresh);
+
+    if (arguments.target_ms > 0.f) {
+        dynres_init(&g_dynres, arguments.target_ms / 1000.f);
+    }
+
+    /* benchmarks measure how fast frames can be drawn, not the display rate */
+    glfwSwapInterval(arguments.bench ? 0 : 1);
 
-    glfwSwapInterval(1);
+    mg.last_time = mg_time();
+    mg.redraw = 1;
 
-    mg.last_time = glfwGetTime();
+    if (arguments.record && bench_record_open(&g_recorder, arguments.record, mg.last_time) != 0) {
+        exit(1);
+    }
 
     while (!glfwWindowShouldClose(g_win)) {
-        glfwPollEvents();
+        if (arguments.continuous || arguments.bench || mg.redraw || input_active()) {
+            glfwPollEvents();
+        } else {
+            /* nothing changed, sleep until something does */
+            glfwWaitEventsTimeout(IDLE_TIMEOUT);
+
+            /* the time spent waiting is not input time */
+            mg.last_time = mg_time();
+        }
 
         if (frame() != 0) {
             break;
         }
+
+        if (g_dump_memory) {
+            g_dump_memory = 0;
+            account_index();
+            mem_report(stdout);
+        }
+    }
+
+    glFinish();
+    stats_shutdown();
+
+    if (arguments.bench) {
+        report_bench();
     }
+    bench_record_close(&g_recorder, mg_time());
+
+    account_index();
+    mem_report(stdout);
+    trace_close();
 
     glfwDestroyWindow(g_win);
     glfwTerminate();
@@ -226,10 +734,180 @@ int main(int argc, char* argv[]) {
     return 0;
 }
 
+/**
+ * Report memory, write --trace and tear everything down at the end of
+ * a run that does not go through the window's main loop.
+ **/
+static void finish_run() {
+    stats_shutdown();
+
+    account_index();
+    mem_report(stdout);
+    trace_close();
+
+    if (arguments.headless) {
+        headless_shutdown();
+    } else {
+        glfwDestroyWindow(g_win);
+        glfwTerminate();
+    }
+    curl_global_cleanup();
+    vips_shutdown();
+}
+
+/**
+ * Render one image per --camera into an offscreen framebuffer and
+ * write them to --output.
+ **/
+static int run_headless() {
+    struct offscreen target = {0};
+    char filename[1024];
+
+    default_camera();
+
+    if (offscreen_resize(&target, arguments.width, arguments.height) != 0) {
+        return 1;
+    }
+
+    if (arguments.bench) {
+        int r = run_headless_bench(&target);
+        offscreen_free(&target);
+        return r;
+    }
+
+    for (int x=0; x<arguments.num_cameras; x++) {
+        mg.view = arguments.cameras[x];
+
+        glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+
+        double start = mg_time();
+        stats_frame_begin();
+        render(target.width, target.height);
+        stats_frame_end();
+        glFinish();
+        double elapsed = mg_time() - start;
+
+        snprintf(filename, sizeof(filename), arguments.output, x);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fbo);
+        if (headless_write_image(filename, target.width, target.height) != 0) {
+            offscreen_free(&target);
+            return 1;
+        }
+
+        LOG_I("Wrote %s (%dx%d, rendered in %.2f ms)", filename, target.width, target.height, elapsed * 1000.0);
+
+        /* pixel centers, with y flipped to the camera's bottom left origin */
+        for (int p=0; p<arguments.num_picks; p++) {
+            pick(arguments.picks[p][0] + 0.5f, target.height - arguments.picks[p][1] - 0.5f);
+        }
+    }
+
+    overdraw_finish();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    offscreen_free(&target);
+
+    return 0;
+}
+
+/**
+ * Without a --camera, orbit the middle of the data far enough to see
+ * all of it.
+ **/
+static void default_camera() {
+    if (arguments.num_cameras == 0 && g_octree.num_nodes > 0) {
+        struct view *v = &arguments.cameras[arguments.num_cameras++];
+        memset(v, 0, sizeof(struct view));
+        v->lookat = g_octree.nodes[0].center;
+        v->dist = g_octree.nodes[0].half * 3.f;
+    }
+}
+
+static void render_poster_tile(void *arg, int w, int h, const float *projection) {
+    g_tile_projection = projection;
+    render(w, h);
+    g_tile_projection = 0;
+}
+
+/**
+ * Export --poster from the first camera. Every point is drawn, with
+ * the level of detail chosen for a single tile the poster would lose
+ * detail where it has the most pixels.
+ **/
+static int run_poster() {
+    char filename[1024];
+
+    default_camera();
+    mg.view = arguments.cameras[0];
+
+    /* tcam_calculate() builds the full frustum from the poster's aspect */
+    mg.cam->width = arguments.poster_width;
+    mg.cam->height = arguments.poster_height;
+    view_apply(&mg.view, mg.cam);
+
+    struct tcam full = *mg.cam;
+    float lod = arguments.lod;
+
+    arguments.lod = 0.f;
+    snprintf(filename, sizeof(filename), arguments.output, 0);
+
+    int r = poster_export(filename, arguments.poster_width, arguments.poster_height,
+                          arguments.poster_tile, &full, render_poster_tile, 0);
+
+    arguments.lod = lod;
+
+    return r;
+}
+
+/**
+ * Play back --bench offscreen, every frame is waited for with
+ * glFinish() so that its time includes the work done by the gpu.
+ **/
+static int run_headless_bench(struct offscreen *target) {
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+
+    while (bench_next(&g_bench, &mg.view)) {
+        TRACE_SCOPE("frame");
+        double start = mg_time();
+        stats_frame_begin();
+        render(target->width, target->height);
+        stats_frame_end();
+        glFinish();
+
+        bench_frame(&g_bench, mg_time() - start, g_frame_draws, g_frame_points);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    overdraw_finish();
+    report_bench();
+
+    return 0;
+}
+
+static void report_bench() {
+    bench_report(&g_bench);
+
+    if (arguments.bench_json) {
+        FILE *fp = strcmp(arguments.bench_json, "-") == 0 ? stdout : fopen(arguments.bench_json, "w");
+        if (!fp) {
+            LOG_E("could not open %s", arguments.bench_json);
+        } else {
+            bench_report_json(&g_bench, fp);
+            if (fp != stdout) {
+                fclose(fp);
+            }
+        }
+    }
+
+    bench_free(&g_bench);
+}
+
 static int load(const char *filename) {
+    TRACE_SCOPE("load");
     LOG_I("Loading '%s'", filename);
     char line[MAX_LINE_LEN];
-    int num_read = 0;
+    size_t num_read = 0;
 
     FILE *fp = fopen(filename, "rb+");
 
@@ -238,22 +916,34 @@ static int load(const char *filename) {
         exit(1);
     }
 
-    int num_lines = file_count_occurrences(fp, '\n');
+    size_t num_lines = file_count_occurrences(fp, '\n');
 
-    if (arguments.head > 0 && num_lines > arguments.head) {
+    if (arguments.head > 0 && num_lines > (size_t)arguments.head) {
         num_lines = arguments.head;
     }
 
-    LOG_I("Object count:\t%d", num_lines);
+    LOG_I("Object count:\t%zu", num_lines);
+
+    /* octree, pick and k-NN indices are 32 bit, and base vertices of draws are a GLint */
+    if (num_lines > INT32_MAX) {
+        LOG_E("at most %d rows can be loaded", INT32_MAX);
+        exit(1);
+    }
+
+    size_t vertex_buf_size = num_lines * sizeof(tvec4);
 
-    int vertex_buf_size = num_lines * sizeof(tvec4);
-    int image_buf_size = num_lines * 16 * 16 * sizeof(uint32_t);
+    g_num_textures = (int)(num_lines / num_images_per_texture() + 1);
+
+    if (arguments.gutter < 0 || arguments.gutter * 2 >= g_image_width) {
+        LOG_E("invalid gutter size");
+        exit(1);
+    }
 
-    g_num_textures = num_lines / num_images_per_texture() + 1;
+    g_texture_levels = arguments.no_mipmaps ? 1 : atlas_num_levels(g_image_width);
 
-    LOG_I("Vertex buffer:\t%d bytes", vertex_buf_size);
-    LOG_I("Image buffer:\t%d bytes", image_buf_size);
+    LOG_I("Vertex buffer:\t%zu bytes", vertex_buf_size);
     LOG_I("Num textures:\t%d", g_num_textures);
+    LOG_I("Texture levels:\t%d", g_texture_levels);
 
     /* create textures */
     g_textures = (GLuint*)malloc(g_num_textures * sizeof(GLuint));
@@ -265,31 +955,63 @@ static int load(const char *filename) {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        g_texture_levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, g_texture_levels - 1);
+        mem_add(MEM_ATLAS, MEM_GPU, texture_gpu_size());
     }
     glBindTexture(GL_TEXTURE_2D, 0);
 
     glGenVertexArrays(1, &g_vao);
     glBindVertexArray(g_vao);
 
-    glGenBuffers(1, &g_vertex_buf);
-    glBindBuffer(GL_ARRAY_BUFFER, g_vertex_buf);
-    glBufferData(GL_ARRAY_BUFFER, vertex_buf_size, 0, GL_STATIC_DRAW);
-
-    tvec4 *buf = (tvec4*)glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+    /* positions are kept in host memory for the spatial index */
+    g_points = (tvec4*)malloc(vertex_buf_size);
+    tvec4 *buf = g_points;
 
     if (!buf) {
-        LOG_E("Could not map buffer: %d", glGetError());
+        LOG_E("out of mem");
         exit(1);
     }
+    mem_set(MEM_VERTEX, MEM_HOST, vertex_buf_size);
 
     rewind(fp);
 
+    if (file_lines_add(&g_lines, 0) != 0) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+
+    /* with --reorder the rows are read in curve order, one seek each */
+    long *offsets = 0;
+    FILE *rows_fp = fp;
+
+    if (arguments.reorder != REORDER_NONE) {
+        offsets = (long*)malloc(num_lines * sizeof(long) + 1);
+        g_rows = (uint32_t*)malloc(num_lines * sizeof(uint32_t) + 1);
+        if (!offsets || !g_rows) {
+            LOG_E("out of mem");
+            exit(1);
+        }
+        mem_add(MEM_VERTEX, MEM_HOST, num_lines * sizeof(uint32_t));
+        mem_add(MEM_STAGING, MEM_HOST, num_lines * sizeof(long));
+
+        num_lines = read_order(fp, num_lines, offsets);
+
+        /* a small buffer, as little is read after every seek */
+        if (!(rows_fp = fopen(filename, "rb"))) {
+            LOG_E("could not open file");
+            exit(1);
+        }
+        setvbuf(rows_fp, 0, _IOFBF, ROW_BUFFER_SIZE);
+    }
+
     CURL *curl_h;
     CURLcode cres;
     struct buf tmp_buf;
     tmp_buf.ptr = malloc(1024*1024);
     tmp_buf.alloc_size = 1024*1024;
+    mem_set(MEM_CURL, MEM_HOST, tmp_buf.alloc_size);
     tmp_buf.size = 0;
     curl_h = curl_easy_init();
     curl_easy_setopt(curl_h, CURLOPT_WRITEFUNCTION, write_to_buf);
@@ -305,11 +1027,34 @@ static int load(const char *filename) {
     unsigned char *pbuf = (unsigned char*)malloc(texture_size);
 
     memset(pbuf, 0, texture_size);
+    mem_add(MEM_STAGING, MEM_HOST, texture_size);
+
+    g_mip_bufs = (unsigned char**)calloc(g_texture_levels, sizeof(unsigned char*));
+    for (int l=1; l<g_texture_levels; l++) {
+        g_mip_bufs[l] = (unsigned char*)malloc(atlas_level_size(g_texture_width, g_texture_height, l));
+        if (!g_mip_bufs[l]) {
+            LOG_E("out of mem");
+            exit(1);
+        }
+        mem_add(MEM_STAGING, MEM_HOST, atlas_level_size(g_texture_width, g_texture_height, l));
+    }
+
+    /* the image is scaled to fit inside the tile's gutter */
+    int gutter = arguments.gutter;
+    int inner_width = g_image_width - 2*gutter;
+    int inner_height = g_image_height - 2*gutter;
 
     glActiveTexture(GL_TEXTURE0);
 
     VipsInterpolate *interp = vips_interpolate_new("linear");
 
+    unsigned char *synth_buf = (unsigned char*)malloc(inner_width * inner_height * 3);
+    if (!synth_buf) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+    mem_add(MEM_STAGING, MEM_HOST, inner_width * inner_height * 3);
+
     char url[512], full_url[1024+256];
     char params[256];
     params[0] = '\0';
@@ -317,30 +1062,44 @@ static int load(const char *filename) {
         sprintf(params, "[%.255s]", arguments.load_params);
     }
 
+    loadstat_begin(num_lines);
+
     int i = 0;
-    while (fgets(line, MAX_LINE_LEN, fp) == line && num_read < num_lines) {
+    while (num_read < num_lines
+           && (!offsets || fseek(rows_fp, offsets[g_rows[num_read]], SEEK_SET) == 0)
+           && fgets(line, MAX_LINE_LEN, rows_fp) == line) {
+        TRACE_SCOPE("row");
+        double t;
+
+        if (!offsets && (num_read + 1) % FILE_LINE_STRIDE == 0 && file_lines_add(&g_lines, ftell(fp)) != 0) {
+            LOG_E("out of mem");
+            exit(1);
+        }
 
-        fprintf(stdout, "\rLoading buffers (%d/%d) ...", num_read, num_lines);
+        loadstat_progress(num_read);
 
-        i = (num_read % images_per_texture);
+        i = (int)(num_read % images_per_texture);
         if (i == 0) {
             current_texture ++;
 
             if (current_texture > 0) {
-                glTexImage2D(GL_TEXTURE_2D, 0, g_texture_format, g_texture_width, g_texture_height,
-                            0, GL_RGB, GL_UNSIGNED_BYTE, pbuf);
+                upload_texture(pbuf);
                 memset(pbuf, 0, texture_size);
             }
 
             glBindTexture(GL_TEXTURE_2D, g_textures[current_texture]);
-
-            fprintf(stdout, "\n");
-            LOG_I("Texture %d...", current_texture);
         }
 
-        /* pack the index into the texture in the w component */
+        t = mg_time();
+
+        /* pack the index into the texture in the w component; a row
+         * that does not parse keeps its place, at the origin */
+        buf->r = buf->g = buf->b = 0.f;
         buf->a = (float)i;
-        sscanf(line, "%f %f %f %511s", &buf->r, &buf->g, &buf->b, url);
+        url[0] = '\0';
+        if (sscanf(line, "%f %f %f %511s", &buf->r, &buf->g, &buf->b, url) < 3) {
+            loadstat_fail(LOAD_FAIL_PARSE);
+        }
 
         buf->r *= arguments.scale;
         buf->g *= arguments.scale;
@@ -353,26 +1112,94 @@ static int load(const char *filename) {
             strcpy(url, "test.jpg");
         }
 
-        sprintf(full_url, "%.511s%.512s", arguments.prefix, url);
+        if (synth_is_url(url)) {
+            loadstat_add(LOAD_PARSE, mg_time() - t);
 
-        VipsImage *img = 0,
-                  *img_cropped = 0,
-                  *img_scaled = 0;
+            /* procedural thumbnail from megagraph-gen, nothing to fetch or decode */
+            struct trace_scope ts = trace_begin("decode");
+            t = mg_time();
+            synth_thumbnail(url, synth_buf, inner_width, inner_height);
+            loadstat_add(LOAD_DECODE, mg_time() - t);
+            trace_end(&ts);
 
-        if (strncmp(full_url, "http://", 7) == 0 || strncmp(full_url, "https://", 8) == 0) {
-            /* download the file to memory */
-            tmp_buf.size = 0;
-            curl_easy_setopt(curl_h, CURLOPT_URL, full_url);
+            t = mg_time();
+
+            for (int y=0; y<inner_height; y++) {
+                for (int x=0; x<inner_width; x++) {
+                    unsigned char *pixel = synth_buf + (y*inner_width + x)*3;
+
+                    pbuf[((sx*g_image_width+gutter+x)*3) + (((sy+1)*g_image_height-1-gutter-y)*g_texture_width*3) + 0] = *(pixel);
+                    pbuf[((sx*g_image_width+gutter+x)*3) + (((sy+1)*g_image_height-1-gutter-y)*g_texture_width*3) + 1] = *(pixel+1);
+                    pbuf[((sx*g_image_width+gutter+x)*3) + (((sy+1)*g_image_height-1-gutter-y)*g_texture_width*3) + 2] = *(pixel+2);
+                }
+            }
+
+            atlas_fill_gutter(pbuf, g_texture_width, sx*g_image_width, sy*g_image_height,
+                              g_image_width, gutter);
+            loadstat_add(LOAD_BLIT, mg_time() - t);
+
+            buf ++;
+            num_read ++;
+            continue;
+        }
+
+        sprintf(full_url, "%.511s%.512s", arguments.prefix, url);
+
+        loadstat_add(LOAD_PARSE, mg_time() - t);
+
+        VipsImage *img = 0,
+                  *img_cropped = 0,
+                  *img_scaled = 0;
+        int fetch_failed = 0;
+
+        if (strncmp(full_url, "http://", 7) == 0 || strncmp(full_url, "https://", 8) == 0) {
+            /* download the file to memory */
+            tmp_buf.size = 0;
+            curl_easy_setopt(curl_h, CURLOPT_URL, full_url);
+
+            struct trace_scope ts = trace_begin("fetch");
+            t = mg_time();
             cres = curl_easy_perform(curl_h);
+            loadstat_add(LOAD_FETCH, mg_time() - t);
+            trace_end(&ts);
+
+            long status = 0;
+            curl_easy_getinfo(curl_h, CURLINFO_RESPONSE_CODE, &status);
 
             if (cres != CURLE_OK) {
                 LOG_E("Could not download %s", full_url);
+                loadstat_fail(LOAD_FAIL_FETCH);
+                fetch_failed = 1;
+            } else if (status >= 400) {
+                LOG_E("Could not download %s (HTTP %ld)", full_url, status);
+                loadstat_fail(LOAD_FAIL_HTTP);
+                fetch_failed = 1;
             } else {
+                loadstat_count(LOAD_BYTES_FETCHED, tmp_buf.size);
+
+                ts = trace_begin("decode");
+                t = mg_time();
                 img = vips_image_new_from_buffer(tmp_buf.ptr, tmp_buf.size, params, NULL);
+                loadstat_add(LOAD_DECODE, mg_time() - t);
+                trace_end(&ts);
             }
         } else {
+            struct stat st;
+            if (stat(full_url, &st) == 0) {
+                loadstat_count(LOAD_BYTES_FILES, st.st_size);
+            }
+
             strcat(full_url, params);
+
+            struct trace_scope ts = trace_begin("decode");
+            t = mg_time();
             img = vips_image_new_from_file(full_url, NULL);
+            loadstat_add(LOAD_DECODE, mg_time() - t);
+            trace_end(&ts);
+        }
+
+        if (!img && !fetch_failed) {
+            loadstat_fail(LOAD_FAIL_DECODE);
         }
 
         if (!img) {
@@ -392,6 +1219,9 @@ static int load(const char *filename) {
 
             int size = image_height < image_width ? image_height : image_width;
 
+            struct trace_scope ts = trace_begin("resize");
+            t = mg_time();
+
             int offs_x = image_width / 2 - size / 2;
             int offs_y = image_height / 2 - size / 2;
 
@@ -400,7 +1230,7 @@ static int load(const char *filename) {
                 exit(1);
             }
 
-            double scale = (double)g_image_width/(double)size;
+            double scale = (double)inner_width/(double)size;
 
             if (vips_similarity(img_cropped, &img_scaled,
                         "scale", scale,
@@ -416,101 +1246,1041 @@ static int load(const char *filename) {
             /* make sure image is available in memory */
             vips_image_wio_input(img_scaled);
 
-            /* we expect these to be 64, but just in case clamp them */
-            int scaled_w = MIN(g_image_width, vips_image_get_width(img_scaled));
-            int scaled_h = MIN(g_image_height, vips_image_get_height(img_scaled));
+            loadstat_add(LOAD_RESIZE, mg_time() - t);
+            trace_end(&ts);
+            t = mg_time();
+
+            /* we expect these to fill the tile inside the gutter, but just in case clamp them */
+            int scaled_w = MIN(inner_width, vips_image_get_width(img_scaled));
+            int scaled_h = MIN(inner_height, vips_image_get_height(img_scaled));
 
             for (int y=0; y<scaled_h; y++) {
                 for (int x=0; x<scaled_w; x++) {
                     VipsPel *pixel = VIPS_IMAGE_ADDR(img_scaled, x, y);
 
-                    pbuf[((sx*g_image_width+x)*3) + (((sy+1)*g_image_height-1-y)*g_texture_width*3) + 0] = *(pixel);
-                    pbuf[((sx*g_image_width+x)*3) + (((sy+1)*g_image_height-1-y)*g_texture_width*3) + 1] = *(pixel+1);
-                    pbuf[((sx*g_image_width+x)*3) + (((sy+1)*g_image_height-1-y)*g_texture_width*3) + 2] = *(pixel+2);
+                    pbuf[((sx*g_image_width+gutter+x)*3) + (((sy+1)*g_image_height-1-gutter-y)*g_texture_width*3) + 0] = *(pixel);
+                    pbuf[((sx*g_image_width+gutter+x)*3) + (((sy+1)*g_image_height-1-gutter-y)*g_texture_width*3) + 1] = *(pixel+1);
+                    pbuf[((sx*g_image_width+gutter+x)*3) + (((sy+1)*g_image_height-1-gutter-y)*g_texture_width*3) + 2] = *(pixel+2);
                 }
 
             }
             g_object_unref(img_scaled);
+
+            atlas_fill_gutter(pbuf, g_texture_width, sx*g_image_width, sy*g_image_height,
+                              g_image_width, gutter);
+            loadstat_add(LOAD_BLIT, mg_time() - t);
         }
 
         buf ++;
         num_read ++;
     }
-    fprintf(stdout, "\n");
 
-    if (i > 0) {
-        LOG_I("i: %d", i);
-        glTexImage2D(GL_TEXTURE_2D, 0, g_texture_format, g_texture_width, g_texture_height,
-                    0, GL_RGB, GL_UNSIGNED_BYTE, pbuf);
+    if (current_texture >= 0) {
+        upload_texture(pbuf);
     }
+
+    loadstat_progress(num_read);
+    loadstat_end(num_read);
     free(pbuf);
+    free(synth_buf);
+
+    for (int l=1; l<g_texture_levels; l++) {
+        free(g_mip_bufs[l]);
+    }
+    free(g_mip_bufs);
 
     free(tmp_buf.ptr);
     curl_easy_cleanup(curl_h);
 
-    glUnmapBuffer(GL_ARRAY_BUFFER);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    free(offsets);
+    if (rows_fp != fp) {
+        fclose(rows_fp);
+    }
+
+    mem_set(MEM_STAGING, MEM_HOST, 0);
+    mem_set(MEM_CURL, MEM_HOST, 0);
+
+    upload_vertices(num_read);
 
-    LOG_I("parsed %d lines", num_read);
+    loadstat_report(stdout);
+
+    if (arguments.load_json) {
+        FILE *jfp = strcmp(arguments.load_json, "-") == 0 ? stdout : fopen(arguments.load_json, "w");
+        if (!jfp) {
+            LOG_E("could not open %s", arguments.load_json);
+        } else {
+            loadstat_report_json(jfp);
+            if (jfp != stdout) {
+                fclose(jfp);
+            }
+        }
+    }
 
     g_num_objects = num_read;
 
     return 0;
 }
 
+/**
+ * Quantize the first num points into compact vertices, one vertex
+ * buffer at a time. Gives up, leaving nothing allocated, as soon as a
+ * buffer is off by more than COMPACT_MAX_ERROR of a sprite.
+ *
+ * Returns 0 on success.
+ **/
+static int upload_compact_vertices(size_t num) {
+    size_t per_buf = vertices_per_buffer();
+    size_t bytes = 0;
+
+    /* one buffer's worth is quantized at a time */
+    size_t staging = MIN(num, per_buf);
+    struct compact_vertex *vertices = (struct compact_vertex*)malloc(staging * sizeof(struct compact_vertex) + 1);
+    struct compact_block *blocks = (struct compact_block*)malloc(compact_num_blocks(staging) * sizeof(struct compact_block) + 1);
+
+    g_block_bufs = (GLuint*)malloc(g_num_vertex_bufs * sizeof(GLuint) + 1);
+    g_block_texs = (GLuint*)malloc(g_num_vertex_bufs * sizeof(GLuint) + 1);
+
+    if (!vertices || !blocks || !g_block_bufs || !g_block_texs) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+    mem_set(MEM_STAGING, MEM_HOST, staging * sizeof(struct compact_vertex)
+                                   + compact_num_blocks(staging) * sizeof(struct compact_block));
+
+    glGenBuffers(g_num_vertex_bufs, g_block_bufs);
+    glGenTextures(g_num_vertex_bufs, g_block_texs);
+
+    double start = mg_time();
+    float error = 0.f;
+
+    for (int b=0; b<g_num_vertex_bufs; b++) {
+        size_t first = b * per_buf, n = MIN(num - first, per_buf);
+        size_t num_blocks = compact_num_blocks(n);
+        float e = compact_encode(g_points + first, n, vertices, blocks);
+
+        if (e < 0.f) {
+            LOG_E("out of mem");
+            exit(1);
+        }
+        error = MAX(error, e);
+
+        /* a sprite is 2 units wide, see the geometry shader */
+        if (error / 2.f > COMPACT_MAX_ERROR) {
+            break;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, g_vertex_bufs[b]);
+        glBufferData(GL_ARRAY_BUFFER, n * sizeof(struct compact_vertex), vertices, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_TEXTURE_BUFFER, g_block_bufs[b]);
+        glBufferData(GL_TEXTURE_BUFFER, num_blocks * sizeof(struct compact_block), blocks, GL_STATIC_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, g_block_texs[b]);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, g_block_bufs[b]);
+
+        bytes += n * sizeof(struct compact_vertex) + num_blocks * sizeof(struct compact_block);
+    }
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    mem_set(MEM_STAGING, MEM_HOST, 0);
+    free(vertices);
+    free(blocks);
+
+    if (error / 2.f > COMPACT_MAX_ERROR) {
+        LOG_E("compact vertices would be off by %g (%.3f%% of a sprite, at most %.3f%% allowed), "
+              "keeping floats; --reorder may help", error, error / 2.f * 100.f, COMPACT_MAX_ERROR * 100.f);
+        glDeleteTextures(g_num_vertex_bufs, g_block_texs);
+        glDeleteBuffers(g_num_vertex_bufs, g_block_bufs);
+        free(g_block_texs);
+        free(g_block_bufs);
+        g_block_texs = 0;
+        g_block_bufs = 0;
+        return 1;
+    }
+
+    LOG_I("Compact:\t%zu vertices of %zu bytes in %.2f s, off by at most %g (%.3f%% of a sprite)",
+          num, sizeof(struct compact_vertex), mg_time() - start, error, error / 2.f * 100.f);
+
+    mem_set(MEM_VERTEX, MEM_GPU, bytes);
+
+    return 0;
+}
+
+/**
+ * Copy the first num points to vertex buffers of vertices_per_buffer()
+ * points each, quantized into compact vertices with --compact-vertices
+ * unless that would move them too far, in which case
+ * --compact-vertices is turned off.
+ **/
+static void upload_vertices(size_t num) {
+    size_t per_buf = vertices_per_buffer();
+    size_t bytes = 0;
+
+    g_num_vertex_bufs = (int)((num + per_buf - 1) / per_buf);
+    g_vertex_bufs = (GLuint*)malloc(g_num_vertex_bufs * sizeof(GLuint) + 1);
+    if (!g_vertex_bufs) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+    glGenBuffers(g_num_vertex_bufs, g_vertex_bufs);
+
+    if (arguments.compact_vertices) {
+        if (upload_compact_vertices(num) == 0) {
+            return;
+        }
+        arguments.compact_vertices = 0;
+    }
+
+    for (int b=0; b<g_num_vertex_bufs; b++) {
+        size_t first = b * per_buf, n = MIN(num - first, per_buf);
+        glBindBuffer(GL_ARRAY_BUFFER, g_vertex_bufs[b]);
+        glBufferData(GL_ARRAY_BUFFER, n * sizeof(tvec4), g_points + first, GL_STATIC_DRAW);
+        bytes += n * sizeof(tvec4);
+    }
+    mem_set(MEM_VERTEX, MEM_GPU, bytes);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+ * Point the vertex attribute at vertex buffer b, and with
+ * --compact-vertices the block origins at its blocks. Vertices of the
+ * following draws are counted from the first point of that buffer.
+ **/
+static void bind_vertices(int b) {
+    if (b == g_bound_vertex_buf) {
+        return;
+    }
+    g_bound_vertex_buf = b;
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_vertex_bufs[b]);
+
+    if (arguments.compact_vertices) {
+        glVertexAttribIPointer(0, 4, GL_UNSIGNED_SHORT, 0, 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_BUFFER, g_block_texs[b]);
+        glActiveTexture(GL_TEXTURE0);
+    } else {
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    }
+}
+
+/**
+ * First pass over the file for --reorder, reading the position of
+ * every row and where it starts into offsets, and the order to load
+ * the rows in into g_rows. The sparse line index is filled in here,
+ * as the rows are not read in file order later. Returns the number
+ * of rows read.
+ **/
+static size_t read_order(FILE *fp, size_t num_lines, long *offsets) {
+    TRACE_SCOPE("reorder");
+    char line[MAX_LINE_LEN];
+    double start = mg_time();
+    size_t num_rows = 0;
+
+    while (num_rows < num_lines) {
+        offsets[num_rows] = ftell(fp);
+        if (fgets(line, MAX_LINE_LEN, fp) != line) {
+            break;
+        }
+
+        if (num_rows > 0 && num_rows % FILE_LINE_STRIDE == 0
+                && file_lines_add(&g_lines, offsets[num_rows]) != 0) {
+            LOG_E("out of mem");
+            exit(1);
+        }
+
+        /* the positions are read again while loading, unscaled will do here */
+        tvec4 *p = &g_points[num_rows];
+        *p = (tvec4){0.f, 0.f, 0.f, 0.f};
+        sscanf(line, "%f %f %f", &p->x, &p->y, &p->z);
+        num_rows ++;
+    }
+
+    if (reorder_rows(g_points, num_rows, arguments.reorder, g_rows) != 0) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+
+    LOG_I("Reordered:\t%zu rows along a %s curve in %.2f s",
+          num_rows, reorder_name(arguments.reorder), mg_time() - start);
+
+    return num_rows;
+}
+
 static int frame() {
+    TRACE_SCOPE("frame");
     int w,h;
 
-    float now = glfwGetTime();
+    double now = mg_time();
     mg.dt = now - mg.last_time;
     mg.last_time = now;
 
-    input_tick(mg.dt);
+    stats_frame_begin();
+
+    stats_cpu_begin(STAT_INPUT);
+    if (arguments.bench) {
+        if (!bench_next(&g_bench, &mg.view)) {
+            stats_frame_cancel();
+            glfwSetWindowShouldClose(g_win, 1);
+            return 0;
+        }
+        mg.redraw = 1;
+    } else if (input_tick(mg.dt)) {
+        mg.redraw = 1;
+    }
+    stats_cpu_end(STAT_INPUT);
+
+    bench_record(&g_recorder, now, mg.dt, &mg.view);
+
+    if (!mg.redraw && !arguments.continuous) {
+        stats_frame_cancel();
+        return 0;
+    }
+
+    mg.redraw = 0;
 
     glfwGetFramebufferSize(g_win, &w, &h);
 
+    /* with dynamic resolution the scene is rendered offscreen and
+     * scaled up to the window, a still frame is always rendered at
+     * full resolution and is not fed to the controller */
+    int scaled = arguments.target_ms > 0.f && (arguments.continuous || input_active());
+    int rw = w, rh = h;
+
+    if (arguments.target_ms > 0.f) {
+        float scale = scaled ? g_dynres.scale : 1.f;
+        rw = MAX(1, (int)(w * scale));
+        rh = MAX(1, (int)(h * scale));
+
+        if (offscreen_resize(&g_offscreen, rw, rh) != 0) {
+            return 1;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, g_offscreen.fbo);
+
+        if (scaled) {
+            dynres_begin(&g_dynres);
+        }
+    }
+
+    render(rw, rh);
+
+    if (mg.pick) {
+        mg.pick = 0;
+        pick(mg.pick_x * rw, mg.pick_y * rh);
+    }
+
+    stats_gpu_begin(STAT_GPU_POST);
+
+    if (arguments.target_ms > 0.f) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, g_offscreen.fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, rw, rh, 0, 0, w, h, GL_COLOR_BUFFER_BIT,
+                          rw == w && rh == h ? GL_NEAREST : GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (scaled) {
+            /* without gpu timers, fall back to the frame interval */
+            dynres_end(&g_dynres, mg.dt);
+        }
+    }
+
+    if (mg.hud && stats_enabled()) {
+        draw_hud(w, h);
+    }
+
+    stats_gpu_end(STAT_GPU_POST);
+
+    struct trace_scope ts = trace_begin("swap");
+    stats_cpu_begin(STAT_SWAP);
+    glfwSwapBuffers(g_win);
+    stats_cpu_end(STAT_SWAP);
+    trace_end(&ts);
+
+    if (arguments.bench) {
+        /* without vsync, swapping blocks once the gpu falls behind */
+        bench_frame(&g_bench, mg_time() - now, g_frame_draws, g_frame_points);
+    }
+
+    stats_frame_end();
+
+    return 0;
+}
+
+/**
+ * Draw the scene from mg.view into the bound framebuffer.
+ **/
+static void render(int w, int h) {
+    TRACE_SCOPE("render");
+    mg.cam->width = w;
+    mg.cam->height = h;
+
+    g_frame_draws = 0;
+    g_frame_points = 0;
+
     glViewport(0, 0, w, h);
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    stats_gpu_begin(STAT_GPU_CLEAR);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    stats_gpu_end(STAT_GPU_CLEAR);
     glEnable(GL_DEPTH_TEST);
 
     glBindVertexArray(g_vao);
     glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, g_vertex_buf);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    g_bound_vertex_buf = -1;
 
     glActiveTexture(GL_TEXTURE0);
     glUseProgram(g_program);
+    if (arguments.compact_vertices) {
+        glUniform1i(g_uniform_blocks, 1);
+    }
 
     glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
 
-    mg.cam->_position = (tvec3){cosf(mg.cam_angle)*mg.cam_dist, 0.f, sinf(mg.cam_angle)*mg.cam_dist};
-    tcam_set_lookat(mg.cam, 0.f, 0.f, 0.f);
-    tcam_enable(mg.cam, TCAM_LOOKAT);
-    tcam_calculate(mg.cam);
+    view_apply(&mg.view, mg.cam);
+    if (g_tile_projection) {
+        memcpy(mg.cam->projection, g_tile_projection, sizeof(mg.cam->projection));
+    }
     glUniformMatrix4fv(g_uniform_p, 1, GL_FALSE, mg.cam->projection);
     glUniformMatrix4fv(g_uniform_mv, 1, GL_FALSE, mg.cam->view);
     glUniform1i(g_uniform_tex0, 0);
+    glUniform2f(g_uniform_tile,
+                (float)arguments.gutter / (float)g_texture_width,
+                (float)(g_image_width - 2*arguments.gutter) / (float)g_texture_width);
+    glUniform1f(g_uniform_max_lod, (float)(g_texture_levels - 1));
+    glUniform1f(g_uniform_viewport, (float)w);
+    glUniform4f(g_uniform_tint, 0.f, 0.f, 0.f, 0.f);
 
-    int left = g_num_objects;
-    int objects_per_texture = num_images_per_texture();
+    stats_gpu_begin(STAT_GPU_DRAW);
 
-    for (int x=0; x<g_num_textures && left > 0; x++) {
-        glBindTexture(GL_TEXTURE_2D, g_textures[x]);
-        int count = MIN(left, objects_per_texture);
-        glDrawArrays(GL_POINTS, x*objects_per_texture, count);
-        left -= objects_per_texture;
+    if (arguments.overdraw) {
+        overdraw_begin(w, h);
+    }
+
+    if (arguments.lod > 0.f) {
+        draw_lod();
+    } else {
+        stats_cpu_begin(STAT_SUBMIT);
+        size_t left = g_num_objects;
+        size_t objects_per_texture = num_images_per_texture();
+        size_t per_buf = vertices_per_buffer();
+
+        for (int x=0; x<g_num_textures && left > 0; x++) {
+            size_t first = x * objects_per_texture;
+            size_t count = MIN(left, objects_per_texture);
+
+            bind_vertices((int)(first / per_buf));
+            glBindTexture(GL_TEXTURE_2D, g_textures[x]);
+            glDrawArrays(GL_POINTS, (GLint)(first % per_buf), (GLsizei)count);
+            g_frame_draws ++;
+            g_frame_points += count;
+            left -= count;
+        }
+        stats_cpu_end(STAT_SUBMIT);
+    }
+
+    if (arguments.overdraw) {
+        overdraw_end();
     }
 
+    draw_highlight();
+
+    stats_gpu_end(STAT_GPU_DRAW);
+
     glBindTexture(GL_TEXTURE_2D, 0);
 
     glDisableVertexAttribArray(0);
+}
 
-    glfwSwapBuffers(g_win);
+/**
+ * Draw the picked sprite and its nearest neighbours again on top of
+ * themselves, tinted. They are drawn whether or not the level of
+ * detail selected them, so neighbours never go missing.
+ **/
+static void draw_highlight() {
+    if (g_num_highlight == 0) {
+        return;
+    }
+
+    int objects_per_texture = num_images_per_texture();
+    size_t per_buf = vertices_per_buffer();
+
+    glDepthFunc(GL_LEQUAL);
+
+    for (int x=0; x<g_num_highlight; x++) {
+        if (x == 0) {
+            glUniform4f(g_uniform_tint, 1.f, 0.2f, 0.1f, 0.5f);
+        } else if (x == 1) {
+            glUniform4f(g_uniform_tint, 1.f, 0.8f, 0.f, 0.4f);
+        }
+        bind_vertices((int)(g_highlight[x] / per_buf));
+        glBindTexture(GL_TEXTURE_2D, g_textures[g_highlight[x] / objects_per_texture]);
+        glDrawArrays(GL_POINTS, (GLint)(g_highlight[x] % per_buf), 1);
+        g_frame_draws ++;
+        g_frame_points ++;
+    }
+
+    glDepthFunc(GL_LESS);
+    glUniform4f(g_uniform_tint, 0.f, 0.f, 0.f, 0.f);
+}
+
+/**
+ * Upload the atlas in pbuf to the bound texture. Mip levels are
+ * generated on the worker threads in one pass over the atlas.
+ **/
+static void upload_texture(unsigned char *pbuf) {
+    TRACE_SCOPE("upload texture");
+    size_t gpu_size = texture_gpu_size();
+    double t = mg_time();
+    glTexImage2D(GL_TEXTURE_2D, 0, g_texture_format, g_texture_width, g_texture_height,
+                0, GL_RGB, GL_UNSIGNED_BYTE, pbuf);
+    loadstat_add(LOAD_UPLOAD, mg_time() - t);
+    loadstat_count(LOAD_BYTES_UPLOADED, atlas_level_size(g_texture_width, g_texture_height, 0));
+
+    if (g_texture_levels > 1) {
+        struct trace_scope ts = trace_begin("mipmap");
+        t = mg_time();
+        g_mip_bufs[0] = pbuf;
+        atlas_mipmap(g_mip_bufs, g_texture_levels, g_texture_width, g_texture_height,
+                     g_image_height, arguments.gutter);
+        g_mip_bufs[0] = 0;
+        loadstat_add(LOAD_MIPMAP, mg_time() - t);
+        trace_end(&ts);
+    }
+
+    for (int l=1; l<g_texture_levels; l++) {
+        t = mg_time();
+        glTexImage2D(GL_TEXTURE_2D, l, g_texture_format, g_texture_width >> l, g_texture_height >> l,
+                    0, GL_RGB, GL_UNSIGNED_BYTE, g_mip_bufs[l]);
+        loadstat_add(LOAD_UPLOAD, mg_time() - t);
+        loadstat_count(LOAD_BYTES_UPLOADED, atlas_level_size(g_texture_width, g_texture_height, l));
+    }
+
+    mem_add(MEM_ATLAS, MEM_GPU, (long long)texture_gpu_size() - (long long)gpu_size);
+}
+
+/**
+ * Update the ledger with the size of the octree, the list of visible
+ * nodes grows as needed while rendering.
+ **/
+static void account_index() {
+    mem_set(MEM_INDEX, MEM_HOST, g_octree.cap_nodes * sizeof(struct octree_node)
+                                 + g_octree.num_indices * sizeof(uint32_t)
+                                 + g_octree.cap_runs * sizeof(struct octree_run)
+                                 + g_octree.cap_visible * sizeof(uint32_t)
+                                 + g_lines.cap * sizeof(long)
+                                 + g_knn.num_points * sizeof(struct knn_point)
+                                 + g_knn.num_splits * sizeof(struct knn_split));
+    mem_set(MEM_INDEX, MEM_GPU, g_octree.num_indices * sizeof(uint32_t));
+}
+
+/**
+ * Log the row, url and position of the sprite at window coordinates
+ * x, y of the last rendered frame, from the bottom left. The url is
+ * read back from the data file. Returns non-zero if a sprite was hit.
+ **/
+static int pick(float x, float y) {
+    TRACE_SCOPE("pick");
+    struct pick_hit hit;
+    double start = mg_time();
+
+    if (!pick_screen(&g_octree, g_points, mg.cam, x, y, &hit)) {
+        LOG_I("Pick %.0f,%.0f:\tnothing (%u nodes, %u points, %.3f ms)",
+              x, y, hit.nodes, hit.tested, (mg_time() - start) * 1000.0);
+        if (g_num_highlight > 0) {
+            g_num_highlight = 0;
+            mg.redraw = 1;
+        }
+        return 0;
+    }
+
+    double elapsed = mg_time() - start;
+    uint32_t row = row_of(hit.index);
+    char line[MAX_LINE_LEN];
+    char url[512] = "-";
+    FILE *fp = fopen(arguments.args[0], "rb");
+
+    if (!fp || file_read_line(fp, &g_lines, row, line, sizeof(line)) != 0) {
+        LOG_E("could not read row %u", row);
+    } else {
+        sscanf(line, "%*f %*f %*f %511s", url);
+    }
+    if (fp) {
+        fclose(fp);
+    }
+
+    LOG_I("Pick %.0f,%.0f:\trow %u, %s at %.2f,%.2f,%.2f (%u nodes, %u points, %.3f ms)",
+          x, y, row, url, TVEC3_INLINE(hit.position), hit.nodes, hit.tested, elapsed * 1000.0);
+
+    if (arguments.knn > 0) {
+        neighbours(hit.index);
+    }
+
+    return 1;
+}
+
+/**
+ * Log the --knn nearest rows of the point at vertex, and highlight
+ * them together with the point itself in the following frames.
+ **/
+static void neighbours(uint32_t vertex) {
+    uint32_t indices[KNN_MAX_K];
+    float distances[KNN_MAX_K];
+    char list[KNN_MAX_K * 32] = "";
+    size_t len = 0;
+    double start = mg_time();
+    tvec3 p = tvec3f(g_points[vertex].x, g_points[vertex].y, g_points[vertex].z);
+
+    int found = knn_query(&g_knn, p, vertex, arguments.knn, indices, distances);
+    double elapsed = mg_time() - start;
+
+    g_highlight[0] = vertex;
+    g_num_highlight = 1;
+
+    for (int x=0; x<found; x++) {
+        len += snprintf(list + len, sizeof(list) - len, "%s%u (%.2f)", x ? ", " : "", row_of(indices[x]), distances[x]);
+        g_highlight[g_num_highlight++] = indices[x];
+    }
+
+    LOG_I("Nearest:\trows %s (%.3f ms)", found ? list : "none", elapsed * 1000.0);
+
+    /* a headless image is already written when its picks are made */
+    if (arguments.headless) {
+        g_num_highlight = 0;
+    }
+
+    mg.redraw = 1;
+}
+
+/**
+ * Build the nearest neighbour tree over the loaded points.
+ **/
+static int build_knn() {
+    double start = mg_time();
+
+    if (knn_build(&g_knn, g_points, g_num_objects) != 0) {
+        LOG_E("out of mem");
+        return 1;
+    }
+
+    LOG_I("k-NN:\t\t%zu points, built in %.2f s on %d threads",
+          g_knn.num_points, mg_time() - start, worker_num_threads());
+
+    account_index();
 
     return 0;
 }
 
+/**
+ * Write one line per row to filename, the row followed by its --knn
+ * nearest rows, nearest first. The rows are queried in batches on the
+ * worker threads, in vertex order, which is not file order after
+ * --reorder. Returns 0 on success.
+ **/
+static int dump_knn(const char *filename) {
+    TRACE_SCOPE("knn dump");
+    int k = arguments.knn > 0 ? arguments.knn : 10;
+    FILE *fp = strcmp(filename, "-") == 0 ? stdout : fopen(filename, "w");
+    tvec3 *queries = (tvec3*)malloc(KNN_DUMP_BATCH * sizeof(tvec3));
+    uint32_t *skip = (uint32_t*)malloc(KNN_DUMP_BATCH * sizeof(uint32_t));
+    uint32_t *indices = (uint32_t*)malloc(KNN_DUMP_BATCH * k * sizeof(uint32_t));
+    float *distances = (float*)malloc(KNN_DUMP_BATCH * k * sizeof(float));
+    double query_time = 0.0;
+    int r = 0;
+
+    if (!fp) {
+        LOG_E("could not open %s", filename);
+        r = 1;
+    } else if (!queries || !skip || !indices || !distances) {
+        LOG_E("out of mem");
+        r = 1;
+    }
+
+    for (size_t first=0; first<g_num_objects && r == 0; first+=KNN_DUMP_BATCH) {
+        size_t n = MIN(g_num_objects - first, KNN_DUMP_BATCH);
+
+        for (size_t x=0; x<n; x++) {
+            const tvec4 *p = &g_points[first + x];
+            queries[x] = tvec3f(p->x, p->y, p->z);
+            skip[x] = (uint32_t)(first + x);
+        }
+
+        double start = mg_time();
+        knn_query_batch(&g_knn, queries, skip, n, k, indices, distances);
+        query_time += mg_time() - start;
+
+        for (size_t x=0; x<n; x++) {
+            fprintf(fp, "%u", row_of((uint32_t)(first + x)));
+            for (int y=0; y<k && indices[x*k + y] != KNN_NONE; y++) {
+                fprintf(fp, " %u", row_of(indices[x*k + y]));
+            }
+            fputc('\n', fp);
+        }
+    }
+
+    if (fp && fp != stdout && fclose(fp) != 0) {
+        LOG_E("could not write %s", filename);
+        r = 1;
+    }
+
+    if (r == 0) {
+        LOG_I("k-NN:\t\t%d nearest of %zu rows written to %s, %.0f queries/s on %d threads",
+              k, g_num_objects, filename, g_num_objects / MAX(query_time, 1e-9), worker_num_threads());
+    }
+
+    free(queries);
+    free(skip);
+    free(indices);
+    free(distances);
+
+    return r;
+}
+
+static void on_sigusr1(int sig) {
+    g_dump_memory = 1;
+}
+
+/**
+ * Print the memory a file would need per subsystem, from its number
+ * of rows and the storage the driver uses for one texture atlas.
+ **/
+static int estimate_memory(const char *filename) {
+    FILE *fp = fopen(filename, "rb");
+
+    if (!fp) {
+        LOG_E("could not open file");
+        return 1;
+    }
+
+    size_t num_lines = file_count_occurrences(fp, '\n');
+    fclose(fp);
+
+    if (arguments.head > 0 && num_lines > (size_t)arguments.head) {
+        num_lines = arguments.head;
+    }
+
+    size_t num_textures = num_lines / num_images_per_texture() + 1;
+    g_texture_levels = arguments.no_mipmaps ? 1 : atlas_num_levels(g_image_width);
+
+    /* upload one atlas with all its levels to see what the driver makes of it */
+    size_t texture_size = atlas_level_size(g_texture_width, g_texture_height, 0);
+    unsigned char *pbuf = (unsigned char*)calloc(1, texture_size);
+    size_t staging = texture_size;
+    GLuint tex;
+
+    if (!pbuf) {
+        LOG_E("out of mem");
+        return 1;
+    }
+
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, g_texture_levels - 1);
+    for (int l=0; l<g_texture_levels; l++) {
+        glTexImage2D(GL_TEXTURE_2D, l, g_texture_format, g_texture_width >> l, g_texture_height >> l,
+                     0, GL_RGB, GL_UNSIGNED_BYTE, pbuf);
+        if (l > 0) {
+            staging += atlas_level_size(g_texture_width, g_texture_height, l);
+        }
+    }
+    size_t atlas_size = texture_gpu_size();
+    glDeleteTextures(1, &tex);
+    free(pbuf);
+
+    /* nodes hold up to OCTREE_NODE_POINTS points, about half of them full */
+    size_t num_nodes = 2 * num_lines / OCTREE_NODE_POINTS + 1;
+
+    mem_set(MEM_VERTEX, MEM_HOST, num_lines * sizeof(tvec4));
+    if (arguments.compact_vertices) {
+        mem_set(MEM_VERTEX, MEM_GPU, num_lines * sizeof(struct compact_vertex)
+                                     + compact_num_blocks(num_lines) * sizeof(struct compact_block));
+    } else {
+        mem_set(MEM_VERTEX, MEM_GPU, num_lines * sizeof(tvec4));
+    }
+    mem_set(MEM_INDEX, MEM_HOST, num_lines * sizeof(uint32_t)
+                                 + num_nodes * (sizeof(struct octree_node) + 2 * sizeof(struct octree_run)));
+    mem_set(MEM_INDEX, MEM_GPU, num_lines * sizeof(uint32_t));
+    mem_set(MEM_DRAW, MEM_HOST, num_textures * (2 * sizeof(size_t) + sizeof(int)));
+    mem_set(MEM_ATLAS, MEM_GPU, num_textures * atlas_size);
+    mem_set(MEM_STAGING, MEM_HOST, staging);
+    mem_set(MEM_CURL, MEM_HOST, 1024*1024);
+
+    LOG_I("Estimate for %zu rows, %zu atlases of %.1f MB", num_lines, num_textures,
+          atlas_size / (1024.0 * 1024.0));
+    mem_report(stdout);
+
+    return 0;
+}
+
+/**
+ * Storage of the bound texture in bytes, as reported by the driver
+ * for compressed formats.
+ **/
+static size_t texture_gpu_size() {
+    size_t total = 0;
+
+    for (int l=0; l<g_texture_levels; l++) {
+        GLint compressed = 0, size = 0, w = 0, h = 0;
+
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) {
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            total += size;
+        } else {
+            /* rgb is stored padded to four bytes per texel */
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_WIDTH, &w);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, l, GL_TEXTURE_HEIGHT, &h);
+            total += (size_t)w * h * 4;
+        }
+    }
+
+    return total;
+}
+
+/**
+ * Build the octree over the loaded points and upload its index
+ * array, nodes refer to the vertex buffer through it. The octree is
+ * kept in FILE.octree next to the data, and read from there when it
+ * was built for the same points.
+ **/
+static int build_lod() {
+    TRACE_SCOPE("build lod");
+    double start = mg_time();
+    char cache[1024];
+    int use_cache = !arguments.no_octree_cache
+        && snprintf(cache, sizeof(cache), "%s.octree", arguments.args[0]) < (int)sizeof(cache);
+
+    if (use_cache && octree_load(&g_octree, cache, g_points, g_num_objects, num_images_per_texture()) == 0) {
+        LOG_I("Octree:\t\t%zu nodes, %zu runs, read from %s in %.2f s",
+              g_octree.num_nodes, g_octree.num_runs, cache, mg_time() - start);
+    } else {
+        if (octree_build(&g_octree, g_points, g_num_objects, num_images_per_texture()) != 0) {
+            LOG_E("out of mem");
+            return 1;
+        }
+
+        LOG_I("Octree:\t\t%zu nodes, %zu runs, built in %.2f s on %d threads",
+              g_octree.num_nodes, g_octree.num_runs, mg_time() - start, worker_num_threads());
+
+        if (use_cache && octree_save(&g_octree, cache, g_points, g_num_objects, num_images_per_texture()) != 0) {
+            LOG_E("could not write %s", cache);
+        }
+    }
+
+    glBindVertexArray(g_vao);
+    glGenBuffers(1, &g_index_buf);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_index_buf);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_octree.num_indices * sizeof(uint32_t),
+                 g_octree.indices, GL_STATIC_DRAW);
+
+    account_index();
+    mem_set(MEM_DRAW, MEM_HOST, g_num_textures * (2 * sizeof(size_t) + sizeof(int)));
+
+    g_draw_texture_start = (size_t*)malloc(g_num_textures * sizeof(size_t));
+    g_draw_texture_count = (size_t*)malloc(g_num_textures * sizeof(size_t));
+    g_draw_texture_order = (int*)malloc(g_num_textures * sizeof(int));
+
+    if (arguments.overdraw) {
+        glGenQueries(1, &g_overdraw_query);
+    }
+
+    return (g_draw_texture_start && g_draw_texture_count && g_draw_texture_order) ? 0 : 1;
+}
+
+/**
+ * Draw the nodes selected for the current camera, each texture is
+ * bound once and all of its runs are drawn with a single call.
+ *
+ * With --front-to-back, textures are drawn in the order their nearest
+ * node was selected, otherwise in atlas order.
+ **/
+static void draw_lod() {
+    struct trace_scope ts = trace_begin("cull");
+    stats_cpu_begin(STAT_CULL);
+    size_t num_visible = octree_select(&g_octree, mg.cam, arguments.lod, arguments.front_to_back);
+    stats_cpu_end(STAT_CULL);
+    trace_end(&ts);
+
+    TRACE_SCOPE("submit");
+
+    stats_cpu_begin(STAT_SUBMIT);
+    size_t total = 0;
+    int num_used = 0;
+
+    /* indices count from the first point, base vertices from the first of its buffer */
+    size_t objects_per_texture = num_images_per_texture();
+    size_t per_buf = vertices_per_buffer();
+
+    memset(g_draw_texture_count, 0, g_num_textures * sizeof(size_t));
+
+    for (size_t x=0; x<num_visible; x++) {
+        struct octree_node *n = &g_octree.nodes[g_octree.visible[x]];
+        for (uint32_t r=0; r<n->num_runs; r++) {
+            uint32_t texture = g_octree.runs[n->first_run + r].texture;
+            if (g_draw_texture_count[texture]++ == 0 && arguments.front_to_back) {
+                g_draw_texture_order[num_used++] = texture;
+            }
+            total ++;
+        }
+    }
+
+    if (!arguments.front_to_back) {
+        for (int x=0; x<g_num_textures; x++) {
+            if (g_draw_texture_count[x] > 0) {
+                g_draw_texture_order[num_used++] = x;
+            }
+        }
+    }
+
+    if (total > g_draw_cap) {
+        g_draw_counts = (GLsizei*)realloc(g_draw_counts, total * sizeof(GLsizei));
+        g_draw_offsets = (const GLvoid**)realloc(g_draw_offsets, total * sizeof(GLvoid*));
+        g_draw_base = (GLint*)realloc(g_draw_base, total * sizeof(GLint));
+        if (!g_draw_counts || !g_draw_offsets || !g_draw_base) {
+            LOG_E("out of mem");
+            exit(1);
+        }
+        mem_add(MEM_DRAW, MEM_HOST, (total - g_draw_cap) * (sizeof(GLsizei) + sizeof(GLvoid*) + sizeof(GLint)));
+        g_draw_cap = total;
+    }
+
+    size_t start = 0;
+    for (int x=0; x<num_used; x++) {
+        int texture = g_draw_texture_order[x];
+        g_draw_texture_start[texture] = start;
+        start += g_draw_texture_count[texture];
+    }
+
+    for (size_t x=0; x<num_visible; x++) {
+        struct octree_node *n = &g_octree.nodes[g_octree.visible[x]];
+        for (uint32_t r=0; r<n->num_runs; r++) {
+            struct octree_run *run = &g_octree.runs[n->first_run + r];
+            size_t pos = g_draw_texture_start[run->texture]++;
+            g_draw_counts[pos] = run->count;
+            g_draw_offsets[pos] = (const GLvoid*)(uintptr_t)(run->first * sizeof(uint32_t));
+            g_draw_base[pos] = -(GLint)(run->texture * objects_per_texture / per_buf * per_buf);
+            g_frame_points += run->count;
+        }
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_index_buf);
+
+    /* the fill above moved every start to the end of its texture */
+    for (int x=0; x<num_used; x++) {
+        int texture = g_draw_texture_order[x];
+        size_t count = g_draw_texture_count[texture];
+        size_t first = g_draw_texture_start[texture] - count;
+
+        bind_vertices((int)(texture * objects_per_texture / per_buf));
+        glBindTexture(GL_TEXTURE_2D, g_textures[texture]);
+        glMultiDrawElementsBaseVertex(GL_POINTS, g_draw_counts + first, GL_UNSIGNED_INT,
+                                      g_draw_offsets + first, (GLsizei)count, g_draw_base + first);
+        g_frame_draws ++;
+    }
+    stats_cpu_end(STAT_SUBMIT);
+}
+
+/**
+ * Read back the samples of the last frame once its query is done,
+ * without waiting for it unless wait is set.
+ **/
+static void overdraw_collect(int wait) {
+    if (g_overdraw_pending != 1) {
+        return;
+    }
+
+    GLint available = 0;
+    glGetQueryObjectiv(g_overdraw_query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available && !wait) {
+        return;
+    }
+
+    /* 32 bits hold a frame's samples, and the 64 bit read needs GL 3.3 */
+    GLuint samples = 0;
+    glGetQueryObjectuiv(g_overdraw_query, GL_QUERY_RESULT, &samples);
+    g_overdraw_samples += samples;
+    g_overdraw_pending = 0;
+}
+
+static void overdraw_report() {
+    if (g_overdraw_pixels > 0) {
+        LOG_I("Overdraw:\t%.2f samples passed/pixel", (double)g_overdraw_samples / (double)g_overdraw_pixels);
+    }
+    g_overdraw_samples = 0;
+    g_overdraw_pixels = 0;
+    g_overdraw_last_report = mg.last_time;
+}
+
+/**
+ * Count the samples that pass the depth test during the draw, and
+ * report their ratio to the number of pixels drawn. Samples that
+ * fail the depth test after being shaded, as with early depth tests
+ * off, are not counted, so this is a lower bound on the fragments
+ * shaded. The result of a query is read back without stalling, once
+ * it becomes available in a later frame.
+ **/
+static void overdraw_begin(int w, int h) {
+    overdraw_collect(0);
+    if (g_overdraw_pending) {
+        return;
+    }
+
+    if (mg.last_time - g_overdraw_last_report >= 1.f) {
+        overdraw_report();
+    }
+
+    glBeginQuery(GL_SAMPLES_PASSED, g_overdraw_query);
+    g_overdraw_pending = 2;
+    g_overdraw_pixels += (uint64_t)w * (uint64_t)h;
+}
+
+/**
+ * Report what is left at the end of a headless run, which does not
+ * advance mg.last_time.
+ **/
+static void overdraw_finish() {
+    if (arguments.overdraw) {
+        overdraw_collect(1);
+        overdraw_report();
+    }
+}
+
+static void overdraw_end() {
+    if (g_overdraw_pending == 2) {
+        glEndQuery(GL_SAMPLES_PASSED);
+        g_overdraw_pending = 1;
+    }
+}
+
+/**
+ * Overlay the rolling minimum, average and 99th percentile of every
+ * stage, gpu stages lag STATS_LATENCY frames behind.
+ **/
+static void draw_hud(int w, int h) {
+    float min, avg, p99;
+
+    hud_printf(0, 0, "%-10s %7s %7s %7s", "ms", "min", "avg", "p99");
+
+    for (int x=0; x<STAT_COUNT; x++) {
+        if (stats_summary(x, &min, &avg, &p99) > 0) {
+            hud_printf(0, x+1, "%-10s %7.2f %7.2f %7.2f", stats_name(x), min, avg, p99);
+        } else {
+            hud_printf(0, x+1, "%-10s %7s %7s %7s", stats_name(x), "-", "-", "-");
+        }
+    }
+
+    hud_printf(0, STAT_COUNT+2, "memory mb  host %.0f gpu %.0f",
+               mem_total(MEM_HOST) / (1024.0 * 1024.0), mem_total(MEM_GPU) / (1024.0 * 1024.0));
+
+    hud_draw(w, h);
+}
+
+static void on_glfw_refresh(GLFWwindow *win) {
+    mg.redraw = 1;
+}
+
 static void on_glfw_error(int error, const char *description) {
     LOG_E("GLFW error: (%d): %s", error, description);
 }
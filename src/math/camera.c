@@ -19,6 +19,7 @@ tcam_init(struct tcam *c)
     tmat4_load_identity(c->view);
     tmat4_load_identity(c->projection);
     tmat4_load_identity(c->combined);
+    tcam_calculate_frustum(c);
 
     c->_velocity = (tvec3){0,0,0};
     c->_position = (tvec3){0,0,0};
@@ -62,6 +63,19 @@ tcam_project(struct tcam *c, float x, float y, float z)
     return r;
 }
 
+/**
+ * tcam_project() for n points stored as separate x, y and z arrays.
+ **/
+void
+tcam_project_points(struct tcam *c, const float *x, const float *y, const float *z, size_t n,
+                    float *sx, float *sy, float *depth)
+{
+    float w = c->_flags & TCAM_PERSPECTIVE ? c->width : c->owidth;
+    float h = c->_flags & TCAM_PERSPECTIVE ? c->height : c->oheight;
+
+    tmat4_project_points(c->combined, w, h, x, y, z, n, sx, sy, depth);
+}
+
 tvec3
 tcam_unproject(struct tcam *c, float x, float y, float z)
 {
@@ -224,5 +238,40 @@ tcam_calculate(struct tcam *c)
     tmat4_copy(c->combined, c->projection);
 
     tmat4_multiply(c->combined, c->view);
+
+    tcam_calculate_frustum(c);
+}
+
+/**
+ * Extract the frustum planes from the combined matrix. A point is
+ * inside the clip volume when -w <= x, y, z <= w in clip space, and
+ * each of those six inequalities is a plane in world space made of
+ * the matrix's last row plus or minus one of the others. Called by
+ * tcam_calculate(), and needed again only if combined is changed by
+ * other means.
+ **/
+void
+tcam_calculate_frustum(struct tcam *c)
+{
+    const float *m = c->combined;
+
+    for (int p=0; p<TCAM_FRUSTUM_NUM_PLANES; p++) {
+        int r = p / 2;
+        float s = p % 2 ? -1.f : 1.f;
+
+        tvec4 *pl = &c->frustum[p];
+        pl->x = m[3] + s*m[r];
+        pl->y = m[7] + s*m[4+r];
+        pl->z = m[11] + s*m[8+r];
+        pl->w = m[15] + s*m[12+r];
+
+        float l = tvec3_magnitude((tvec3*)pl);
+        if (l > 0.f) {
+            pl->x /= l;
+            pl->y /= l;
+            pl->z /= l;
+            pl->w /= l;
+        }
+    }
 }
 
@@ -4,12 +4,25 @@
 /** @relates tcam @{ */
 
 #include <stdint.h>
+#include <stddef.h>
 #include "vector.h"
 
 #define TCAM_VELOCITY    1 /**< Set to enable camera velocity. lol jk this isnt even implemented yet */
 #define TCAM_PERSPECTIVE 2 /**< Enable perspective camera. If unset, the camera is orthographic. */
 #define TCAM_LOOKAT      4 /**< If set, the camera's direction is calculated from a point given to tcam_lookat, otherwise the camera's direction is set using tcam_set_direction */
 
+/** Indices of struct tcam's frustum planes. */
+enum {
+    TCAM_FRUSTUM_LEFT,
+    TCAM_FRUSTUM_RIGHT,
+    TCAM_FRUSTUM_BOTTOM,
+    TCAM_FRUSTUM_TOP,
+    TCAM_FRUSTUM_NEAR,
+    TCAM_FRUSTUM_FAR,
+
+    TCAM_FRUSTUM_NUM_PLANES
+};
+
 /** 
  * Perspective/ortho2d camera convenience stuff.
  *
@@ -21,6 +34,7 @@ struct tcam {
     float             view[16];
     float             projection[16];
     float             combined[16];
+    tvec4             frustum[TCAM_FRUSTUM_NUM_PLANES]; /* planes (x,y,z,w) with dot(xyz, p) + w >= 0 inside, xyz of unit length */
 
     tvec3              _velocity;
     tvec3              _position;
@@ -53,8 +67,11 @@ void tcam_disable(struct tcam *cam, uint32_t flag);
 void tcam_free(struct tcam *cam);
 void tcam_set_direction(struct tcam *c, float x, float y, float z);
 void tcam_calculate(struct tcam *c);
+void tcam_calculate_frustum(struct tcam *c);
 
 tvec3 tcam_unproject(struct tcam *c, float x, float y, float z);
 tvec3 tcam_project(struct tcam *c, float x, float y, float z);
+void tcam_project_points(struct tcam *c, const float *x, const float *y, const float *z, size_t n,
+                         float *sx, float *sy, float *depth);
 
 #endif
@@ -90,3 +90,102 @@ tintersect_point_rect(tvec2 *point, tvec2 *rect_pos, tvec2 *rect_size)
             (point->y > rect_pos->y-(rect_size->h/2)) &&
             (point->y < rect_pos->y+(rect_size->h/2)));
 }
+
+/**
+ * Classify the sphere against a convex volume given as planes (x,y,z,w)
+ * with unit normals pointing inward, such as tcam's frustum. Returns
+ * TINTERSECT_OUTSIDE if the sphere is entirely behind one plane,
+ * TINTERSECT_INSIDE if it is entirely in front of all of them and
+ * TINTERSECT_INTERSECTING otherwise. The test is conservative: a
+ * sphere near a corner of the volume but outside it may be reported
+ * as intersecting, never the other way around.
+ *
+ * @relates tintersect
+ **/
+int
+tintersect_sphere_frustum(const tvec4 *planes, int num_planes, tvec3 center, float radius)
+{
+    int outside = 0, straddles = 0;
+
+    for (int p=0; p<num_planes; p++) {
+        float d = planes[p].x*center.x + planes[p].y*center.y + planes[p].z*center.z + planes[p].w;
+        outside |= d < -radius;
+        straddles |= d < radius;
+    }
+
+    return outside ? TINTERSECT_OUTSIDE : (straddles ? TINTERSECT_INTERSECTING : TINTERSECT_INSIDE);
+}
+
+/**
+ * Classify the axis-aligned box with the given center and half
+ * extents, like tintersect_sphere_frustum(). Each plane is tested
+ * against the box's projected radius along the plane normal, so the
+ * test is exact per plane and conservative overall.
+ *
+ * @relates tintersect
+ **/
+int
+tintersect_aabb_frustum(const tvec4 *planes, int num_planes, tvec3 center, tvec3 half)
+{
+    int outside = 0, straddles = 0;
+
+    for (int p=0; p<num_planes; p++) {
+        float d = planes[p].x*center.x + planes[p].y*center.y + planes[p].z*center.z + planes[p].w;
+        float r = fabsf(planes[p].x)*half.x + fabsf(planes[p].y)*half.y + fabsf(planes[p].z)*half.z;
+        outside |= d < -r;
+        straddles |= d < r;
+    }
+
+    return outside ? TINTERSECT_OUTSIDE : (straddles ? TINTERSECT_INTERSECTING : TINTERSECT_INSIDE);
+}
+
+/**
+ * tintersect_sphere_frustum() over n spheres stored as separate
+ * arrays, writing one TINTERSECT_ value per sphere to out. The inner
+ * loop has no branches, so optimized builds vectorize it.
+ *
+ * @relates tintersect
+ **/
+void
+tintersect_spheres_frustum(const tvec4 *planes, int num_planes,
+                           const float *x, const float *y, const float *z, const float *radius,
+                           size_t n, uint8_t *out)
+{
+    for (size_t i=0; i<n; i++) {
+        int outside = 0, straddles = 0;
+
+        for (int p=0; p<num_planes; p++) {
+            float d = planes[p].x*x[i] + planes[p].y*y[i] + planes[p].z*z[i] + planes[p].w;
+            outside |= d < -radius[i];
+            straddles |= d < radius[i];
+        }
+
+        out[i] = outside ? TINTERSECT_OUTSIDE : (straddles ? TINTERSECT_INTERSECTING : TINTERSECT_INSIDE);
+    }
+}
+
+/**
+ * tintersect_aabb_frustum() over n boxes given by separate center
+ * and half extent arrays.
+ *
+ * @relates tintersect
+ **/
+void
+tintersect_aabbs_frustum(const tvec4 *planes, int num_planes,
+                         const float *x, const float *y, const float *z,
+                         const float *hx, const float *hy, const float *hz,
+                         size_t n, uint8_t *out)
+{
+    for (size_t i=0; i<n; i++) {
+        int outside = 0, straddles = 0;
+
+        for (int p=0; p<num_planes; p++) {
+            float d = planes[p].x*x[i] + planes[p].y*y[i] + planes[p].z*z[i] + planes[p].w;
+            float r = fabsf(planes[p].x)*hx[i] + fabsf(planes[p].y)*hy[i] + fabsf(planes[p].z)*hz[i];
+            outside |= d < -r;
+            straddles |= d < r;
+        }
+
+        out[i] = outside ? TINTERSECT_OUTSIDE : (straddles ? TINTERSECT_INTERSECTING : TINTERSECT_INSIDE);
+    }
+}
@@ -4,8 +4,17 @@
 
 /** @relates tintersect @{ */
 
+#include <stddef.h>
+#include <stdint.h>
 #include "vector.h"
 
+/** Classification of a volume against a convex set of planes. */
+enum {
+    TINTERSECT_OUTSIDE,
+    TINTERSECT_INSIDE,
+    TINTERSECT_INTERSECTING,
+};
+
 /** 
  * Misc intersection functions.
  * The struct tintersect does not exist, all intersection functions take various arguments.
@@ -21,6 +30,15 @@ int tintersect_ray_plane(tvec3 *origin, tvec3 *dir, tvec4 *plane, tvec3 *interse
 int tintersect_point_rect(tvec2 *point, tvec2 *rect_pos, tvec2 *rect_size);
 int tintersect_lines(tvec2 a1, tvec2 a2, tvec2 b1, tvec2 b2, tvec2 *point);
 int tintersect_segments(tvec2 a1, tvec2 a2, tvec2 b1, tvec2 b2, tvec2 *point);
+int tintersect_sphere_frustum(const tvec4 *planes, int num_planes, tvec3 center, float radius);
+int tintersect_aabb_frustum(const tvec4 *planes, int num_planes, tvec3 center, tvec3 half);
+void tintersect_spheres_frustum(const tvec4 *planes, int num_planes,
+                                const float *x, const float *y, const float *z, const float *radius,
+                                size_t n, uint8_t *out);
+void tintersect_aabbs_frustum(const tvec4 *planes, int num_planes,
+                              const float *x, const float *y, const float *z,
+                              const float *hx, const float *hy, const float *hz,
+                              size_t n, uint8_t *out);
 
 static inline tvec2
 tintersect_segment_point_nearest(tvec2 v, tvec2 w, tvec2 p)
@@ -1,6 +1,7 @@
 #include "vector.h"
 #include "matrix.h"
 #include "misc.h"
+#include "simd.h"
 
 #include <math.h>
 #include <string.h>
@@ -312,6 +313,66 @@ float tmath_sqrt(float x)
 
 #endif
 
+void
+tmath_sin_n(float *out, const float *x, size_t n)
+{
+    tmath_active->sin_n(out, x, n);
+}
+
+void
+tmath_sincos_n(float *s, float *c, const float *x, size_t n)
+{
+    tmath_active->sincos_n(s, c, x, n);
+}
+
+void
+tmath_atan2_n(float *out, const float *y, const float *x, size_t n)
+{
+    tmath_active->atan2_n(out, y, x, n);
+}
+
+void
+tmath_pow_n(float *out, const float *x, const float *e, size_t n)
+{
+    tmath_active->pow_n(out, x, e, n);
+}
+
+void
+tmath_sqrt_n(float *out, const float *x, size_t n)
+{
+    tmath_active->sqrt_n(out, x, n);
+}
+
+void
+tmath_sin_n_scalar(float *out, const float *x, size_t n)
+{
+    for (size_t i=0; i<n; i++) out[i] = tmath_sin(x[i]);
+}
+
+void
+tmath_sincos_n_scalar(float *s, float *c, const float *x, size_t n)
+{
+    for (size_t i=0; i<n; i++) tmath_sincos(x[i], &s[i], &c[i]);
+}
+
+void
+tmath_atan2_n_scalar(float *out, const float *y, const float *x, size_t n)
+{
+    for (size_t i=0; i<n; i++) out[i] = tmath_atan2(y[i], x[i]);
+}
+
+void
+tmath_pow_n_scalar(float *out, const float *x, const float *e, size_t n)
+{
+    for (size_t i=0; i<n; i++) out[i] = tmath_pow(x[i], e[i]);
+}
+
+void
+tmath_sqrt_n_scalar(float *out, const float *x, size_t n)
+{
+    for (size_t i=0; i<n; i++) out[i] = tmath_sqrt(x[i]);
+}
+
 /**
  * Invert the given matrix in-place.
  * @returns 0 if the matrix could not be inverted, 1 otherwise
@@ -320,6 +381,12 @@ float tmath_sqrt(float x)
  **/
 int
 tmat4_invert(float *out)
+{
+    return tmath_active->mat4_invert(out);
+}
+
+int
+tmat4_invert_scalar(float *out)
 {
     float m[16];
     tmat4_copy(m, out);
@@ -521,32 +588,20 @@ tmat3_load_identity(float *m)
 void
 tmat4_multiply_reverse(float m2[16], float m1[16])
 {
-    float tmp[16];
-    int x,y;
-
-    for (x=0; x<16; x++) {
-        tmp[x] = 0.f;
-
-        for (y=0; y<4; y++)
-            tmp[x] += m1[(x%4) + (y*4)] * m2[y + ((x/4)*4)];
-    }
-    memcpy(m2, tmp, TMAT4_SIZE);
-    /*
-    float tmp[16];
-    int x,y;
-
-    for (x=0; x<4; x++) {
-        for (y=0; y<4; y++) {
-            tmp[y+(x*4)] = (m1[x*4]*m2[y])+ (m1[x*4+1] * m2[y+4])
-                          + (m1[x*4+2] * m2[y+8]) + (m1[x*4+3] * m2[y+12]);
-        }
-    }
-    memcpy(m1, tmp, TMAT4_SIZE);
-    */
+    tmath_active->mat4_multiply(m2, m1, m2);
 }
 
 void
 tmat4_multiply(float m1[16], float m2[16])
+{
+    tmath_active->mat4_multiply(m1, m1, m2);
+}
+
+/**
+ * out = a*b, out may be the same as a or b.
+ **/
+void
+tmat4_multiply_scalar(float *out, const float *a, const float *b)
 {
     float tmp[16];
     int x,y;
@@ -555,21 +610,9 @@ tmat4_multiply(float m1[16], float m2[16])
         tmp[x] = 0.f;
 
         for (y=0; y<4; y++)
-            tmp[x] += m1[(x%4) + (y*4)] * m2[y + ((x/4)*4)];
+            tmp[x] += a[(x%4) + (y*4)] * b[y + ((x/4)*4)];
     }
-    memcpy(m1, tmp, TMAT4_SIZE);
-    /*
-    float tmp[16];
-    int x,y;
-
-    for (x=0; x<4; x++) {
-        for (y=0; y<4; y++) {
-            tmp[y+(x*4)] = (m1[x*4]*m2[y])+ (m1[x*4+1] * m2[y+4])
-                          + (m1[x*4+2] * m2[y+8]) + (m1[x*4+3] * m2[y+12]);
-        }
-    }
-    memcpy(m1, tmp, TMAT4_SIZE);
-    */
+    memcpy(out, tmp, TMAT4_SIZE);
 }
 
 void
@@ -685,6 +728,12 @@ tvec3_project_mat4(tvec3 *v, float *m)
 
 void
 tvec4_mul_mat4(tvec4 *v, float *m)
+{
+    tmath_active->vec4_mul_mat4(v, m);
+}
+
+void
+tvec4_mul_mat4_scalar(tvec4 *v, const float *m)
 {
     float x = v->x;
     float y = v->y;
@@ -697,6 +746,35 @@ tvec4_mul_mat4(tvec4 *v, float *m)
     v->w = (x*m[3] + y*m[7] + z*m[11] + w*m[15]);
 }
 
+/**
+ * Transform n points, given as separate x, y and z arrays, by m and
+ * map them to a width by height viewport. Gives window coordinates in
+ * sx and sy and depth in [0, 1], the same values as tcam_project()
+ * gives one point at a time. The outputs must not overlap the inputs.
+ **/
+void
+tmat4_project_points(const float *m, float width, float height,
+                     const float *x, const float *y, const float *z, size_t n,
+                     float *sx, float *sy, float *depth)
+{
+    tmath_active->project_points(m, width, height, x, y, z, n, sx, sy, depth);
+}
+
+void
+tmat4_project_points_scalar(const float *m, float width, float height,
+                            const float *x, const float *y, const float *z, size_t n,
+                            float *sx, float *sy, float *depth)
+{
+    for (size_t i=0; i<n; i++) {
+        tvec4 v = (tvec4){x[i], y[i], z[i], 1.f};
+        tvec4_mul_mat4_scalar(&v, m);
+
+        sx[i] = width * (v.x / v.w + 1.f) / 2.f;
+        sy[i] = height * (v.y / v.w + 1.f) / 2.f;
+        depth[i] = (v.z / v.w + 1) / 2;
+    }
+}
+
 void
 tvec3_mul_mat3(tvec3 *v, float *m)
 {
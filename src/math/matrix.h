@@ -50,6 +50,9 @@ int  tmat4_invert(float *out);
 void tmat4_scale(float *m, float x, float y, float z);
 void tmat4_set_near_plane(float *m, tvec4 *plane);
 void tmat4_transpose(float *m);
+void tmat4_project_points(const float *m, float width, float height,
+                          const float *x, const float *y, const float *z, size_t n,
+                          float *sx, float *sy, float *depth);
 
 static inline void tmat4_translate_vec3(float *m, tvec3 *v)
 {
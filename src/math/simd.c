@@ -0,0 +1,433 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * SSE and AVX versions of the tmat4/tvec4 kernels and the fast-math
+ * array functions, chosen at startup.
+ *
+ * Matrices are column-major, so a column is one vector and a product
+ * is a sum of columns scaled by broadcast elements. Every function
+ * repeats the operations of its scalar counterpart lane by lane and
+ * in the same order, including the 0.f the scalar sums start from,
+ * so results are bit-identical. The functions are compiled with
+ * target attributes rather than global -m flags, so the rest of the
+ * program still runs on any cpu. The fast-math functions are in
+ * simd_lanes.h, included once per lane count.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "vector.h"
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TMATH_X86
+#include <immintrin.h>
+#endif
+
+#define SCALAR_ARRAYS \
+    tmath_sin_n_scalar, tmath_sincos_n_scalar, tmath_atan2_n_scalar, \
+    tmath_pow_n_scalar, tmath_sqrt_n_scalar
+
+static const struct tmath_kernels scalar_kernels = {
+    "scalar",
+    tmat4_multiply_scalar,
+    tmat4_invert_scalar,
+    tvec4_mul_mat4_scalar,
+    tmat4_project_points_scalar,
+    SCALAR_ARRAYS,
+};
+
+const struct tmath_kernels *tmath_active = &scalar_kernels;
+
+#ifdef TMATH_X86
+
+__attribute__((target("sse2"))) static void
+tmat4_multiply_sse(float *out, const float *a, const float *b)
+{
+    __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a+4),
+           a2 = _mm_loadu_ps(a+8), a3 = _mm_loadu_ps(a+12);
+    __m128 r[4];
+
+    for (int c=0; c<4; c++) {
+        __m128 s = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(a0, _mm_set1_ps(b[c*4])));
+        s = _mm_add_ps(s, _mm_mul_ps(a1, _mm_set1_ps(b[c*4+1])));
+        s = _mm_add_ps(s, _mm_mul_ps(a2, _mm_set1_ps(b[c*4+2])));
+        r[c] = _mm_add_ps(s, _mm_mul_ps(a3, _mm_set1_ps(b[c*4+3])));
+    }
+
+    /* b is read to the end before out is written, they may be the same */
+    for (int c=0; c<4; c++) {
+        _mm_storeu_ps(out + c*4, r[c]);
+    }
+}
+
+__attribute__((target("sse2"))) static void
+tvec4_mul_mat4_sse(tvec4 *v, const float *m)
+{
+    __m128 s = _mm_mul_ps(_mm_set1_ps(v->x), _mm_loadu_ps(m));
+    s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(v->y), _mm_loadu_ps(m+4)));
+    s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(v->z), _mm_loadu_ps(m+8)));
+    s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(v->w), _mm_loadu_ps(m+12)));
+    _mm_storeu_ps(&v->x, s);
+}
+
+/**
+ * Same cofactor expansion as tmat4_invert_scalar(). Each output
+ * column is a sum of three products of a row of m, swizzled to
+ * (m[4+k], m[k], m[12+k], m[8+k]), and 2x2 determinants laid out as
+ * (b, b, a, a). The scalar code starts half of the sums with a
+ * negated term, so terms are negated per lane with a sign mask and
+ * subtraction is done as addition of the negated term, which are
+ * both exact and keep even the sign of zero results identical.
+ **/
+__attribute__((target("sse2"))) static int
+tmat4_invert_sse(float *out)
+{
+    __m128 c0 = _mm_loadu_ps(out), c1 = _mm_loadu_ps(out+4),
+           c2 = _mm_loadu_ps(out+8), c3 = _mm_loadu_ps(out+12);
+
+    /* the 2x2 determinants a0..a3, b0..b3 and a4, a5, b4, b5 */
+    __m128 A = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(c0, c0, _MM_SHUFFLE(1,0,0,0)), _mm_shuffle_ps(c1, c1, _MM_SHUFFLE(2,3,2,1))),
+        _mm_mul_ps(_mm_shuffle_ps(c0, c0, _MM_SHUFFLE(2,3,2,1)), _mm_shuffle_ps(c1, c1, _MM_SHUFFLE(1,0,0,0))));
+    __m128 B = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(c2, c2, _MM_SHUFFLE(1,0,0,0)), _mm_shuffle_ps(c3, c3, _MM_SHUFFLE(2,3,2,1))),
+        _mm_mul_ps(_mm_shuffle_ps(c2, c2, _MM_SHUFFLE(2,3,2,1)), _mm_shuffle_ps(c3, c3, _MM_SHUFFLE(1,0,0,0))));
+    __m128 E = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2,1,2,1)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3,3,3,3))),
+        _mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3,3,3,3)), _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2,1,2,1))));
+
+    float a[6], b[6], e[4];
+    _mm_storeu_ps(a, A);
+    _mm_storeu_ps(b, B);
+    _mm_storeu_ps(e, E);
+    a[4] = e[0];
+    a[5] = e[1];
+    b[4] = e[2];
+    b[5] = e[3];
+
+    float det = a[0]*b[5] - a[1]*b[4] + a[2]*b[3] + a[3]*b[2] - a[4]*b[1] + a[5]*b[0];
+
+    if (!(fabsf(det) > 0.00001f)) {
+        return 0;
+    }
+
+    /* rows of m, then swizzled to (m[4+k], m[k], m[12+k], m[8+k]) */
+    __m128 r0 = c0, r1 = c1, r2 = c2, r3 = c3;
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    __m128 R0 = _mm_shuffle_ps(r0, r0, _MM_SHUFFLE(2,3,0,1));
+    __m128 R1 = _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(2,3,0,1));
+    __m128 R2 = _mm_shuffle_ps(r2, r2, _MM_SHUFFLE(2,3,0,1));
+    __m128 R3 = _mm_shuffle_ps(r3, r3, _MM_SHUFFLE(2,3,0,1));
+
+    __m128 D[6];
+    for (int x=0; x<6; x++) {
+        D[x] = _mm_setr_ps(b[x], b[x], a[x], a[x]);
+    }
+
+    /* sign masks for lanes whose cofactor starts with a minus, and the rest */
+    const __m128 odd = _mm_castsi128_ps(_mm_setr_epi32(0, 0x80000000, 0, 0x80000000));
+    const __m128 even = _mm_castsi128_ps(_mm_setr_epi32(0x80000000, 0, 0x80000000, 0));
+
+    __m128 v0 = _mm_add_ps(_mm_add_ps(_mm_xor_ps(_mm_mul_ps(R1, D[5]), odd), _mm_xor_ps(_mm_mul_ps(R2, D[4]), even)),
+                           _mm_xor_ps(_mm_mul_ps(R3, D[3]), odd));
+    __m128 v1 = _mm_add_ps(_mm_add_ps(_mm_xor_ps(_mm_mul_ps(R0, D[5]), even), _mm_xor_ps(_mm_mul_ps(R2, D[2]), odd)),
+                           _mm_xor_ps(_mm_mul_ps(R3, D[1]), even));
+    __m128 v2 = _mm_add_ps(_mm_add_ps(_mm_xor_ps(_mm_mul_ps(R0, D[4]), odd), _mm_xor_ps(_mm_mul_ps(R1, D[2]), even)),
+                           _mm_xor_ps(_mm_mul_ps(R3, D[0]), odd));
+    __m128 v3 = _mm_add_ps(_mm_add_ps(_mm_xor_ps(_mm_mul_ps(R0, D[3]), even), _mm_xor_ps(_mm_mul_ps(R1, D[1]), odd)),
+                           _mm_xor_ps(_mm_mul_ps(R2, D[0]), even));
+
+    __m128 invdet = _mm_set1_ps(1.f/det);
+    _mm_storeu_ps(out,    _mm_mul_ps(v0, invdet));
+    _mm_storeu_ps(out+4,  _mm_mul_ps(v1, invdet));
+    _mm_storeu_ps(out+8,  _mm_mul_ps(v2, invdet));
+    _mm_storeu_ps(out+12, _mm_mul_ps(v3, invdet));
+
+    return 1;
+}
+
+__attribute__((target("avx"))) static void
+tmat4_multiply_avx(float *out, const float *a, const float *b)
+{
+    /* two result columns at a time, the columns of a in both halves */
+    __m256 a0 = _mm256_broadcast_ps((const __m128*)a), a1 = _mm256_broadcast_ps((const __m128*)(a+4)),
+           a2 = _mm256_broadcast_ps((const __m128*)(a+8)), a3 = _mm256_broadcast_ps((const __m128*)(a+12));
+    __m256 r[2];
+
+    for (int c=0; c<2; c++) {
+        /* columns c*2 and c*2+1 of b, each element broadcast within its half */
+        __m256 bc = _mm256_loadu_ps(b + c*8);
+        __m256 s = _mm256_add_ps(_mm256_setzero_ps(), _mm256_mul_ps(a0, _mm256_permute_ps(bc, _MM_SHUFFLE(0,0,0,0))));
+        s = _mm256_add_ps(s, _mm256_mul_ps(a1, _mm256_permute_ps(bc, _MM_SHUFFLE(1,1,1,1))));
+        s = _mm256_add_ps(s, _mm256_mul_ps(a2, _mm256_permute_ps(bc, _MM_SHUFFLE(2,2,2,2))));
+        r[c] = _mm256_add_ps(s, _mm256_mul_ps(a3, _mm256_permute_ps(bc, _MM_SHUFFLE(3,3,3,3))));
+    }
+
+    _mm256_storeu_ps(out, r[0]);
+    _mm256_storeu_ps(out + 8, r[1]);
+}
+
+/**
+ * Four points per iteration with the coordinates in separate
+ * registers, so every lane is one point going through the scalar
+ * code's operations. The remainder is left to the scalar kernel.
+ **/
+__attribute__((target("sse2"))) static void
+tmat4_project_points_sse(const float *m, float width, float height,
+                         const float *x, const float *y, const float *z, size_t n,
+                         float *sx, float *sy, float *depth)
+{
+    __m128 M[16];
+    for (int k=0; k<16; k++) {
+        M[k] = _mm_set1_ps(m[k]);
+    }
+
+    const __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f);
+    const __m128 w = _mm_set1_ps(width), h = _mm_set1_ps(height);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 X = _mm_loadu_ps(x + i), Y = _mm_loadu_ps(y + i), Z = _mm_loadu_ps(z + i);
+        __m128 v[4];
+
+        for (int r=0; r<4; r++) {
+            /* x*m[r] + y*m[4+r] + z*m[8+r] + 1*m[12+r] */
+            v[r] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(X, M[r]), _mm_mul_ps(Y, M[4+r])),
+                                         _mm_mul_ps(Z, M[8+r])), M[12+r]);
+        }
+
+        _mm_storeu_ps(sx + i, _mm_div_ps(_mm_mul_ps(w, _mm_add_ps(_mm_div_ps(v[0], v[3]), one)), two));
+        _mm_storeu_ps(sy + i, _mm_div_ps(_mm_mul_ps(h, _mm_add_ps(_mm_div_ps(v[1], v[3]), one)), two));
+        _mm_storeu_ps(depth + i, _mm_div_ps(_mm_add_ps(_mm_div_ps(v[2], v[3]), one), two));
+    }
+
+    tmat4_project_points_scalar(m, width, height, x + i, y + i, z + i, n - i, sx + i, sy + i, depth + i);
+}
+
+__attribute__((target("avx"))) static void
+tmat4_project_points_avx(const float *m, float width, float height,
+                         const float *x, const float *y, const float *z, size_t n,
+                         float *sx, float *sy, float *depth)
+{
+    __m256 M[16];
+    for (int k=0; k<16; k++) {
+        M[k] = _mm256_set1_ps(m[k]);
+    }
+
+    const __m256 one = _mm256_set1_ps(1.f), two = _mm256_set1_ps(2.f);
+    const __m256 w = _mm256_set1_ps(width), h = _mm256_set1_ps(height);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 X = _mm256_loadu_ps(x + i), Y = _mm256_loadu_ps(y + i), Z = _mm256_loadu_ps(z + i);
+        __m256 v[4];
+
+        for (int r=0; r<4; r++) {
+            v[r] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(X, M[r]), _mm256_mul_ps(Y, M[4+r])),
+                                               _mm256_mul_ps(Z, M[8+r])), M[12+r]);
+        }
+
+        _mm256_storeu_ps(sx + i, _mm256_div_ps(_mm256_mul_ps(w, _mm256_add_ps(_mm256_div_ps(v[0], v[3]), one)), two));
+        _mm256_storeu_ps(sy + i, _mm256_div_ps(_mm256_mul_ps(h, _mm256_add_ps(_mm256_div_ps(v[1], v[3]), one)), two));
+        _mm256_storeu_ps(depth + i, _mm256_div_ps(_mm256_add_ps(_mm256_div_ps(v[2], v[3]), one), two));
+    }
+
+    tmat4_project_points_scalar(m, width, height, x + i, y + i, z + i, n - i, sx + i, sy + i, depth + i);
+}
+
+#ifdef TMS_FAST_MATH
+
+/* the constants of math.c, from the same literals */
+static const float tmath_lanes_sin_rng[2] = {2.0 / M_PI, M_PI / 2.0};
+static const float tmath_lanes_sin_lut[4] = {-0.00018365f, -0.16664831f, +0.00830636f, +0.99999661f};
+static const float tmath_lanes_sincos_lut[8] = {
+    -0.00018365f, -0.00018365f, +0.00830636f, +0.00830636f,
+    -0.16664831f, -0.16664831f, +0.99999661f, +0.99999661f,
+};
+static const float tmath_lanes_pow_rng[2] = {1.442695041f, 0.693147180f};
+static const float tmath_lanes_pow_lut[16] = {
+    -2.295614848256274, -2.470711633419806, -5.686926051100417, -0.165253547131978,
+    +5.175912446351073, +0.844006986174912, +4.584458825456749, +0.014127821926000,
+    0.9999999916728642, 0.04165989275009526, 0.5000006143673624, 0.0014122663401803872,
+    1.000000059694879, 0.008336936973260111, 0.16666570253074878, 0.00019578093328483123,
+};
+static const float tmath_lanes_atan2_lut[4] = {
+    -0.0443265554792128, -0.3258083974640975, +0.1555786518463281, +0.9997878412794807,
+};
+static const float tmath_lanes_atan2_pi_2 = M_PI_2;
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#define LANES 4
+#define LANE_SUFFIX sse
+#include "simd_lanes.h"
+#undef LANES
+#undef LANE_SUFFIX
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define LANES 8
+#define LANE_SUFFIX avx2
+#include "simd_lanes.h"
+#undef LANES
+#undef LANE_SUFFIX
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#define LANES 16
+#define LANE_SUFFIX avx512
+#include "simd_lanes.h"
+#undef LANES
+#undef LANE_SUFFIX
+#pragma GCC pop_options
+
+#define LANE_ARRAYS(suffix) \
+    tmath_sin_n_##suffix, tmath_sincos_n_##suffix, tmath_atan2_n_##suffix, \
+    tmath_pow_n_##suffix, tmath_sqrt_n_##suffix
+
+#else
+
+/* the libm fallbacks have no vector versions */
+#define LANE_ARRAYS(suffix) SCALAR_ARRAYS
+
+#endif
+
+static const struct tmath_kernels sse_kernels = {
+    "sse",
+    tmat4_multiply_sse,
+    tmat4_invert_sse,
+    tvec4_mul_mat4_sse,
+    tmat4_project_points_sse,
+    LANE_ARRAYS(sse),
+};
+
+/**
+ * A single vector or the cofactors do not fill 8 lanes, those stay
+ * sse in every wider variant. AVX lacks 256-bit integer operations,
+ * which the fast-math bit tricks need, so its arrays are sse as well.
+ **/
+static const struct tmath_kernels avx_kernels = {
+    "avx",
+    tmat4_multiply_avx,
+    tmat4_invert_sse,
+    tvec4_mul_mat4_sse,
+    tmat4_project_points_avx,
+    LANE_ARRAYS(sse),
+};
+
+static const struct tmath_kernels avx2_kernels = {
+    "avx2",
+    tmat4_multiply_avx,
+    tmat4_invert_sse,
+    tvec4_mul_mat4_sse,
+    tmat4_project_points_avx,
+    LANE_ARRAYS(avx2),
+};
+
+static const struct tmath_kernels avx512_kernels = {
+    "avx512",
+    tmat4_multiply_avx,
+    tmat4_invert_sse,
+    tvec4_mul_mat4_sse,
+    tmat4_project_points_avx,
+    LANE_ARRAYS(avx512),
+};
+
+#endif
+
+static const char *variant_names[TMATH_NUM_VARIANTS] = {
+    "scalar", "sse", "avx", "avx2", "avx512", "neon",
+};
+
+/**
+ * Returns the kernels of the given variant, or 0 if the variant is
+ * not built for this architecture or not supported by the cpu.
+ **/
+const struct tmath_kernels*
+tmath_kernels(int variant)
+{
+    switch (variant) {
+        case TMATH_SCALAR:
+            return &scalar_kernels;
+
+#ifdef TMATH_X86
+        case TMATH_SSE:
+            return __builtin_cpu_supports("sse2") ? &sse_kernels : 0;
+
+        case TMATH_AVX:
+            return __builtin_cpu_supports("avx") ? &avx_kernels : 0;
+
+        case TMATH_AVX2:
+            return __builtin_cpu_supports("avx2") ? &avx2_kernels : 0;
+
+        case TMATH_AVX512:
+            return __builtin_cpu_supports("avx512f") ? &avx512_kernels : 0;
+#endif
+    }
+
+    return 0;
+}
+
+/**
+ * Use the given variant from now on, it must not be changed while
+ * other threads use the math functions.
+ *
+ * Returns 0 on success.
+ **/
+int
+tmath_select(int variant)
+{
+    const struct tmath_kernels *k = tmath_kernels(variant);
+
+    if (!k) {
+        return 1;
+    }
+
+    tmath_active = k;
+    return 0;
+}
+
+int
+tmath_selected(void)
+{
+    for (int x=0; x<TMATH_NUM_VARIANTS; x++) {
+        if (tmath_kernels(x) == tmath_active) {
+            return x;
+        }
+    }
+    return TMATH_SCALAR;
+}
+
+/**
+ * Pick the widest variant the cpu supports before main() runs,
+ * unless TMATH_SIMD names one.
+ **/
+__attribute__((constructor)) static void
+tmath_init(void)
+{
+#ifdef TMATH_X86
+    __builtin_cpu_init();
+#endif
+
+    const char *env = getenv("TMATH_SIMD");
+
+    if (env) {
+        for (int x=0; x<TMATH_NUM_VARIANTS; x++) {
+            if (strcmp(env, variant_names[x]) == 0 && tmath_select(x) == 0) {
+                return;
+            }
+        }
+    }
+
+    for (int x=TMATH_NUM_VARIANTS-1; x>=0; x--) {
+        if (tmath_select(x) == 0) {
+            return;
+        }
+    }
+}
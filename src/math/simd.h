@@ -0,0 +1,78 @@
+#ifndef _TMATH_SIMD__H_
+#define _TMATH_SIMD__H_
+
+#include <stddef.h>
+
+#include "vector.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** @relates tmath_kernels @{ */
+enum {
+    TMATH_SCALAR,
+    TMATH_SSE,
+    TMATH_AVX,
+    TMATH_AVX2,
+    TMATH_AVX512,
+    TMATH_NEON, /* reserved, no kernels yet */
+
+    TMATH_NUM_VARIANTS
+};
+
+/**
+ * Implementations of the tmat4 and tvec4 functions that have vector
+ * versions. tmat4_multiply(), tmat4_invert(), tvec4_mul_mat4(),
+ * tmat4_project_points(), the tmath_*_n() array functions and
+ * everything built on them call through tmath_active, which points
+ * to the best variant the cpu supports. The TMATH_SIMD environment
+ * variable (scalar, sse, avx, avx2 or avx512) overrides the choice.
+ * The array functions run 4 lanes wide with sse and avx, 8 with avx2
+ * and 16 with avx512.
+ *
+ * All variants give bit-identical results: they do the same float
+ * operations as the scalar code, in the same order, and fused
+ * multiply-adds are never used.
+ **/
+struct tmath_kernels {
+    const char *name;
+    void (*mat4_multiply)(float *out, const float *a, const float *b); /* out = a*b, out may alias a or b */
+    int  (*mat4_invert)(float *m);
+    void (*vec4_mul_mat4)(tvec4 *v, const float *m);
+    void (*project_points)(const float *m, float width, float height,
+                           const float *x, const float *y, const float *z, size_t n,
+                           float *sx, float *sy, float *depth);
+    void (*sin_n)(float *out, const float *x, size_t n);
+    void (*sincos_n)(float *s, float *c, const float *x, size_t n);
+    void (*atan2_n)(float *out, const float *y, const float *x, size_t n);
+    void (*pow_n)(float *out, const float *x, const float *e, size_t n);
+    void (*sqrt_n)(float *out, const float *x, size_t n);
+};
+
+extern const struct tmath_kernels *tmath_active;
+
+const struct tmath_kernels *tmath_kernels(int variant);
+int tmath_select(int variant);
+int tmath_selected(void);
+
+/* the scalar kernels, in math.c */
+void tmat4_multiply_scalar(float *out, const float *a, const float *b);
+int  tmat4_invert_scalar(float *m);
+void tvec4_mul_mat4_scalar(tvec4 *v, const float *m);
+void tmat4_project_points_scalar(const float *m, float width, float height,
+                                 const float *x, const float *y, const float *z, size_t n,
+                                 float *sx, float *sy, float *depth);
+void tmath_sin_n_scalar(float *out, const float *x, size_t n);
+void tmath_sincos_n_scalar(float *s, float *c, const float *x, size_t n);
+void tmath_atan2_n_scalar(float *out, const float *y, const float *x, size_t n);
+void tmath_pow_n_scalar(float *out, const float *x, const float *e, size_t n);
+void tmath_sqrt_n_scalar(float *out, const float *x, size_t n);
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,262 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Array versions of the fast-math functions, written once over GCC
+ * vector types and included by simd.c for each lane count, with
+ * LANES and LANE_SUFFIX defined and the target set by a pragma. Every
+ * line repeats the corresponding line of math.c on all lanes, with
+ * the same float operations, int conversions and bit tricks, so the
+ * results are bit-identical to tmath_sin() and friends. Comparisons
+ * give 0 or -1 per lane, which is negated where the scalar code uses
+ * the 0 or 1 of a C comparison. The constant tables are in simd.c.
+ **/
+
+#define LANE_CAT_(a, b) a##b
+#define LANE_CAT(a, b) LANE_CAT_(a, b)
+#define LANE_FN(name) LANE_CAT(LANE_CAT(name, _), LANE_SUFFIX)
+
+#define VF LANE_CAT(tmath_vf, LANES)
+#define VI LANE_CAT(tmath_vi, LANES)
+
+typedef float VF __attribute__((vector_size(LANES * 4)));
+typedef int   VI __attribute__((vector_size(LANES * 4)));
+
+#define TOF(v) __builtin_convertvector(v, VF)
+#define TOI(v) __builtin_convertvector(v, VI)
+#define BITS(v) ((VI)(v))
+#define FLOATS(v) ((VF)(v))
+
+static inline VF
+LANE_FN(load)(const float *p)
+{
+    VF v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void
+LANE_FN(store)(float *p, VF v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline VF
+LANE_FN(fabs)(VF v)
+{
+    return FLOATS(BITS(v) & 0x7fffffff);
+}
+
+/* the reciprocal approximation shared by atan2 and sqrt */
+static inline VF
+LANE_FN(recip)(VF x)
+{
+    VI m = 0x3F800000 - (BITS(x) & 0x7F800000);
+    VF r = FLOATS(BITS(x) + m);
+    r = 1.41176471f - 0.47058824f * r;
+    r = FLOATS(BITS(r) + m);
+    VF b = 2.0f - r * x;
+    r = r * b;
+    b = 2.0f - r * x;
+    return r * b;
+}
+
+static inline VF
+LANE_FN(sin_lanes)(VF x)
+{
+    VF ax = LANE_FN(fabs)(x);
+    VI m = TOI(ax * tmath_lanes_sin_rng[0]);
+    ax = ax - TOF(m) * tmath_lanes_sin_rng[1];
+
+    VI n = m & 1;
+    ax = ax - TOF(n) * tmath_lanes_sin_rng[1];
+    m = m >> 1;
+    n = n ^ m;
+    m = -(x < 0.0f);
+    n = n ^ m;
+    n = n << 31;
+    ax = FLOATS(BITS(ax) ^ n);
+
+    VF xx = ax * ax;
+    VF a = (tmath_lanes_sin_lut[0] * ax) * xx + (tmath_lanes_sin_lut[2] * ax);
+    VF b = (tmath_lanes_sin_lut[1] * ax) * xx + (tmath_lanes_sin_lut[3] * ax);
+    xx = xx * xx;
+    return b + a * xx;
+}
+
+/* one half of tmath_sincos(), the sine of x or the cosine of x - pi/2 */
+static inline VF
+LANE_FN(sincos_lanes)(VF x)
+{
+    VF ax = LANE_FN(fabs)(x);
+    VI m = TOI(ax * tmath_lanes_sin_rng[0]);
+    ax = ax - TOF(m) * tmath_lanes_sin_rng[1];
+
+    VI n = m & 1;
+    ax = ax - TOF(n) * tmath_lanes_sin_rng[1];
+    m = m >> 1;
+    n = n ^ m;
+    m = -(x < 0.0f);
+    n = n ^ m;
+    n = n << 31;
+    ax = FLOATS(BITS(ax) ^ n);
+
+    VF xx = ax * ax;
+    VF r = tmath_lanes_sincos_lut[0] + (VF){};
+    r = r * xx + tmath_lanes_sincos_lut[2];
+    r = r * xx + tmath_lanes_sincos_lut[4];
+    r = r * xx + tmath_lanes_sincos_lut[6];
+    return r * ax;
+}
+
+static inline VF
+LANE_FN(pow_lanes)(VF x, VF e)
+{
+    const float *l = tmath_lanes_pow_lut;
+    VF a, b, c, d, xx, r = x;
+    VI m = BITS(r) >> 23;
+
+    m = m - 127;
+    r = FLOATS(BITS(r) - (m << 23));
+
+    xx = r * r;
+    a = (l[4] * r) + l[0];
+    b = (l[6] * r) + l[2];
+    c = (l[5] * r) + l[1];
+    d = (l[7] * r) + l[3];
+    a = a + b * xx;
+    c = c + d * xx;
+    xx = xx * xx;
+    r = a + c * xx;
+
+    r = r + TOF(m) * tmath_lanes_pow_rng[1];
+    r = r * e;
+
+    m = TOI(r * tmath_lanes_pow_rng[0]);
+    r = r - TOF(m) * tmath_lanes_pow_rng[1];
+
+    a = (l[12] * r) + l[8];
+    b = (l[14] * r) + l[10];
+    c = (l[13] * r) + l[9];
+    d = (l[15] * r) + l[11];
+    xx = r * r;
+    a = a + b * xx;
+    c = c + d * xx;
+    xx = xx * xx;
+    r = a + c * xx;
+
+    return FLOATS(BITS(r) + (m << 23));
+}
+
+static inline VF
+LANE_FN(atan2_lanes)(VF y, VF x)
+{
+    const float *l = tmath_lanes_atan2_lut;
+    const float pi_2 = tmath_lanes_atan2_pi_2;
+    VF a, b, c, r, xx, xinv;
+
+    xx = LANE_FN(fabs)(x);
+    xinv = LANE_FN(recip)(xx);
+
+    c = LANE_FN(fabs)(y * xinv);
+    xinv = LANE_FN(recip)(c);
+
+    xinv = xinv + c;
+    a = TOF(-(c > 1.0f));
+    c = c - a * xinv;
+    r = a * pi_2;
+
+    xx = c * c;
+    a = (l[0] * c) * xx + (l[2] * c);
+    b = (l[1] * c) * xx + (l[3] * c);
+    xx = xx * xx;
+    r = r + a * xx;
+    r = r + b;
+
+    b = (float)M_PI - 2.0f * r;
+    r = r + TOF(-(x < 0.0f)) * b;
+    b = TOF(-(LANE_FN(fabs)(x) < 0.000001f));
+    c = TOF(-(b == 0.0f));
+    r = c * r;
+    r = r + pi_2 * b;
+    b = r + r;
+    r = r - TOF(-(y < 0.0f)) * b;
+
+    return r;
+}
+
+static inline VF
+LANE_FN(sqrt_lanes)(VF x)
+{
+    VF a = FLOATS(0x5F3759DF - (BITS(x) >> 1));
+    VF c = x * a;
+    VF b = (3.0f - c * a) * 0.5f;
+    a = a * b;
+    c = x * a;
+    b = (3.0f - c * a) * 0.5f;
+    a = a * b;
+
+    return LANE_FN(recip)(a);
+}
+
+static void
+LANE_FN(tmath_sin_n)(float *out, const float *x, size_t n)
+{
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        LANE_FN(store)(out + i, LANE_FN(sin_lanes)(LANE_FN(load)(x + i)));
+    }
+    tmath_sin_n_scalar(out + i, x + i, n - i);
+}
+
+static void
+LANE_FN(tmath_sincos_n)(float *s, float *c, const float *x, size_t n)
+{
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        VF v = LANE_FN(load)(x + i);
+        LANE_FN(store)(s + i, LANE_FN(sincos_lanes)(v));
+        LANE_FN(store)(c + i, LANE_FN(sincos_lanes)(v + tmath_lanes_sin_rng[1]));
+    }
+    tmath_sincos_n_scalar(s + i, c + i, x + i, n - i);
+}
+
+static void
+LANE_FN(tmath_atan2_n)(float *out, const float *y, const float *x, size_t n)
+{
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        LANE_FN(store)(out + i, LANE_FN(atan2_lanes)(LANE_FN(load)(y + i), LANE_FN(load)(x + i)));
+    }
+    tmath_atan2_n_scalar(out + i, y + i, x + i, n - i);
+}
+
+static void
+LANE_FN(tmath_pow_n)(float *out, const float *x, const float *e, size_t n)
+{
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        LANE_FN(store)(out + i, LANE_FN(pow_lanes)(LANE_FN(load)(x + i), LANE_FN(load)(e + i)));
+    }
+    tmath_pow_n_scalar(out + i, x + i, e + i, n - i);
+}
+
+static void
+LANE_FN(tmath_sqrt_n)(float *out, const float *x, size_t n)
+{
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        LANE_FN(store)(out + i, LANE_FN(sqrt_lanes)(LANE_FN(load)(x + i)));
+    }
+    tmath_sqrt_n_scalar(out + i, x + i, n - i);
+}
+
+#undef TOF
+#undef TOI
+#undef BITS
+#undef FLOATS
+#undef VF
+#undef VI
+#undef LANE_FN
+#undef LANE_CAT
+#undef LANE_CAT_
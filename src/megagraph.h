@@ -2,24 +2,37 @@
 #define _PLOTTER__H_
 
 #include <stdio.h>
+#include <time.h>
 #include "glad/glad.h"
 #include <GLFW/glfw3.h>
 
-#define MG_NAME "MegaGraph"
-#define MG_VERSION "0.9"
-
-#define LOG_I(x, ...) fprintf(stdout, x "\n", ##__VA_ARGS__)
-#define LOG_E(x, ...) fprintf(stderr, x "\n", ##__VA_ARGS__)
+#include "log.h"
+#include "view.h"
 
 extern struct megagraph {
     struct tcam *cam;
-    float        cam_angle;
-    float        cam_dist;
+    struct view  view;
     float        dt;
-    float        last_time;
+    double       last_time;
+    int          redraw; /* set to have the next frame rendered */
+    int          hud;    /* show the frame statistics overlay */
+    int          pick;   /* set to have the sprite at pick_x, pick_y reported by the next frame */
+    float        pick_x; /* window position as a fraction of its size, from the bottom left */
+    float        pick_y;
 } mg;
 
 void on_glfw_key(GLFWwindow *win, int key, int scancode, int action, int mods);
-void input_tick(double dt);
+void on_glfw_mouse_button(GLFWwindow *win, int button, int action, int mods);
+int input_tick(double dt);
+int input_active(void);
+
+/**
+ * Monotonic time in seconds, usable with or without a window.
+ **/
+static inline double mg_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
 
 #endif
@@ -0,0 +1,97 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Memory ledger. Subsystems report what they hold in host and GPU
+ * memory per category, the current and peak amounts can be queried
+ * at any time. GPU amounts are what was requested from the driver,
+ * which may pad or duplicate storage.
+ **/
+
+#include <vips/vips.h>
+
+#include "memstat.h"
+
+static const char *names[MEM_NUM_CATEGORIES] = {
+    "vertex",
+    "index",
+    "draw lists",
+    "atlas",
+    "staging",
+    "curl",
+    "framebuffer",
+    "vips",
+};
+
+static size_t current[MEM_NUM_CATEGORIES][2];
+static size_t peak[MEM_NUM_CATEGORIES][2];
+
+void
+mem_set(int category, int where, size_t bytes)
+{
+    current[category][where] = bytes;
+    if (bytes > peak[category][where]) {
+        peak[category][where] = bytes;
+    }
+}
+
+void
+mem_add(int category, int where, long long bytes)
+{
+    long long v = (long long)current[category][where] + bytes;
+    mem_set(category, where, v > 0 ? (size_t)v : 0);
+}
+
+size_t
+mem_get(int category, int where)
+{
+    if (category == MEM_VIPS && where == MEM_HOST) {
+        mem_set(MEM_VIPS, MEM_HOST, vips_tracked_get_mem());
+    }
+
+    return current[category][where];
+}
+
+size_t
+mem_total(int where)
+{
+    size_t total = 0;
+
+    for (int x=0; x<MEM_NUM_CATEGORIES; x++) {
+        total += mem_get(x, where);
+    }
+
+    return total;
+}
+
+static double
+mb(size_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+void
+mem_report(FILE *fp)
+{
+    size_t peak_total[2] = {0, 0};
+
+    mem_get(MEM_VIPS, MEM_HOST);
+    if (vips_tracked_get_mem_highwater() > peak[MEM_VIPS][MEM_HOST]) {
+        peak[MEM_VIPS][MEM_HOST] = vips_tracked_get_mem_highwater();
+    }
+
+    fprintf(fp, "%-12s %12s %12s %12s %12s\n", "memory MB", "host", "gpu", "peak host", "peak gpu");
+
+    for (int x=0; x<MEM_NUM_CATEGORIES; x++) {
+        fprintf(fp, "%-12s %12.1f %12.1f %12.1f %12.1f\n", names[x],
+                mb(current[x][MEM_HOST]), mb(current[x][MEM_GPU]),
+                mb(peak[x][MEM_HOST]), mb(peak[x][MEM_GPU]));
+        peak_total[MEM_HOST] += peak[x][MEM_HOST];
+        peak_total[MEM_GPU] += peak[x][MEM_GPU];
+    }
+
+    /* the sum of the peaks is an upper bound, they need not coincide */
+    fprintf(fp, "%-12s %12.1f %12.1f %12.1f %12.1f\n", "total",
+            mb(mem_total(MEM_HOST)), mb(mem_total(MEM_GPU)),
+            mb(peak_total[MEM_HOST]), mb(peak_total[MEM_GPU]));
+}
@@ -0,0 +1,31 @@
+#ifndef _MEMSTAT__H_
+#define _MEMSTAT__H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+enum {
+    MEM_VERTEX,      /* point positions */
+    MEM_INDEX,       /* octree, its element buffer and the k-NN tree */
+    MEM_DRAW,        /* per-frame draw lists */
+    MEM_ATLAS,       /* texture atlases as stored by the driver */
+    MEM_STAGING,     /* atlas and mipmap buffers used while loading */
+    MEM_CURL,        /* download buffer */
+    MEM_FRAMEBUFFER, /* offscreen render targets */
+    MEM_VIPS,        /* pixel buffers tracked by vips */
+
+    MEM_NUM_CATEGORIES
+};
+
+enum {
+    MEM_HOST,
+    MEM_GPU,
+};
+
+void mem_set(int category, int where, size_t bytes);
+void mem_add(int category, int where, long long bytes);
+size_t mem_get(int category, int where);
+size_t mem_total(int where);
+void mem_report(FILE *fp);
+
+#endif
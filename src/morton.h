@@ -0,0 +1,29 @@
+#ifndef _MORTON__H_
+#define _MORTON__H_
+
+#include <stdint.h>
+
+/* spread the low 21 bits of x to every third bit */
+static inline uint64_t
+morton_spread(uint64_t x)
+{
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffULL;
+    x = (x | x << 16) & 0x1f0000ff0000ffULL;
+    x = (x | x << 8)  & 0x100f00f00f00f00fULL;
+    x = (x | x << 4)  & 0x10c30c30c30c30c3ULL;
+    x = (x | x << 2)  & 0x1249249249249249ULL;
+    return x;
+}
+
+/**
+ * Morton (Z-order) code of grid cell x, y, z, of up to 21 bits each,
+ * with x in the lowest bit of every level.
+ **/
+static inline uint64_t
+morton_encode(uint32_t x, uint32_t y, uint32_t z)
+{
+    return morton_spread(x) | morton_spread(y) << 1 | morton_spread(z) << 2;
+}
+
+#endif
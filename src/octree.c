@@ -0,0 +1,933 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * The octree is built from the points sorted by Morton code, so that
+ * every node, and every grid cell of a node, is a contiguous range of
+ * the sorted array and is carved out with one linear scan instead of
+ * being partitioned. The sort is a radix sort and both it and the
+ * subtrees below the first few levels run on the worker threads.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#include "octree.h"
+#include "morton.h"
+#include "trace.h"
+#include "worker.h"
+#include "math/camera.h"
+#include "math/intersect.h"
+
+#define MORTON_BITS 21    /* bits per axis, one per octree level */
+#define GRID_LEVELS 4     /* log2(OCTREE_GRID), the grid of a node is this many levels below it */
+#define RADIX_BITS  11    /* bits per digit of the Morton codes */
+#define RADIX_SIZE  (1 << RADIX_BITS)
+#define TOP_SHIFT   (3 * MORTON_BITS - RADIX_BITS)
+#define SORT_SMALL  32    /* ranges this short are insertion sorted */
+#define SORT_BLOCK  65536 /* points per block of the parallel passes */
+#define SPLIT_DEPTH 3     /* nodes below this depth are built as independent subtrees */
+#define SPRITE_REACH 1.4142136f /* corner of a 2 unit wide sprite from its point */
+
+#define CACHE_MAGIC   "MGOCTREE"
+#define CACHE_VERSION 2
+
+struct build_ctx {
+    const tvec4    *points;
+    const uint64_t *codes;  /* Morton codes, sorted */
+    const uint32_t *order;  /* the point of every sorted code */
+    unsigned char  *taken;  /* set when the sorted point has been given to a node */
+};
+
+/**
+ * A subtree that is left for the parallel pass, to be built into its
+ * own octree and appended as child octant of node parent.
+ **/
+struct pending {
+    uint32_t lo, hi;    /* range of the sorted points */
+    uint32_t remaining; /* points in the range not taken by an ancestor */
+    uint32_t first;     /* where its indices go in the octree's indices */
+    tvec3    center;
+    float    half;
+    int      depth;
+    int32_t  parent;
+    int      octant;
+};
+
+struct build_job {
+    struct build_ctx *c;
+    struct pending   *pending;
+    struct octree    *subtrees;
+    uint32_t         *indices; /* of the whole octree */
+    uint64_t         *by_size; /* size << 32 | index of the pending subtrees, largest first */
+    size_t            num_pending;
+    size_t            next;    /* next entry of by_size to build */
+    int               failed;
+};
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int
+push_node(struct octree *t)
+{
+    if (t->num_nodes == t->cap_nodes) {
+        size_t cap = t->cap_nodes ? t->cap_nodes * 2 : 64;
+        struct octree_node *n = realloc(t->nodes, cap * sizeof(struct octree_node));
+        if (!n) return -1;
+        t->nodes = n;
+        t->cap_nodes = cap;
+    }
+    memset(&t->nodes[t->num_nodes], 0, sizeof(struct octree_node));
+    return (int)t->num_nodes++;
+}
+
+static int
+push_pending(struct pending **p, size_t *num, size_t *cap, struct pending e)
+{
+    if (*num == *cap) {
+        size_t c = *cap ? *cap * 2 : 64;
+        struct pending *n = realloc(*p, c * sizeof(struct pending));
+        if (!n) return -1;
+        *p = n;
+        *cap = c;
+    }
+    (*p)[(*num)++] = e;
+    return 0;
+}
+
+struct runs_job {
+    struct octree *t;
+    int            points_per_texture;
+};
+
+/**
+ * Split the own points of nodes [begin, end), sorted by vertex index,
+ * into runs sharing the same texture atlas. With t->runs unset only
+ * the runs are counted, into num_runs.
+ **/
+static void
+make_runs(void *arg, size_t begin, size_t end)
+{
+    struct runs_job *j = (struct runs_job*)arg;
+    struct octree *t = j->t;
+
+    for (size_t x=begin; x<end; x++) {
+        struct octree_node *n = &t->nodes[x];
+        const uint32_t *idx = t->indices + n->first;
+        struct octree_run *r = t->runs ? t->runs + n->first_run : 0;
+        uint32_t num_runs = 0;
+
+        for (uint32_t i=0; i<n->count; i++) {
+            uint32_t texture = idx[i] / j->points_per_texture;
+            if (num_runs == 0 || texture != idx[i-1] / j->points_per_texture) {
+                if (r) r[num_runs] = (struct octree_run){texture, n->first + i, 0};
+                num_runs ++;
+            }
+            if (r) r[num_runs-1].count ++;
+        }
+
+        n->num_runs = num_runs;
+    }
+}
+
+/**
+ * Build the node for the sorted points [lo, hi), of which remaining
+ * are not yet taken by an ancestor, into t. With frontier set, the
+ * children at SPLIT_DEPTH are not built but added to it, with -1 left
+ * in the node for them. Returns the node id or -1 if out of memory.
+ **/
+static int
+build_node(struct build_ctx *c, struct octree *t, uint32_t lo, uint32_t hi, uint32_t remaining,
+           tvec3 center, float half, int depth,
+           struct pending **frontier, size_t *num_frontier, size_t *cap_frontier)
+{
+    int id = push_node(t);
+
+    if (id < 0) return -1;
+
+    struct octree_node *n = &t->nodes[id];
+    n->center = center;
+    n->half = half;
+    n->first = (uint32_t)t->num_indices;
+    for (int x=0; x<8; x++) n->children[x] = -1;
+
+    if (remaining <= OCTREE_NODE_POINTS || depth >= OCTREE_MAX_DEPTH) {
+        for (uint32_t x=lo; x<hi; x++) {
+            if (!c->taken[x]) {
+                c->taken[x] = 1;
+                t->indices[t->num_indices++] = c->order[x];
+            }
+        }
+        n->count = remaining;
+        qsort(t->indices + n->first, n->count, sizeof(uint32_t), cmp_u32);
+        return id;
+    }
+
+    /* keep the first point not taken in every occupied grid cell, the
+     * cells are the Morton prefixes GRID_LEVELS levels down */
+    int level = depth + GRID_LEVELS < MORTON_BITS ? depth + GRID_LEVELS : MORTON_BITS;
+    int cell_shift = 3 * (MORTON_BITS - level);
+    int octant_shift = 3 * (MORTON_BITS - 1 - depth);
+
+    uint32_t octant_count[8] = {0};
+    uint32_t octant_taken[8] = {0};
+    uint64_t cell = ~0ULL;
+    int need = 0;
+
+    for (uint32_t x=lo; x<hi; x++) {
+        uint64_t code = c->codes[x];
+        int o = (int)(code >> octant_shift) & 7;
+
+        if ((code >> cell_shift) != cell) {
+            cell = code >> cell_shift;
+            need = 1;
+        }
+        if (need && !c->taken[x]) {
+            c->taken[x] = 1;
+            t->indices[t->num_indices++] = c->order[x];
+            need = 0;
+        }
+
+        octant_count[o] ++;
+        octant_taken[o] += c->taken[x];
+    }
+
+    n->count = (uint32_t)t->num_indices - n->first;
+    qsort(t->indices + n->first, n->count, sizeof(uint32_t), cmp_u32);
+
+    /* the octants follow each other in Morton order */
+    float h = half / 2.f;
+    uint32_t first = lo;
+
+    for (int o=0; o<8; o++) {
+        uint32_t count = octant_count[o], left = octant_count[o] - octant_taken[o];
+        uint32_t child_lo = first;
+
+        first += count;
+        if (left == 0) continue;
+
+        tvec3 cc = (tvec3){
+            center.x + ((o & 1) ? h : -h),
+            center.y + ((o & 2) ? h : -h),
+            center.z + ((o & 4) ? h : -h)
+        };
+
+        if (frontier && depth + 1 >= SPLIT_DEPTH) {
+            struct pending p = {child_lo, child_lo + count, left, 0, cc, h, depth + 1, id, o};
+            if (push_pending(frontier, num_frontier, cap_frontier, p) != 0) return -1;
+            continue;
+        }
+
+        int child = build_node(c, t, child_lo, child_lo + count, left, cc, h, depth + 1,
+                               frontier, num_frontier, cap_frontier);
+        if (child < 0) return -1;
+
+        /* t->nodes may have moved during the recursion */
+        t->nodes[id].children[o] = child;
+    }
+
+    return id;
+}
+
+static int
+cmp_u64_desc(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x < y) - (x > y);
+}
+
+/**
+ * Every thread takes the largest subtree left until none are. The
+ * subtrees write their indices straight to their part of t->indices.
+ **/
+static void
+build_subtrees(void *arg, size_t begin, size_t end)
+{
+    TRACE_SCOPE("octree subtrees");
+    struct build_job *j = (struct build_job*)arg;
+    size_t x;
+
+    while ((x = __atomic_fetch_add(&j->next, 1, __ATOMIC_RELAXED)) < j->num_pending) {
+        uint32_t i = (uint32_t)j->by_size[x];
+        struct pending *p = &j->pending[i];
+        struct octree *s = &j->subtrees[i];
+
+        s->indices = j->indices + p->first;
+        if (build_node(j->c, s, p->lo, p->hi, p->remaining, p->center, p->half, p->depth, 0, 0, 0) < 0) {
+            __atomic_store_n(&j->failed, 1, __ATOMIC_RELAXED);
+        }
+        s->indices = 0;
+    }
+}
+
+/**
+ * Append the nodes of subtree s, whose indices are already in place
+ * at first, to t as child octant of node parent. Returns 0 on success.
+ **/
+static int
+append_subtree(struct octree *t, const struct octree *s, uint32_t first, int32_t parent, int octant)
+{
+    uint32_t node_base = (uint32_t)t->num_nodes;
+    uint32_t index_base = first;
+
+    for (size_t x=0; x<s->num_nodes; x++) {
+        if (push_node(t) < 0) return -1;
+
+        struct octree_node *n = &t->nodes[t->num_nodes-1];
+        *n = s->nodes[x];
+        n->first += index_base;
+        for (int c=0; c<8; c++) {
+            if (n->children[c] >= 0) n->children[c] += node_base;
+        }
+    }
+
+    t->num_indices += s->num_indices;
+    t->nodes[parent].children[octant] = (int32_t)node_base;
+
+    return 0;
+}
+
+struct sort_job {
+    const tvec4 *points;
+    size_t       num_points;
+    tvec3        min;
+    float        scale;      /* from world units to Morton cells */
+    uint64_t    *keys;
+    uint32_t    *values;
+    uint32_t    *hist;       /* RADIX_SIZE counters per block */
+    size_t       first[RADIX_SIZE + 1]; /* where every bucket of the top digit starts */
+    size_t       next;       /* next bucket to sort */
+};
+
+static void
+compute_codes(void *arg, size_t begin, size_t end)
+{
+    struct sort_job *j = (struct sort_job*)arg;
+    size_t last = end * SORT_BLOCK < j->num_points ? end * SORT_BLOCK : j->num_points;
+    const float max = (float)((1 << MORTON_BITS) - 1);
+
+    for (size_t x=begin * SORT_BLOCK; x<last; x++) {
+        float qx = (j->points[x].x - j->min.x) * j->scale;
+        float qy = (j->points[x].y - j->min.y) * j->scale;
+        float qz = (j->points[x].z - j->min.z) * j->scale;
+        qx = qx < 0.f ? 0.f : (qx > max ? max : qx);
+        qy = qy < 0.f ? 0.f : (qy > max ? max : qy);
+        qz = qz < 0.f ? 0.f : (qz > max ? max : qz);
+
+        j->keys[x] = morton_encode((uint32_t)qx, (uint32_t)qy, (uint32_t)qz);
+        j->values[x] = (uint32_t)x;
+    }
+}
+
+static void
+count_digits(void *arg, size_t begin, size_t end)
+{
+    struct sort_job *j = (struct sort_job*)arg;
+
+    for (size_t b=begin; b<end; b++) {
+        uint32_t *h = j->hist + b * RADIX_SIZE;
+        size_t last = (b+1) * SORT_BLOCK < j->num_points ? (b+1) * SORT_BLOCK : j->num_points;
+
+        memset(h, 0, RADIX_SIZE * sizeof(uint32_t));
+        for (size_t x=b * SORT_BLOCK; x<last; x++) {
+            h[(j->keys[x] >> TOP_SHIFT) & (RADIX_SIZE-1)] ++;
+        }
+    }
+}
+
+/**
+ * Move every key, with its value, to the bucket of its digit at
+ * shift, in place. first holds where each bucket starts and gets
+ * RADIX_SIZE+1 entries.
+ **/
+static void
+sort_permute(uint64_t *k, uint32_t *v, const size_t *first, int shift)
+{
+    size_t head[RADIX_SIZE];
+
+    memcpy(head, first, sizeof(head));
+
+    for (int d=0; d<RADIX_SIZE; d++) {
+        while (head[d] < first[d+1]) {
+            uint64_t key = k[head[d]];
+            uint32_t value = v[head[d]];
+            int kd = (int)(key >> shift) & (RADIX_SIZE-1);
+
+            /* swap the key into its bucket until one belonging here turns up */
+            while (kd != d) {
+                size_t to = head[kd]++;
+                uint64_t tk = k[to]; k[to] = key; key = tk;
+                uint32_t tv = v[to]; v[to] = value; value = tv;
+                kd = (int)(key >> shift) & (RADIX_SIZE-1);
+            }
+
+            k[head[d]] = key;
+            v[head[d]] = value;
+            head[d] ++;
+        }
+    }
+}
+
+/**
+ * Sort n keys with their values on the digit at shift and then every
+ * bucket on the digits below it. Small ranges are insertion sorted,
+ * so the recursion stops as soon as the points are told apart.
+ **/
+static void
+sort_msd(uint64_t *k, uint32_t *v, size_t n, int shift)
+{
+    if (n <= SORT_SMALL) {
+        for (size_t x=1; x<n; x++) {
+            uint64_t key = k[x];
+            uint32_t value = v[x];
+            size_t y = x;
+            for (; y > 0 && k[y-1] > key; y--) {
+                k[y] = k[y-1];
+                v[y] = v[y-1];
+            }
+            k[y] = key;
+            v[y] = value;
+        }
+        return;
+    }
+
+    size_t first[RADIX_SIZE + 1] = {0};
+
+    for (size_t x=0; x<n; x++) {
+        first[((k[x] >> shift) & (RADIX_SIZE-1)) + 1] ++;
+    }
+    for (int d=0; d<RADIX_SIZE; d++) {
+        first[d+1] += first[d];
+    }
+
+    sort_permute(k, v, first, shift);
+
+    if (shift == 0) {
+        return;
+    }
+
+    int next = shift > RADIX_BITS ? shift - RADIX_BITS : 0;
+    for (int d=0; d<RADIX_SIZE; d++) {
+        sort_msd(k + first[d], v + first[d], first[d+1] - first[d], next);
+    }
+}
+
+/* every thread takes the next bucket of the top digit until none are left */
+static void
+sort_buckets(void *arg, size_t begin, size_t end)
+{
+    struct sort_job *j = (struct sort_job*)arg;
+    size_t d;
+
+    while ((d = __atomic_fetch_add(&j->next, 1, __ATOMIC_RELAXED)) < RADIX_SIZE) {
+        sort_msd(j->keys + j->first[d], j->values + j->first[d],
+                 j->first[d+1] - j->first[d], TOP_SHIFT - RADIX_BITS);
+    }
+}
+
+/**
+ * Sort j->keys together with j->values, in place. The top digit is
+ * counted in parallel and then every bucket is sorted on its own by
+ * the worker threads.
+ **/
+static void
+radix_sort(struct sort_job *j, size_t num_blocks)
+{
+    worker_parallel_for(num_blocks, count_digits, j);
+
+    j->first[0] = 0;
+    for (int d=0; d<RADIX_SIZE; d++) {
+        size_t count = 0;
+        for (size_t b=0; b<num_blocks; b++) {
+            count += j->hist[b * RADIX_SIZE + d];
+        }
+        j->first[d+1] = j->first[d] + count;
+    }
+
+    sort_permute(j->keys, j->values, j->first, TOP_SHIFT);
+
+    j->next = 0;
+    worker_parallel_for(worker_num_threads(), sort_buckets, j);
+}
+
+/**
+ * Build the octree over the given points.
+ *
+ * points_per_texture is the number of sprites per texture atlas, it
+ * is used to group each node's points into per-texture runs.
+ *
+ * Returns 0 on success.
+ **/
+int
+octree_build(struct octree *t, const tvec4 *points, size_t num_points, int points_per_texture)
+{
+    TRACE_SCOPE("octree build");
+    memset(t, 0, sizeof(struct octree));
+
+    if (num_points == 0) {
+        return 0;
+    }
+
+    tvec3 min = (tvec3){FLT_MAX, FLT_MAX, FLT_MAX};
+    tvec3 max = (tvec3){-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    for (size_t x=0; x<num_points; x++) {
+        if (points[x].x < min.x) min.x = points[x].x;
+        if (points[x].y < min.y) min.y = points[x].y;
+        if (points[x].z < min.z) min.z = points[x].z;
+        if (points[x].x > max.x) max.x = points[x].x;
+        if (points[x].y > max.y) max.y = points[x].y;
+        if (points[x].z > max.z) max.z = points[x].z;
+    }
+
+    float half = max.x - min.x;
+    if (max.y - min.y > half) half = max.y - min.y;
+    if (max.z - min.z > half) half = max.z - min.z;
+    half = half / 2.f + 1.f; /* sprites are 2 units wide */
+
+    tvec3 center = (tvec3){(min.x+max.x)/2.f, (min.y+max.y)/2.f, (min.z+max.z)/2.f};
+
+    size_t num_blocks = (num_points + SORT_BLOCK - 1) / SORT_BLOCK;
+    struct sort_job s = {
+        .points = points,
+        .num_points = num_points,
+        .min = (tvec3){center.x - half, center.y - half, center.z - half},
+        .scale = (float)(1 << MORTON_BITS) / (2.f * half),
+        .keys = malloc(num_points * sizeof(uint64_t)),
+        .values = malloc(num_points * sizeof(uint32_t)),
+        .hist = malloc(num_blocks * RADIX_SIZE * sizeof(uint32_t)),
+    };
+
+    if (!s.keys || !s.values || !s.hist) {
+        free(s.keys); free(s.values); free(s.hist);
+        return 1;
+    }
+
+    struct trace_scope ts = trace_begin("octree sort");
+    worker_parallel_for(num_blocks, compute_codes, &s);
+    radix_sort(&s, num_blocks);
+    trace_end(&ts);
+
+    free(s.hist);
+
+    struct build_ctx c = {points, s.keys, s.values, calloc(num_points, 1)};
+    struct build_job j = {&c};
+    size_t cap_pending = 0;
+
+    t->indices = malloc(num_points * sizeof(uint32_t));
+    j.indices = t->indices;
+
+    int r = c.taken && t->indices
+        && build_node(&c, t, 0, (uint32_t)num_points, (uint32_t)num_points, center, half, 0,
+                      &j.pending, &j.num_pending, &cap_pending) >= 0;
+
+    if (r && j.num_pending > 0) {
+        j.subtrees = calloc(j.num_pending, sizeof(struct octree));
+        j.by_size = malloc(j.num_pending * sizeof(uint64_t));
+        r = j.subtrees && j.by_size;
+    }
+
+    if (r && j.num_pending > 0) {
+        /* the subtrees follow the indices of the nodes above them in octree order */
+        uint32_t first = (uint32_t)t->num_indices;
+
+        for (size_t x=0; x<j.num_pending; x++) {
+            j.pending[x].first = first;
+            first += j.pending[x].remaining;
+            j.by_size[x] = (uint64_t)j.pending[x].remaining << 32 | x;
+        }
+        qsort(j.by_size, j.num_pending, sizeof(uint64_t), cmp_u64_desc);
+
+        worker_parallel_for(worker_num_threads(), build_subtrees, &j);
+        r = !j.failed;
+
+        /* appending in octree order gives the same tree with any number of threads */
+        for (size_t x=0; x<j.num_pending && r; x++) {
+            struct pending *p = &j.pending[x];
+            r = append_subtree(t, &j.subtrees[x], p->first, p->parent, p->octant) == 0;
+            octree_free(&j.subtrees[x]);
+        }
+    }
+
+    for (size_t x=0; j.subtrees && x<j.num_pending; x++) {
+        octree_free(&j.subtrees[x]);
+    }
+    free(j.subtrees);
+    free(j.by_size);
+    free(j.pending);
+    free(c.taken);
+    free(s.keys);
+    free(s.values);
+
+    /* count the runs of every node, then fill them in at their offsets */
+    struct runs_job rj = {t, points_per_texture};
+
+    if (r) {
+        TRACE_SCOPE("octree runs");
+        worker_parallel_for(t->num_nodes, make_runs, &rj);
+
+        for (size_t x=0; x<t->num_nodes; x++) {
+            t->nodes[x].first_run = (uint32_t)t->num_runs;
+            t->num_runs += t->nodes[x].num_runs;
+        }
+
+        t->runs = malloc(t->num_runs * sizeof(struct octree_run));
+        t->cap_runs = t->num_runs;
+        r = t->runs != 0;
+    }
+
+    if (r) {
+        worker_parallel_for(t->num_nodes, make_runs, &rj);
+    }
+
+    if (!r) {
+        octree_free(t);
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+octree_free(struct octree *t)
+{
+    free(t->nodes);
+    free(t->indices);
+    free(t->runs);
+    free(t->visible);
+    memset(t, 0, sizeof(struct octree));
+}
+
+static int
+push_visible(struct octree *t, uint32_t node)
+{
+    if (t->num_visible == t->cap_visible) {
+        size_t cap = t->cap_visible ? t->cap_visible * 2 : 256;
+        uint32_t *v = realloc(t->visible, cap * sizeof(uint32_t));
+        if (!v) return -1;
+        t->visible = v;
+        t->cap_visible = cap;
+    }
+    t->visible[t->num_visible++] = node;
+    return 0;
+}
+
+/**
+ * Select the nodes to draw for the given camera.
+ *
+ * A node's children are visited as long as the node's grid cell, which
+ * is the spacing between its representative points, covers more than
+ * `threshold` pixels on screen. Nodes outside the camera's frustum are
+ * skipped along with their subtrees, and the children of nodes inside
+ * it are not tested again. The selected node ids are written to
+ * t->visible.
+ *
+ * If front_to_back is set, the children of every node are visited
+ * starting with the octant containing the camera, which yields a
+ * coarse front-to-back order (a parent still comes before its
+ * children) at no extra cost.
+ *
+ * Returns the number of selected nodes.
+ **/
+size_t
+octree_select(struct octree *t, struct tcam *cam, float threshold, int front_to_back)
+{
+    int32_t stack[OCTREE_MAX_DEPTH * 7 + 8];
+    uint8_t inside[OCTREE_MAX_DEPTH * 7 + 8]; /* the node's parent is inside the frustum */
+    int sp = 0;
+
+    t->num_visible = 0;
+
+    if (t->num_nodes == 0) {
+        return 0;
+    }
+
+    /* pixels per world unit at distance 1 */
+    float px_scale = 1.f;
+    if (tcam_enabled(cam, TCAM_PERSPECTIVE)) {
+        px_scale = cam->height / (2.f * tanf(cam->fov * 3.141592653589793f / 360.f));
+    }
+
+    stack[sp] = 0;
+    inside[sp++] = 0;
+
+    while (sp > 0) {
+        int32_t id = stack[--sp];
+        struct octree_node *n = &t->nodes[id];
+        int in = inside[sp];
+
+        if (!in) {
+            /* grown by the reach of a sprite past the points in the node */
+            float h = n->half + SPRITE_REACH;
+            int c = tintersect_aabb_frustum(cam->frustum, TCAM_FRUSTUM_NUM_PLANES, n->center, (tvec3){h, h, h});
+            if (c == TINTERSECT_OUTSIDE) {
+                continue;
+            }
+            in = c == TINTERSECT_INSIDE;
+        }
+
+        if (push_visible(t, id) != 0) {
+            break;
+        }
+
+        float error = (2.f * n->half / OCTREE_GRID) * px_scale;
+
+        if (tcam_enabled(cam, TCAM_PERSPECTIVE)) {
+            tvec3 d = (tvec3){
+                n->center.x - cam->_position.x,
+                n->center.y - cam->_position.y,
+                n->center.z - cam->_position.z
+            };
+            float dist = tvec3_magnitude(&d) - n->half * 1.7320508f;
+
+            if (dist > cam->near) {
+                error /= dist;
+            } else {
+                error = FLT_MAX;
+            }
+        }
+
+        if (error <= threshold) {
+            continue;
+        }
+
+        /* xor-ing with the octant nearest to the camera gives a
+         * visibility order, push the farthest octant first so that
+         * the nearest one is popped first */
+        int near = 0;
+        if (front_to_back) {
+            near = (cam->_position.x >= n->center.x)
+                 | ((cam->_position.y >= n->center.y) << 1)
+                 | ((cam->_position.z >= n->center.z) << 2);
+        }
+
+        for (int x=7; x>=0; x--) {
+            int child = n->children[x ^ near];
+            if (child >= 0) {
+                stack[sp] = child;
+                inside[sp++] = (uint8_t)in;
+            }
+        }
+    }
+
+    return t->num_visible;
+}
+
+/**
+ * Identifies the points an octree was built over, a word-wise FNV-1a
+ * over the positions of every block, folded in block order.
+ **/
+struct hash_job {
+    const tvec4 *points;
+    size_t       num_points;
+    uint64_t    *blocks;
+};
+
+static void
+hash_blocks(void *arg, size_t begin, size_t end)
+{
+    struct hash_job *j = (struct hash_job*)arg;
+
+    for (size_t b=begin; b<end; b++) {
+        size_t last = (b+1) * SORT_BLOCK < j->num_points ? (b+1) * SORT_BLOCK : j->num_points;
+        uint64_t h = 0xcbf29ce484222325ULL;
+
+        for (size_t x=b * SORT_BLOCK; x<last; x++) {
+            uint32_t w[3];
+            memcpy(w, &j->points[x], sizeof(w));
+            h = (h ^ w[0]) * 0x100000001b3ULL;
+            h = (h ^ w[1]) * 0x100000001b3ULL;
+            h = (h ^ w[2]) * 0x100000001b3ULL;
+        }
+        j->blocks[b] = h;
+    }
+}
+
+static uint64_t
+hash_points(const tvec4 *points, size_t num_points)
+{
+    size_t num_blocks = (num_points + SORT_BLOCK - 1) / SORT_BLOCK;
+    struct hash_job j = {points, num_points, malloc((num_blocks + 1) * sizeof(uint64_t))};
+    uint64_t h = 0xcbf29ce484222325ULL ^ num_points;
+
+    if (!j.blocks) {
+        return 0;
+    }
+
+    worker_parallel_for(num_blocks, hash_blocks, &j);
+
+    for (size_t b=0; b<num_blocks; b++) {
+        h = (h ^ j.blocks[b]) * 0x100000001b3ULL;
+    }
+    free(j.blocks);
+
+    return h;
+}
+
+struct cache_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t node_size;          /* sizeof(struct octree_node), to reject files of other builds */
+    uint64_t hash;               /* of the points, see hash_points() */
+    uint64_t num_points;
+    uint64_t num_nodes;
+    uint64_t num_runs;
+    int32_t  points_per_texture;
+    int32_t  grid;
+    uint64_t num_textures;       /* runs may only refer to these */
+};
+
+static void
+cache_header(struct cache_header *h, const tvec4 *points, size_t num_points, int points_per_texture)
+{
+    memset(h, 0, sizeof(struct cache_header));
+    memcpy(h->magic, CACHE_MAGIC, sizeof(h->magic));
+    h->version = CACHE_VERSION;
+    h->node_size = sizeof(struct octree_node);
+    h->hash = hash_points(points, num_points);
+    h->num_points = num_points;
+    h->points_per_texture = points_per_texture;
+    h->num_textures = (num_points + points_per_texture - 1) / points_per_texture;
+    h->grid = OCTREE_GRID;
+}
+
+/**
+ * Write the octree built over the given points to filename, through
+ * a temporary file so that a partial file is never left behind.
+ *
+ * Returns 0 on success.
+ **/
+int
+octree_save(const struct octree *t, const char *filename,
+            const tvec4 *points, size_t num_points, int points_per_texture)
+{
+    TRACE_SCOPE("octree save");
+    struct cache_header h;
+    char tmp[1024];
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", filename) >= (int)sizeof(tmp)) {
+        return 1;
+    }
+
+    cache_header(&h, points, num_points, points_per_texture);
+    h.num_nodes = t->num_nodes;
+    h.num_runs = t->num_runs;
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        return 1;
+    }
+
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1
+          && fwrite(t->nodes, sizeof(struct octree_node), t->num_nodes, fp) == t->num_nodes
+          && fwrite(t->runs, sizeof(struct octree_run), t->num_runs, fp) == t->num_runs
+          && fwrite(t->indices, sizeof(uint32_t), t->num_indices, fp) == t->num_indices;
+
+    ok = fclose(fp) == 0 && ok;
+
+    if (!ok || rename(tmp, filename) != 0) {
+        remove(tmp);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Read an octree written by octree_save() for the same points and
+ * points_per_texture.
+ *
+ * Returns 0 on success, and non-zero without touching t if there is
+ * no such file or it was written for other points.
+ **/
+int
+octree_load(struct octree *t, const char *filename,
+            const tvec4 *points, size_t num_points, int points_per_texture)
+{
+    TRACE_SCOPE("octree load");
+    struct cache_header h, expect;
+    struct octree l = {0};
+
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return 1;
+    }
+
+    if (fread(&h, sizeof(h), 1, fp) != 1) {
+        fclose(fp);
+        return 1;
+    }
+
+    cache_header(&expect, points, num_points, points_per_texture);
+    expect.num_nodes = h.num_nodes;
+    expect.num_runs = h.num_runs;
+
+    if (memcmp(&h, &expect, sizeof(h)) != 0) {
+        fclose(fp);
+        return 1;
+    }
+
+    l.nodes = malloc(h.num_nodes * sizeof(struct octree_node));
+    l.runs = malloc(h.num_runs * sizeof(struct octree_run));
+    l.indices = malloc(num_points * sizeof(uint32_t));
+    l.num_nodes = l.cap_nodes = h.num_nodes;
+    l.num_runs = l.cap_runs = h.num_runs;
+    l.num_indices = num_points;
+
+    int ok = l.nodes && l.runs && l.indices
+          && fread(l.nodes, sizeof(struct octree_node), l.num_nodes, fp) == l.num_nodes
+          && fread(l.runs, sizeof(struct octree_run), l.num_runs, fp) == l.num_runs
+          && fread(l.indices, sizeof(uint32_t), l.num_indices, fp) == l.num_indices;
+
+    fclose(fp);
+
+    /* a damaged file must not send the traversals out of bounds, nor
+     * around in circles: every node but the root has exactly one
+     * parent, which comes before it */
+    unsigned char *has_parent = ok ? calloc(l.num_nodes + 1, 1) : 0;
+    ok = ok && has_parent && l.num_nodes > 0;
+
+    for (size_t x=0; ok && x<l.num_nodes; x++) {
+        const struct octree_node *n = &l.nodes[x];
+        ok = (uint64_t)n->first + n->count <= num_points
+          && (uint64_t)n->first_run + n->num_runs <= l.num_runs;
+        for (int c=0; ok && c<8; c++) {
+            int32_t child = n->children[c];
+            if (child != -1) {
+                ok = child > (int64_t)x && child < (int64_t)l.num_nodes && !has_parent[child];
+                if (ok) has_parent[child] = 1;
+            }
+        }
+    }
+    free(has_parent);
+
+    for (size_t x=0; ok && x<l.num_indices; x++) {
+        ok = l.indices[x] < num_points;
+    }
+
+    /* the points of a run are drawn with its texture, and from the
+     * vertex buffer that holds that texture */
+    for (size_t x=0; ok && x<l.num_runs; x++) {
+        const struct octree_run *r = &l.runs[x];
+        ok = (uint64_t)r->first + r->count <= num_points;
+        for (uint32_t y=0; ok && y<r->count; y++) {
+            ok = l.indices[r->first + y] / (uint32_t)points_per_texture == r->texture;
+        }
+    }
+
+    if (!ok) {
+        octree_free(&l);
+        return 1;
+    }
+
+    *t = l;
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef _OCTREE__H_
+#define _OCTREE__H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "math/vector.h"
+
+struct tcam;
+
+#define OCTREE_GRID        16 /* representatives are picked one per cell of a GRID^3 grid */
+#define OCTREE_NODE_POINTS (OCTREE_GRID*OCTREE_GRID*OCTREE_GRID)
+#define OCTREE_MAX_DEPTH   21
+
+/**
+ * A run of indices in octree.indices that all refer to
+ * points in the same texture atlas.
+ **/
+struct octree_run {
+    uint32_t texture;
+    uint32_t first;
+    uint32_t count;
+};
+
+/**
+ * Every point belongs to exactly one node. Internal nodes own a
+ * spatially even sample of the points below them, so drawing a node
+ * together with all its ancestors gives a coarse but complete
+ * representation of the node's volume.
+ **/
+struct octree_node {
+    tvec3    center;
+    float    half;        /* half the edge length of the node cube */
+    uint32_t first;       /* first index of the node's own points */
+    uint32_t count;
+    uint32_t first_run;
+    uint32_t num_runs;
+    int32_t  children[8]; /* -1 if there is no child */
+};
+
+struct octree {
+    struct octree_node *nodes;
+    size_t              num_nodes;
+    size_t              cap_nodes;
+
+    uint32_t           *indices;
+    size_t              num_indices;
+
+    struct octree_run  *runs;
+    size_t              num_runs;
+    size_t              cap_runs;
+
+    /* output of octree_select() */
+    uint32_t           *visible;
+    size_t              num_visible;
+    size_t              cap_visible;
+};
+
+int octree_build(struct octree *t, const tvec4 *points, size_t num_points, int points_per_texture);
+void octree_free(struct octree *t);
+int octree_save(const struct octree *t, const char *filename,
+                const tvec4 *points, size_t num_points, int points_per_texture);
+int octree_load(struct octree *t, const char *filename,
+                const tvec4 *points, size_t num_points, int points_per_texture);
+size_t octree_select(struct octree *t, struct tcam *cam, float threshold, int front_to_back);
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ **/
+
+#include <string.h>
+
+#include "megagraph.h"
+#include "memstat.h"
+#include "offscreen.h"
+
+/**
+ * Make sure the framebuffer exists and has the given size, storage
+ * is only reallocated if the size changed.
+ *
+ * Returns 0 on success.
+ **/
+int
+offscreen_resize(struct offscreen *o, int width, int height)
+{
+    if (o->fbo && o->width == width && o->height == height) {
+        return 0;
+    }
+
+    if (!o->fbo) {
+        glGenFramebuffers(1, &o->fbo);
+        glGenRenderbuffers(1, &o->color);
+        glGenRenderbuffers(1, &o->depth);
+    }
+
+    glBindRenderbuffer(GL_RENDERBUFFER, o->color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, o->depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, o->fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, o->color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, o->depth);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        LOG_E("Incomplete framebuffer: 0x%x", status);
+        return 1;
+    }
+
+    /* rgba8 color and 24 bit depth, padded to 32 bits; only once the
+     * size is kept, so offscreen_free() takes off what was added */
+    mem_add(MEM_FRAMEBUFFER, MEM_GPU, ((long long)width * height - (long long)o->width * o->height) * 8);
+
+    o->width = width;
+    o->height = height;
+
+    return 0;
+}
+
+void
+offscreen_free(struct offscreen *o)
+{
+    if (o->fbo) {
+        glDeleteFramebuffers(1, &o->fbo);
+        glDeleteRenderbuffers(1, &o->color);
+        glDeleteRenderbuffers(1, &o->depth);
+        mem_add(MEM_FRAMEBUFFER, MEM_GPU, -(long long)o->width * o->height * 8);
+    }
+    memset(o, 0, sizeof(struct offscreen));
+}
@@ -0,0 +1,20 @@
+#ifndef _OFFSCREEN__H_
+#define _OFFSCREEN__H_
+
+#include "glad/glad.h"
+
+/**
+ * Framebuffer object with a color and a depth renderbuffer.
+ **/
+struct offscreen {
+    GLuint fbo;
+    GLuint color;
+    GLuint depth;
+    int    width;
+    int    height;
+};
+
+int offscreen_resize(struct offscreen *o, int width, int height);
+void offscreen_free(struct offscreen *o);
+
+#endif
@@ -0,0 +1,236 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Finding the sprite under the cursor. A ray through the pixel is cast
+ * into the octree nearest node first, and every point of a visited node
+ * is tested against its quad in view space, the same square the
+ * geometry shader emits. Nodes that the ray enters behind the nearest
+ * hit so far are skipped, so only the few nodes along the ray in front
+ * of the hit are looked at.
+ **/
+
+#include <float.h>
+#include <math.h>
+
+#include "math/camera.h"
+#include "octree.h"
+#include "pick.h"
+
+/* nodes are pushed at most 8 per level */
+#define PICK_STACK (8 * (OCTREE_MAX_DEPTH + 2))
+
+struct pick_entry {
+    int32_t node;
+    float   t;
+};
+
+/**
+ * Clip the ray against one slab of a box, returns 0 if nothing of the
+ * ray is left.
+ **/
+static int
+clip_slab(float origin, float dir, float lo, float hi, float *t0, float *t1)
+{
+    if (dir == 0.f) {
+        return origin >= lo && origin <= hi;
+    }
+
+    float a = (lo - origin) / dir;
+    float b = (hi - origin) / dir;
+
+    if (a > b) {
+        float tmp = a; a = b; b = tmp;
+    }
+    if (a > *t0) *t0 = a;
+    if (b < *t1) *t1 = b;
+
+    return *t0 <= *t1;
+}
+
+/**
+ * Distance along the ray to where it enters the node's cube grown by
+ * pad on every side, or -1 if it misses. Starting inside gives 0.
+ **/
+static float
+ray_node(const struct pick_ray *r, const struct octree_node *n, float pad)
+{
+    float t0 = 0.f, t1 = FLT_MAX;
+    float h = n->half + pad;
+
+    if (!clip_slab(r->origin.x, r->dir.x, n->center.x - h, n->center.x + h, &t0, &t1)
+            || !clip_slab(r->origin.y, r->dir.y, n->center.y - h, n->center.y + h, &t0, &t1)
+            || !clip_slab(r->origin.z, r->dir.z, n->center.z - h, n->center.z + h, &t0, &t1)) {
+        return -1.f;
+    }
+
+    return t0;
+}
+
+/**
+ * Cast a ray from the near plane through window coordinates x, y of
+ * the camera, measured in pixels from the bottom left corner like
+ * tcam_unproject(). The camera must be calculated.
+ **/
+void
+pick_ray_from_screen(struct tcam *cam, float x, float y, struct pick_ray *ray)
+{
+    tvec3 near = tcam_unproject(cam, x, y, 0.f);
+    tvec3 dir;
+
+    if (tcam_enabled(cam, TCAM_PERSPECTIVE)) {
+        dir = tvec3f(near.x - cam->_position.x, near.y - cam->_position.y, near.z - cam->_position.z);
+    } else {
+        /* every ray is parallel to the view direction, -z of the view matrix */
+        dir = tvec3f(-cam->view[2], -cam->view[6], -cam->view[10]);
+    }
+
+    tvec3_normalize(&dir);
+
+    ray->origin = near;
+    ray->dir = dir;
+}
+
+/**
+ * Find the nearest sprite hit by the ray. Sprites face the camera, so
+ * the view matrix of cam decides the orientation of every quad.
+ * Returns non-zero and fills in hit if a sprite was hit.
+ **/
+int
+pick_ray(const struct octree *t, const tvec4 *points, const struct tcam *cam,
+         const struct pick_ray *ray, struct pick_hit *hit)
+{
+    const float *v = cam->view;
+    const float h = PICK_SPRITE_HALF;
+    /* a quad reaches at most this far from its point in any direction */
+    const float pad = h * 1.41421356f;
+
+    struct pick_entry stack[PICK_STACK];
+    int sp = 0;
+
+    float best = FLT_MAX;
+    int64_t best_index = -1;
+
+    hit->nodes = 0;
+    hit->tested = 0;
+
+    if (t->num_nodes == 0) {
+        return 0;
+    }
+
+    /* the ray in view space, where every quad lies in a plane of constant z */
+    float ox = v[0]*ray->origin.x + v[4]*ray->origin.y + v[8]*ray->origin.z + v[12];
+    float oy = v[1]*ray->origin.x + v[5]*ray->origin.y + v[9]*ray->origin.z + v[13];
+    float oz = v[2]*ray->origin.x + v[6]*ray->origin.y + v[10]*ray->origin.z + v[14];
+    float dx = v[0]*ray->dir.x + v[4]*ray->dir.y + v[8]*ray->dir.z;
+    float dy = v[1]*ray->dir.x + v[5]*ray->dir.y + v[9]*ray->dir.z;
+    float dz = v[2]*ray->dir.x + v[6]*ray->dir.y + v[10]*ray->dir.z;
+
+    /* a ray along the quads can't hit any of them */
+    if (fabsf(dz) < 1e-6f) {
+        return 0;
+    }
+
+    float inv_dz = 1.f / dz;
+    float t_root = ray_node(ray, &t->nodes[0], pad);
+
+    if (t_root >= 0.f) {
+        stack[sp++] = (struct pick_entry){0, t_root};
+    }
+
+    while (sp > 0) {
+        struct pick_entry e = stack[--sp];
+
+        if (e.t >= best) {
+            continue;
+        }
+
+        const struct octree_node *n = &t->nodes[e.node];
+        const uint32_t *idx = t->indices + n->first;
+
+        hit->nodes ++;
+        hit->tested += n->count;
+
+        for (uint32_t x=0; x<n->count; x++) {
+            const tvec4 *p = &points[idx[x]];
+
+            /* a node's points are spread over the whole array, fetch ahead */
+            if (x + 16 < n->count) {
+                __builtin_prefetch(&points[idx[x+16]]);
+            }
+
+            float pz = v[2]*p->x + v[6]*p->y + v[10]*p->z + v[14];
+            float d = (pz - oz) * inv_dz;
+
+            if (d < 0.f || d >= best) {
+                continue;
+            }
+
+            float px = v[0]*p->x + v[4]*p->y + v[8]*p->z + v[12];
+            if (fabsf(ox + d*dx - px) > h) {
+                continue;
+            }
+
+            float py = v[1]*p->x + v[5]*p->y + v[9]*p->z + v[13];
+            if (fabsf(oy + d*dy - py) > h) {
+                continue;
+            }
+
+            best = d;
+            best_index = idx[x];
+        }
+
+        /* push the children farthest first, so the nearest is visited next */
+        struct pick_entry children[8];
+        int num_children = 0;
+
+        for (int c=0; c<8; c++) {
+            if (n->children[c] < 0) {
+                continue;
+            }
+
+            float tc = ray_node(ray, &t->nodes[n->children[c]], pad);
+            if (tc < 0.f || tc >= best) {
+                continue;
+            }
+
+            int k = num_children++;
+            while (k > 0 && children[k-1].t < tc) {
+                children[k] = children[k-1];
+                k --;
+            }
+            children[k] = (struct pick_entry){n->children[c], tc};
+        }
+
+        for (int c=0; c<num_children && sp < PICK_STACK; c++) {
+            stack[sp++] = children[c];
+        }
+    }
+
+    if (best_index < 0) {
+        return 0;
+    }
+
+    const tvec4 *p = &points[best_index];
+
+    hit->index = (uint32_t)best_index;
+    hit->position = tvec3f(p->x, p->y, p->z);
+    hit->distance = best;
+
+    return 1;
+}
+
+/**
+ * Find the nearest sprite under window coordinates x, y of the camera,
+ * see pick_ray_from_screen(). Returns non-zero if a sprite was hit.
+ **/
+int
+pick_screen(const struct octree *t, const tvec4 *points, struct tcam *cam,
+            float x, float y, struct pick_hit *hit)
+{
+    struct pick_ray ray;
+
+    pick_ray_from_screen(cam, x, y, &ray);
+
+    return pick_ray(t, points, cam, &ray, hit);
+}
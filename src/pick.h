@@ -0,0 +1,36 @@
+#ifndef _PICK__H_
+#define _PICK__H_
+
+#include <stdint.h>
+
+#include "math/vector.h"
+
+struct tcam;
+struct octree;
+
+/* half the edge of a sprite quad in view space, see size in the geometry shader */
+#define PICK_SPRITE_HALF 1.f
+
+/**
+ * A ray in world space, dir is of unit length.
+ **/
+struct pick_ray {
+    tvec3 origin;
+    tvec3 dir;
+};
+
+struct pick_hit {
+    uint32_t index;    /* of the point in points */
+    tvec3    position;
+    float    distance; /* along the ray, from the near plane */
+    uint32_t nodes;    /* octree nodes visited */
+    uint32_t tested;   /* points tested */
+};
+
+void pick_ray_from_screen(struct tcam *cam, float x, float y, struct pick_ray *ray);
+int pick_ray(const struct octree *t, const tvec4 *points, const struct tcam *cam,
+             const struct pick_ray *ray, struct pick_hit *hit);
+int pick_screen(const struct octree *t, const tvec4 *points, struct tcam *cam,
+                float x, float y, struct pick_hit *hit);
+
+#endif
@@ -0,0 +1,173 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Poster export. The camera's frustum is split into a grid of
+ * sub-frusta that are rendered one at a time into an offscreen
+ * framebuffer. Finished rows of tiles are appended to a raw temporary
+ * file, which vips then streams into the output image, so host memory
+ * stays at one row of tiles whatever the poster size.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vips/vips.h>
+
+#include "megagraph.h"
+#include "memstat.h"
+#include "offscreen.h"
+#include "poster.h"
+#include "math/camera.h"
+#include "math/matrix.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+/**
+ * Render every tile and append the rows of tiles to fp.
+ *
+ * Returns 0 on success.
+ **/
+static int
+write_tiles(FILE *fp, int width, int height, int tile_w, int tile_h,
+            const struct tcam *cam, poster_render_fn render, void *arg,
+            unsigned char *strip, unsigned char *tile)
+{
+    struct offscreen target = {0};
+    size_t stride = (size_t)width * 3;
+    int cols = (width + tile_w - 1) / tile_w;
+    int rows = (height + tile_h - 1) / tile_h;
+
+    /* the full frustum, as tmat4_perspective() would build it for the poster */
+    float top = cam->near * tanf(cam->fov * 3.141592653589793f / 360.f);
+    float right = top * (float)width / (float)height;
+
+    LOG_I("Poster:\t\t%dx%d in %dx%d tiles of %dx%d", width, height, cols, rows, tile_w, tile_h);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    for (int ty=0; ty<rows; ty++) {
+        int y0 = ty * tile_h;
+        int th = MIN(tile_h, height - y0);
+
+        for (int tx=0; tx<cols; tx++) {
+            int x0 = tx * tile_w;
+            int tw = MIN(tile_w, width - x0);
+            float projection[16];
+
+            /* image rows go down, frustum coordinates go up */
+            tmat4_frustum(projection,
+                          -right + 2.f * right * x0 / width,
+                          -right + 2.f * right * (x0 + tw) / width,
+                          top - 2.f * top * (y0 + th) / height,
+                          top - 2.f * top * y0 / height,
+                          cam->near, cam->far);
+
+            if (offscreen_resize(&target, tw, th) != 0) {
+                offscreen_free(&target);
+                return 1;
+            }
+
+            glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+            render(arg, tw, th, projection);
+
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, target.fbo);
+            glReadPixels(0, 0, tw, th, GL_RGB, GL_UNSIGNED_BYTE, tile);
+
+            for (int y=0; y<th; y++) {
+                memcpy(strip + y * stride + (size_t)x0 * 3, tile + (size_t)(th-1-y) * tw * 3, (size_t)tw * 3);
+            }
+        }
+
+        if (fwrite(strip, stride, th, fp) != (size_t)th) {
+            offscreen_free(&target);
+            return 1;
+        }
+
+        LOG_I("Poster row %d/%d", ty + 1, rows);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    offscreen_free(&target);
+
+    return 0;
+}
+
+/**
+ * Render a width x height image of the camera's view to filename, in
+ * tiles of at most tile_size pixels. The format follows the file
+ * name's extension, .tif is the better choice for very large posters.
+ *
+ * Returns 0 on success.
+ **/
+int
+poster_export(const char *filename, int width, int height, int tile_size,
+              const struct tcam *cam, poster_render_fn render, void *arg)
+{
+    GLint max_rb = 0, max_vp[2] = {0, 0};
+
+    if (!(cam->_flags & TCAM_PERSPECTIVE)) {
+        LOG_E("poster export needs a perspective camera");
+        return 1;
+    }
+
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_rb);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_vp);
+    tile_size = MIN(tile_size, MIN(max_rb, MIN(max_vp[0], max_vp[1])));
+
+    int tile_w = MIN(tile_size, width);
+    int tile_h = MIN(tile_size, height);
+
+    char tmpname[1024];
+    snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", filename);
+    int fd = mkstemp(tmpname);
+    FILE *fp = fd >= 0 ? fdopen(fd, "wb") : 0;
+
+    if (!fp) {
+        LOG_E("could not create temporary file next to %s", filename);
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmpname);
+        }
+        return 1;
+    }
+
+    size_t staging = (size_t)width * 3 * tile_h + (size_t)tile_w * tile_h * 3;
+    unsigned char *strip = malloc((size_t)width * 3 * tile_h);
+    unsigned char *tile = malloc((size_t)tile_w * tile_h * 3);
+
+    if (!strip || !tile) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+
+    mem_add(MEM_STAGING, MEM_HOST, staging);
+    int r = write_tiles(fp, width, height, tile_w, tile_h, cam, render, arg, strip, tile);
+    mem_add(MEM_STAGING, MEM_HOST, -(long long)staging);
+
+    free(strip);
+    free(tile);
+
+    if (fclose(fp) != 0 || r != 0) {
+        LOG_E("could not write %s", tmpname);
+        unlink(tmpname);
+        return 1;
+    }
+
+    VipsImage *img = 0;
+    r = 1;
+    if (vips_rawload(tmpname, &img, width, height, 3, NULL) == 0) {
+        r = vips_image_write_to_file(img, filename, NULL);
+        g_object_unref(img);
+    }
+    unlink(tmpname);
+
+    if (r != 0) {
+        LOG_E("could not write %s: %s", filename, vips_error_buffer());
+        return 1;
+    }
+
+    LOG_I("Wrote %s (%dx%d)", filename, width, height);
+
+    return 0;
+}
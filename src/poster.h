@@ -0,0 +1,15 @@
+#ifndef _POSTER__H_
+#define _POSTER__H_
+
+struct tcam;
+
+/**
+ * Called once per tile to draw the scene into the bound framebuffer,
+ * with the projection matrix replaced by the tile's sub-frustum.
+ **/
+typedef void (*poster_render_fn)(void *arg, int width, int height, const float *projection);
+
+int poster_export(const char *filename, int width, int height, int tile_size,
+                  const struct tcam *cam, poster_render_fn render, void *arg);
+
+#endif
@@ -0,0 +1,48 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Batched projection of point positions to window coordinates on the
+ * cpu, for work such as selection or export that needs to know where
+ * many points end up on screen.
+ **/
+
+#include "math/camera.h"
+#include "project.h"
+#include "worker.h"
+
+struct project_job {
+    struct tcam                *cam;
+    const struct point_streams *in;
+    struct projected           *out;
+};
+
+static void
+project_blocks(void *arg, size_t begin, size_t end)
+{
+    struct project_job *j = (struct project_job*)arg;
+    size_t first = begin * PROJECT_BLOCK;
+    size_t last = end * PROJECT_BLOCK < j->in->count ? end * PROJECT_BLOCK : j->in->count;
+
+    tcam_project_points(j->cam, j->in->x + first, j->in->y + first, j->in->z + first, last - first,
+                        j->out->sx + first, j->out->sy + first, j->out->depth + first);
+}
+
+/**
+ * Project every point of in with the camera's combined matrix, see
+ * tcam_project(). With parallel set the points are split over the
+ * worker threads in blocks of PROJECT_BLOCK points, so small inputs
+ * stay on the calling thread. The camera must be calculated.
+ **/
+void
+project_points(struct tcam *cam, const struct point_streams *in, struct projected *out, int parallel)
+{
+    struct project_job j = {cam, in, out};
+    size_t num_blocks = (in->count + PROJECT_BLOCK - 1) / PROJECT_BLOCK;
+
+    if (parallel) {
+        worker_parallel_for(num_blocks, project_blocks, &j);
+    } else if (num_blocks) {
+        project_blocks(&j, 0, num_blocks);
+    }
+}
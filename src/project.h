@@ -0,0 +1,33 @@
+#ifndef _PROJECT__H_
+#define _PROJECT__H_
+
+#include <stddef.h>
+
+struct tcam;
+
+#define PROJECT_BLOCK 16384 /* points per unit of work handed to a thread */
+
+/**
+ * Point positions as separate coordinate arrays, so that a run of
+ * points fills a vector register per coordinate.
+ **/
+struct point_streams {
+    const float *x;
+    const float *y;
+    const float *z;
+    size_t       count;
+};
+
+/**
+ * Window coordinates and depth of a point_streams, one entry per
+ * point.
+ **/
+struct projected {
+    float *sx;
+    float *sy;
+    float *depth;
+};
+
+void project_points(struct tcam *cam, const struct point_streams *in, struct projected *out, int parallel);
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Load order of the rows along a space filling curve through the
+ * bounding box of the points. Rows that are near each other in space
+ * then get neighbouring vertices and atlas slots, so the part of the
+ * data in view is a few contiguous vertex ranges in a few atlases
+ * instead of a scattering over all of them. The Hilbert curve keeps
+ * neighbours together a little better than the Morton (Z-order)
+ * curve, which jumps at the edges of every octant.
+ **/
+
+#include <stdlib.h>
+#include <float.h>
+
+#include "reorder.h"
+#include "morton.h"
+#include "worker.h"
+
+#define KEY_BLOCK 65536 /* points per unit of work while computing keys */
+
+struct keyed_row {
+    uint64_t key;
+    uint32_t row;
+};
+
+struct key_job {
+    const tvec4        *points;
+    size_t              num_points;
+    enum reorder_curve  curve;
+    tvec3               min;
+    float               scale; /* from world units to grid cells */
+    struct keyed_row   *out;
+};
+
+const char *
+reorder_name(enum reorder_curve curve)
+{
+    switch (curve) {
+        case REORDER_MORTON:  return "morton";
+        case REORDER_HILBERT: return "hilbert";
+        default:              return "none";
+    }
+}
+
+/**
+ * Position along the curve of grid cell x, y, z, each of
+ * REORDER_BITS bits. The Hilbert index is computed with Skilling's
+ * transpose, "Programming the Hilbert curve" (2004), and its bits are
+ * then interleaved like a Morton code.
+ **/
+uint64_t
+reorder_key(enum reorder_curve curve, uint32_t x, uint32_t y, uint32_t z)
+{
+    if (curve == REORDER_HILBERT) {
+        uint32_t v[3] = {x, y, z};
+        uint32_t m = 1u << (REORDER_BITS - 1);
+
+        /* undo the excess work of the inverse transform */
+        for (uint32_t q=m; q>1; q>>=1) {
+            uint32_t p = q - 1;
+            for (int i=0; i<3; i++) {
+                if (v[i] & q) {
+                    v[0] ^= p;
+                } else {
+                    uint32_t t = (v[0] ^ v[i]) & p;
+                    v[0] ^= t;
+                    v[i] ^= t;
+                }
+            }
+        }
+
+        /* gray encode */
+        v[1] ^= v[0];
+        v[2] ^= v[1];
+
+        uint32_t t = 0;
+        for (uint32_t q=m; q>1; q>>=1) {
+            if (v[2] & q) t ^= q - 1;
+        }
+        for (int i=0; i<3; i++) {
+            v[i] ^= t;
+        }
+
+        /* the first axis holds the highest bit of every level */
+        return morton_encode(v[2], v[1], v[0]);
+    }
+
+    return morton_encode(x, y, z);
+}
+
+static void
+compute_keys(void *arg, size_t begin, size_t end)
+{
+    struct key_job *j = (struct key_job*)arg;
+    size_t last = end * KEY_BLOCK < j->num_points ? end * KEY_BLOCK : j->num_points;
+    const float max = (float)((1 << REORDER_BITS) - 1);
+
+    for (size_t x=begin * KEY_BLOCK; x<last; x++) {
+        float c[3] = {
+            (j->points[x].x - j->min.x) * j->scale,
+            (j->points[x].y - j->min.y) * j->scale,
+            (j->points[x].z - j->min.z) * j->scale,
+        };
+        for (int a=0; a<3; a++) {
+            c[a] = c[a] < 0.f ? 0.f : (c[a] > max ? max : c[a]);
+        }
+
+        j->out[x].key = reorder_key(j->curve, (uint32_t)c[0], (uint32_t)c[1], (uint32_t)c[2]);
+        j->out[x].row = (uint32_t)x;
+    }
+}
+
+static int
+cmp_keyed_row(const void *a, const void *b)
+{
+    const struct keyed_row *x = (const struct keyed_row*)a, *y = (const struct keyed_row*)b;
+
+    if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    return (x->row > y->row) - (x->row < y->row);
+}
+
+/**
+ * Order the points along curve. rows gets num_points entries, the
+ * index into points of the first point along the curve, then the
+ * second and so on. Points in the same grid cell keep their order.
+ *
+ * Returns 0 on success.
+ **/
+int
+reorder_rows(const tvec4 *points, size_t num_points, enum reorder_curve curve, uint32_t *rows)
+{
+    struct keyed_row *keyed = malloc(num_points * sizeof(struct keyed_row) + 1);
+
+    if (!keyed) {
+        return 1;
+    }
+
+    tvec3 min = (tvec3){FLT_MAX, FLT_MAX, FLT_MAX};
+    float extent = 0.f;
+
+    for (size_t x=0; x<num_points; x++) {
+        if (points[x].x < min.x) min.x = points[x].x;
+        if (points[x].y < min.y) min.y = points[x].y;
+        if (points[x].z < min.z) min.z = points[x].z;
+    }
+    for (size_t x=0; x<num_points; x++) {
+        if (points[x].x - min.x > extent) extent = points[x].x - min.x;
+        if (points[x].y - min.y > extent) extent = points[x].y - min.y;
+        if (points[x].z - min.z > extent) extent = points[x].z - min.z;
+    }
+
+    /* a cube, so that cells are as wide as they are deep */
+    struct key_job j = {points, num_points, curve, min,
+                        extent > 0.f ? (float)(1 << REORDER_BITS) / extent : 0.f, keyed};
+
+    worker_parallel_for((num_points + KEY_BLOCK - 1) / KEY_BLOCK, compute_keys, &j);
+    qsort(keyed, num_points, sizeof(struct keyed_row), cmp_keyed_row);
+
+    for (size_t x=0; x<num_points; x++) {
+        rows[x] = keyed[x].row;
+    }
+
+    free(keyed);
+
+    return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef _REORDER__H_
+#define _REORDER__H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "math/vector.h"
+
+/* space filling curves the rows can be loaded along, see --reorder */
+enum reorder_curve {
+    REORDER_NONE,
+    REORDER_MORTON,
+    REORDER_HILBERT,
+};
+
+#define REORDER_BITS 21 /* grid cells per axis are 2^REORDER_BITS */
+
+const char *reorder_name(enum reorder_curve curve);
+uint64_t reorder_key(enum reorder_curve curve, uint32_t x, uint32_t y, uint32_t z);
+int reorder_rows(const tvec4 *points, size_t num_points, enum reorder_curve curve, uint32_t *rows);
+
+#endif
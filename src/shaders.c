@@ -6,19 +6,35 @@
 #include <stdio.h>
 
 #include "glad/glad.h"
+#include "compact.h"
+
+#define STR_(x) #x
+#define STR(x)  STR_(x)
 
 GLuint g_program;
 GLuint g_uniform_mv;
 GLuint g_uniform_p;
 GLuint g_uniform_tex0;
+GLuint g_uniform_tile;
+GLuint g_uniform_tint;
+GLuint g_uniform_blocks;
+GLuint g_uniform_max_lod;
+GLuint g_uniform_viewport;
+
+GLuint g_hud_program;
+GLuint g_hud_uniform_screen;
+GLuint g_hud_uniform_font;
+GLuint g_hud_uniform_color;
 
 static const char* src_fs[] = {
     "#version 330 core                      \n",
     "uniform sampler2D tex0;                \n",
+    "uniform vec4 tint; /* blended over the image by its alpha, for highlighting */ \n",
     "in vec2 uv;                            \n",
+    "flat in vec4 uvclamp; /* corners of the part of the tile that may be sampled */ \n",
     "out vec3 color;                        \n",
     "void main() {                          \n",
-    "   color = texture(tex0, uv).rgb;       \n",
+    "   color = mix(texture(tex0, clamp(uv, uvclamp.xy, uvclamp.zw)).rgb, tint.rgb, tint.a); \n",
     "}                                      \n",
     ""
 };
@@ -35,6 +51,22 @@ static const char* src_vs[] = {
     "}\n",
 };
 
+/* the same for --compact-vertices, see compact.h */
+static const char* src_vs_compact[] = {
+    "#version 330 core                      \n",
+    "layout(location = 0) in uvec4 position; /* steps from the block origin, and the slot */ \n",
+    "uniform mat4 MV;                       \n",
+    "uniform samplerBuffer blocks; /* origin and step of every block of vertices */ \n",
+    "out vec2 uvbase;                       \n",
+    "void main() {                          \n",
+    "   vec4 b = texelFetch(blocks, gl_VertexID / " STR(COMPACT_BLOCK) "); \n",
+    "   float slot = float(position.w);     \n",
+    "   vec2 u = vec2(mod(slot, 64.0), (floor(slot / 64.0)));                          \n",
+    "   uvbase = u * vec2(1.0/64.0);            \n",
+    "   gl_Position = MV*vec4(b.xyz + vec3(position.xyz) * b.w, 1.0);          \n",
+    "}\n",
+};
+
 static const char* src_gs[] = {
     "#version 330 core                      \n",
     "layout(points) in;                     \n",
@@ -47,84 +79,161 @@ static const char* src_gs[] = {
     "\n",
     "in vec2 uvbase[];                           \n",
     "out vec2 uv;                           \n",
+    "flat out vec4 uvclamp;                 \n",
     "uniform mat4 P;                        \n",
-    "const vec2 uvscale = vec2(1.0/64.0, 1.0/64.0);                  \n",
+    "uniform vec2 tile; /* gutter and image size in texture coordinates */ \n",
+    "uniform sampler2D tex0;                \n",
+    "uniform float max_lod; /* last mip level of the atlas */ \n",
+    "uniform float viewport; /* width in pixels */ \n",
     "\n",
     "void main() {                                  \n",
+    "   vec2 uvbias = uvbase[0] + vec2(tile.x);     \n",
+    "   vec2 uvscale = vec2(tile.y);                \n",
     "   vec4 pos = gl_in[0].gl_Position;                    \n",
+    "\n",
+    "   /* once the gutter is under a texel, keep the filter inside the tile \n",
+    "    * on the coarser of the two levels sampled, for a sprite this many \n",
+    "    * texels per pixel across */ \n",
+    "   float texels = tile.y * float(textureSize(tex0, 0).x); \n",
+    "   float pixels = size * P[0][0] / max((P*pos).w, 1e-6) * 0.5 * viewport; \n",
+    "   float lod = clamp(ceil(log2(texels / max(pixels, 1e-6))), 0.0, max_lod); \n",
+    "   vec2 half_texel = vec2(0.5 * exp2(lod)) / vec2(textureSize(tex0, 0)); \n",
+    "   vec4 c = vec4(uvbase[0] + half_texel, uvbase[0] + vec2(1.0/64.0) - half_texel); \n",
     "   vec2 vo = pos.xy + vec2(-0.5, -0.5) * size;   \n",
     "   gl_Position = P*vec4(vo, pos.zw);             \n",
-    "   uv = uvbase[0]+vec2(0.0, 0.0)*uvscale;                         \n",
+    "   uv = uvbias+vec2(0.0, 0.0)*uvscale;                         \n",
     //"   uv = vec2(0.0, 0.0);                         \n",
+    "   uvclamp = c;                                \n",
     "   EmitVertex();                               \n",
     "\n",
     "   vo = pos.xy + vec2(-0.5, 0.5) * size;   \n",
     "   gl_Position = P*vec4(vo, pos.zw);             \n",
-    "   uv = uvbase[0]+vec2(0.0, 1.0)*uvscale;                         \n",
+    "   uv = uvbias+vec2(0.0, 1.0)*uvscale;                         \n",
     //"   uv = vec2(0.0, 1.0);                         \n",
+    "   uvclamp = c;                                \n",
     "   EmitVertex();                               \n",
     "\n",
     "   vo = pos.xy + vec2(0.5, -0.5) * size;   \n",
     "   gl_Position = P*vec4(vo, pos.zw);             \n",
-    "   uv = uvbase[0]+vec2(1.0, 0.0)*uvscale;                         \n",
+    "   uv = uvbias+vec2(1.0, 0.0)*uvscale;                         \n",
     //"   uv = vec2(1.0, 0.0);                         \n",
+    "   uvclamp = c;                                \n",
     "   EmitVertex();                               \n",
     "\n",
     "   vo = pos.xy + vec2(0.5, 0.5) * size;   \n",
     "   gl_Position = P*vec4(vo, pos.zw);             \n",
-    "   uv = uvbase[0]+vec2(1.0, 1.0)*uvscale;                         \n",
+    "   uv = uvbias+vec2(1.0, 1.0)*uvscale;                         \n",
     //"   uv = vec2(1.0, 1.0);                         \n",
+    "   uvclamp = c;                                \n",
     "   EmitVertex();                               \n",
     "   EndPrimitive();                               \n",
     "}\n",
 };
 
-int compile_shaders() {
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    GLuint gs = glCreateShader(GL_GEOMETRY_SHADER);
+static const char* src_hud_vs[] = {
+    "#version 330 core                      \n",
+    "layout(location = 0) in vec4 vertex; /* pixel position and font texture coordinates */ \n",
+    "uniform vec2 screen;                   \n",
+    "out vec2 uv;                           \n",
+    "void main() {                          \n",
+    "   uv = vertex.zw;                     \n",
+    "   gl_Position = vec4(vertex.x / screen.x * 2.0 - 1.0, 1.0 - vertex.y / screen.y * 2.0, 0.0, 1.0); \n",
+    "}\n",
+};
+
+static const char* src_hud_fs[] = {
+    "#version 330 core                      \n",
+    "uniform sampler2D font;                \n",
+    "uniform vec4 color;                    \n",
+    "in vec2 uv;                            \n",
+    "out vec4 frag;                         \n",
+    "void main() {                          \n",
+    "   float a = uv.x < 0.0 ? 1.0 : texture(font, uv).r; /* negative uv is a solid quad */ \n",
+    "   frag = vec4(color.rgb, color.a * a); \n",
+    "}\n",
+};
+
+static int compile_shader(GLuint shader, const char **src, int count, const char *name) {
     GLint status;
     int log_length = 0;
 
-    glShaderSource(vs, sizeof(src_vs)/sizeof(char*), src_vs, 0);
-    glCompileShader(vs);
+    glShaderSource(shader, count, src, 0);
+    glCompileShader(shader);
 
-    glGetShaderiv(vs, GL_COMPILE_STATUS, &status);
-    glGetShaderiv(vs, GL_INFO_LOG_LENGTH, &log_length);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &log_length);
 
     if (status != GL_TRUE && log_length > 0) {
         char log[log_length+1];
-        glGetShaderInfoLog(vs, log_length, 0, log);
+        glGetShaderInfoLog(shader, log_length, 0, log);
         log[log_length] = '\0';
-        fprintf(stderr, "!!! Error compiling vertex shader:\n%s", log);
+        fprintf(stderr, "!!! Error compiling %s shader:\n%s", name, log);
         return 1;
     }
-    
-    glShaderSource(fs, sizeof(src_fs)/sizeof(char*), src_fs, 0);
-    glCompileShader(fs);
 
-    glGetShaderiv(fs, GL_COMPILE_STATUS, &status);
-    glGetShaderiv(fs, GL_INFO_LOG_LENGTH, &log_length);
+    return 0;
+}
+
+static int link_program(GLuint program, const char *name) {
+    GLint status;
+    int log_length = 0;
+
+    glLinkProgram(program);
+
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
 
     if (status != GL_TRUE && log_length > 0) {
         char log[log_length+1];
-        glGetShaderInfoLog(fs, log_length, 0, log);
+        glGetProgramInfoLog(program, log_length, 0, log);
         log[log_length] = '\0';
-        fprintf(stderr, "!!! Error compiling fragment shader:\n%s", log);
+        fprintf(stderr, "!!! Error linking %s shader program:\n%s", name, log);
         return 1;
     }
 
-    glShaderSource(gs, sizeof(src_gs)/sizeof(char*), src_gs, 0);
-    glCompileShader(gs);
+    return 0;
+}
 
-    glGetShaderiv(gs, GL_COMPILE_STATUS, &status);
-    glGetShaderiv(gs, GL_INFO_LOG_LENGTH, &log_length);
+/**
+ * Program for the statistics overlay, see hud.c.
+ **/
+static int compile_hud_shaders() {
+    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
 
-    if (status != GL_TRUE && log_length > 0) {
-        char log[log_length+1];
-        glGetShaderInfoLog(gs, log_length, 0, log);
-        log[log_length] = '\0';
-        fprintf(stderr, "!!! Error compiling geometry shader:\n%s", log);
+    if (compile_shader(vs, src_hud_vs, sizeof(src_hud_vs)/sizeof(char*), "hud vertex") != 0
+            || compile_shader(fs, src_hud_fs, sizeof(src_hud_fs)/sizeof(char*), "hud fragment") != 0) {
+        return 1;
+    }
+
+    g_hud_program = glCreateProgram();
+    glAttachShader(g_hud_program, vs);
+    glAttachShader(g_hud_program, fs);
+
+    if (link_program(g_hud_program, "hud") != 0) {
+        return 1;
+    }
+
+    g_hud_uniform_screen = glGetUniformLocation(g_hud_program, "screen");
+    g_hud_uniform_font = glGetUniformLocation(g_hud_program, "font");
+    g_hud_uniform_color = glGetUniformLocation(g_hud_program, "color");
+
+    return 0;
+}
+
+/**
+ * Compile the point program, reading tvec4 vertices or, if compact is
+ * set, compact_vertex ones.
+ **/
+int compile_shaders(int compact) {
+    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+    GLuint gs = glCreateShader(GL_GEOMETRY_SHADER);
+
+    if ((compact ? compile_shader(vs, src_vs_compact, sizeof(src_vs_compact)/sizeof(char*), "vertex")
+                 : compile_shader(vs, src_vs, sizeof(src_vs)/sizeof(char*), "vertex")) != 0
+            || compile_shader(fs, src_fs, sizeof(src_fs)/sizeof(char*), "fragment") != 0
+            || compile_shader(gs, src_gs, sizeof(src_gs)/sizeof(char*), "geometry") != 0) {
         return 1;
     }
 
@@ -132,23 +241,20 @@ int compile_shaders() {
     glAttachShader(g_program, vs);
     glAttachShader(g_program, fs);
     glAttachShader(g_program, gs);
-    glLinkProgram(g_program);
 
-    glGetProgramiv(g_program, GL_LINK_STATUS, &status);
-    glGetProgramiv(g_program, GL_INFO_LOG_LENGTH, &log_length);
-
-    if (status != GL_TRUE && log_length > 0) {
-        char log[log_length+1];
-        glGetProgramInfoLog(g_program, log_length, 0, log);
-        log[log_length] = '\0';
-        fprintf(stderr, "!!! Error linking shader program:\n%s", log);
+    if (link_program(g_program, "point") != 0) {
         return 1;
     }
 
     g_uniform_mv = glGetUniformLocation(g_program, "MV");
     g_uniform_p = glGetUniformLocation(g_program, "P");
     g_uniform_tex0 = glGetUniformLocation(g_program, "tex0");
+    g_uniform_tile = glGetUniformLocation(g_program, "tile");
+    g_uniform_tint = glGetUniformLocation(g_program, "tint");
+    g_uniform_blocks = glGetUniformLocation(g_program, "blocks");
+    g_uniform_max_lod = glGetUniformLocation(g_program, "max_lod");
+    g_uniform_viewport = glGetUniformLocation(g_program, "viewport");
 
-    return 0;
+    return compile_hud_shaders();
 }
 
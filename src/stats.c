@@ -0,0 +1,318 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Per-stage frame timing. CPU stages are timed with mg_time(), GPU
+ * stages with a GL_TIMESTAMP query at either end. Timestamps, unlike
+ * GL_TIME_ELAPSED queries, may be taken while another timer query is
+ * active, such as the one dynres.c wraps the whole render in, and
+ * stages may overlap. Every frame uses its own set of
+ * queries out of STATS_LATENCY, and a frame is only read back when its
+ * set comes around again, by which time the GPU is done with it, so
+ * timing never stalls the pipeline.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "megagraph.h"
+#include "stats.h"
+
+static const char *names[STAT_COUNT] = {
+    "input",
+    "cull",
+    "submit",
+    "swap",
+    "total",
+    "gpu clear",
+    "gpu draw",
+    "gpu post",
+};
+
+struct frame_slot {
+    int      used;
+    long     frame;
+    float    cpu[STAT_FIRST_GPU];
+    GLuint   queries[STAT_NUM_GPU][2]; /* timestamps at the start and the end */
+    int      issued[STAT_NUM_GPU];
+};
+
+static struct {
+    int               enabled;
+    int               gpu;
+    FILE             *csv;
+
+    long              frame;
+    struct frame_slot slots[STATS_LATENCY];
+    struct frame_slot *current;
+    double            cpu_start[STAT_FIRST_GPU];
+
+    float             window[STAT_COUNT][STATS_WINDOW];
+    int               count[STAT_COUNT];
+    int               head[STAT_COUNT];
+} stats;
+
+static void retire_slot(struct frame_slot *s);
+
+/**
+ * Enable frame timing. If csv_filename is given, one line of stage
+ * times in milliseconds is written per frame.
+ *
+ * Returns 0 on success.
+ **/
+int
+stats_init(const char *csv_filename)
+{
+    memset(&stats, 0, sizeof(stats));
+
+    if (csv_filename) {
+        if (!(stats.csv = fopen(csv_filename, "w"))) {
+            LOG_E("could not open %s", csv_filename);
+            return 1;
+        }
+
+        fprintf(stats.csv, "frame");
+        for (int x=0; x<STAT_COUNT; x++) {
+            fprintf(stats.csv, ",%s", names[x]);
+        }
+        fprintf(stats.csv, "\n");
+    }
+
+    stats.gpu = GLAD_GL_VERSION_3_3;
+    if (stats.gpu) {
+        for (int x=0; x<STATS_LATENCY; x++) {
+            glGenQueries(2 * STAT_NUM_GPU, stats.slots[x].queries[0]);
+        }
+    }
+
+    stats.enabled = 1;
+    return 0;
+}
+
+/**
+ * Flush the frames still in flight, the caller should glFinish()
+ * first so their queries are available.
+ **/
+void
+stats_shutdown(void)
+{
+    if (!stats.enabled) return;
+
+    for (long f=stats.frame-STATS_LATENCY; f<stats.frame; f++) {
+        if (f >= 0 && stats.slots[f % STATS_LATENCY].used) {
+            retire_slot(&stats.slots[f % STATS_LATENCY]);
+        }
+    }
+
+    if (stats.gpu) {
+        for (int x=0; x<STATS_LATENCY; x++) {
+            glDeleteQueries(2 * STAT_NUM_GPU, stats.slots[x].queries[0]);
+        }
+    }
+
+    if (stats.csv) {
+        fclose(stats.csv);
+        stats.csv = 0;
+    }
+    stats.enabled = 0;
+}
+
+int
+stats_enabled(void)
+{
+    return stats.enabled;
+}
+
+const char*
+stats_name(int stat)
+{
+    return names[stat];
+}
+
+static void
+push_sample(int stat, float value)
+{
+    stats.window[stat][stats.head[stat]] = value;
+    stats.head[stat] = (stats.head[stat] + 1) % STATS_WINDOW;
+    if (stats.count[stat] < STATS_WINDOW) {
+        stats.count[stat] ++;
+    }
+}
+
+/**
+ * Collect the slot's queries, add the frame to the rolling window and
+ * the csv file.
+ **/
+static void
+retire_slot(struct frame_slot *s)
+{
+    float gpu[STAT_NUM_GPU];
+
+    for (int x=0; x<STAT_NUM_GPU; x++) {
+        gpu[x] = -1.f;
+
+        if (s->issued[x] == 1) {
+            GLint available = 0;
+            glGetQueryObjectiv(s->queries[x][1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+            /* should not happen after STATS_LATENCY frames, but never wait */
+            if (available) {
+                GLuint64 start = 0, end = 0;
+                glGetQueryObjectui64v(s->queries[x][0], GL_QUERY_RESULT, &start);
+                glGetQueryObjectui64v(s->queries[x][1], GL_QUERY_RESULT, &end);
+                gpu[x] = end > start ? (float)(end - start) * 1e-6f : 0.f;
+                push_sample(STAT_FIRST_GPU + x, gpu[x]);
+            }
+        }
+    }
+
+    for (int x=0; x<STAT_FIRST_GPU; x++) {
+        if (s->cpu[x] >= 0.f) {
+            push_sample(x, s->cpu[x]);
+        }
+    }
+
+    if (stats.csv) {
+        fprintf(stats.csv, "%ld", s->frame);
+        for (int x=0; x<STAT_COUNT; x++) {
+            float v = x < STAT_FIRST_GPU ? s->cpu[x] : gpu[x - STAT_FIRST_GPU];
+            if (v >= 0.f) {
+                fprintf(stats.csv, ",%.4f", v);
+            } else {
+                fprintf(stats.csv, ",");
+            }
+        }
+        fprintf(stats.csv, "\n");
+    }
+
+    s->used = 0;
+}
+
+void
+stats_frame_begin(void)
+{
+    if (!stats.enabled) return;
+
+    struct frame_slot *s = &stats.slots[stats.frame % STATS_LATENCY];
+
+    if (s->used) {
+        retire_slot(s);
+    }
+
+    s->used = 1;
+    s->frame = stats.frame;
+    for (int x=0; x<STAT_FIRST_GPU; x++) s->cpu[x] = -1.f;
+    memset(s->issued, 0, sizeof(s->issued));
+
+    stats.current = s;
+    stats_cpu_begin(STAT_FRAME);
+}
+
+void
+stats_frame_end(void)
+{
+    if (!stats.enabled || !stats.current) return;
+
+    stats_cpu_end(STAT_FRAME);
+    stats.current = 0;
+    stats.frame ++;
+}
+
+/**
+ * Drop the frame started with stats_frame_begin(), for frames that
+ * turn out to have nothing to draw.
+ **/
+void
+stats_frame_cancel(void)
+{
+    if (!stats.enabled || !stats.current) return;
+
+    stats.current->used = 0;
+    stats.current = 0;
+}
+
+void
+stats_cpu_begin(int stat)
+{
+    if (!stats.enabled) return;
+    stats.cpu_start[stat] = mg_time();
+}
+
+/**
+ * CPU stages may be entered several times per frame, the times add up.
+ **/
+void
+stats_cpu_end(int stat)
+{
+    if (!stats.enabled || !stats.current) return;
+
+    float ms = (float)((mg_time() - stats.cpu_start[stat]) * 1000.0);
+    float *v = &stats.current->cpu[stat];
+    *v = *v < 0.f ? ms : *v + ms;
+}
+
+void
+stats_gpu_begin(int stat)
+{
+    if (!stats.enabled || !stats.gpu || !stats.current) return;
+
+    int x = stat - STAT_FIRST_GPU;
+    if (stats.current->issued[x]) {
+        return;
+    }
+
+    glQueryCounter(stats.current->queries[x][0], GL_TIMESTAMP);
+    stats.current->issued[x] = 2;
+}
+
+void
+stats_gpu_end(int stat)
+{
+    if (!stats.enabled || !stats.gpu || !stats.current) return;
+
+    int x = stat - STAT_FIRST_GPU;
+    if (stats.current->issued[x] == 2) {
+        glQueryCounter(stats.current->queries[x][1], GL_TIMESTAMP);
+        stats.current->issued[x] = 1;
+    }
+}
+
+static int
+cmp_float(const void *a, const void *b)
+{
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Minimum, average and 99th percentile of the stage over the rolling
+ * window, in milliseconds.
+ *
+ * Returns the number of frames in the window.
+ **/
+int
+stats_summary(int stat, float *min, float *avg, float *p99)
+{
+    float sorted[STATS_WINDOW];
+    int n = stats.count[stat];
+
+    *min = *avg = *p99 = 0.f;
+
+    if (n == 0) {
+        return 0;
+    }
+
+    memcpy(sorted, stats.window[stat], n * sizeof(float));
+    qsort(sorted, n, sizeof(float), cmp_float);
+
+    double sum = 0.0;
+    for (int x=0; x<n; x++) {
+        sum += sorted[x];
+    }
+
+    *min = sorted[0];
+    *avg = (float)(sum / n);
+    *p99 = sorted[(n * 99) / 100 < n ? (n * 99) / 100 : n-1];
+
+    return n;
+}
@@ -0,0 +1,43 @@
+#ifndef _STATS__H_
+#define _STATS__H_
+
+#include "glad/glad.h"
+
+enum {
+    /* cpu stages */
+    STAT_INPUT,
+    STAT_CULL,
+    STAT_SUBMIT,
+    STAT_SWAP,
+    STAT_FRAME,
+
+    /* gpu stages, measured with timer queries */
+    STAT_GPU_CLEAR,
+    STAT_GPU_DRAW,
+    STAT_GPU_POST,
+
+    STAT_COUNT
+};
+
+#define STAT_FIRST_GPU STAT_GPU_CLEAR
+#define STAT_NUM_GPU   (STAT_COUNT - STAT_FIRST_GPU)
+
+#define STATS_WINDOW   240 /* frames in the rolling window */
+#define STATS_LATENCY  3   /* frames of timer queries in flight */
+
+int stats_init(const char *csv_filename);
+void stats_shutdown(void);
+int stats_enabled(void);
+const char *stats_name(int stat);
+
+void stats_frame_begin(void);
+void stats_frame_end(void);
+void stats_frame_cancel(void);
+void stats_cpu_begin(int stat);
+void stats_cpu_end(int stat);
+void stats_gpu_begin(int stat);
+void stats_gpu_end(int stat);
+
+int stats_summary(int stat, float *min, float *avg, float *p99);
+
+#endif
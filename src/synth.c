@@ -0,0 +1,80 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Procedural thumbnails for synthetic datasets. URLs of the form
+ * gen:N are drawn in-process instead of being read and decoded, so
+ * that loading millions of rows measures the loader and not the disk.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "synth.h"
+
+int
+synth_is_url(const char *url)
+{
+    return strncmp(url, SYNTH_SCHEME, strlen(SYNTH_SCHEME)) == 0;
+}
+
+static void
+hue_to_rgb(unsigned h, unsigned char *c)
+{
+    /* h in [0, 1536), fully saturated */
+    unsigned f = h & 255;
+    switch (h >> 8) {
+        case 0: c[0] = 255;   c[1] = f;     c[2] = 0;     break;
+        case 1: c[0] = 255-f; c[1] = 255;   c[2] = 0;     break;
+        case 2: c[0] = 0;     c[1] = 255;   c[2] = f;     break;
+        case 3: c[0] = 0;     c[1] = 255-f; c[2] = 255;   break;
+        case 4: c[0] = f;     c[1] = 0;     c[2] = 255;   break;
+        default:c[0] = 255;   c[1] = 0;     c[2] = 255-f; break;
+    }
+}
+
+/**
+ * Draw the thumbnail for a gen: url as packed RGB, rows top to bottom.
+ * The pattern and colors are a function of the number in the url.
+ **/
+void
+synth_thumbnail(const char *url, unsigned char *rgb, int width, int height)
+{
+    uint64_t h = synth_hash(strtoull(url + strlen(SYNTH_SCHEME), 0, 10));
+    unsigned char fg[3], bg[3];
+
+    hue_to_rgb((unsigned)(h % 1536), fg);
+    hue_to_rgb((unsigned)((h >> 16) % 1536), bg);
+
+    /* darken the background so the two colors always differ */
+    for (int c=0; c<3; c++) {
+        bg[c] = bg[c] / 3;
+    }
+
+    int pattern = (int)((h >> 32) % 4);
+    int period = 4 + (int)((h >> 40) % 12);
+
+    for (int y=0; y<height; y++) {
+        for (int x=0; x<width; x++) {
+            int dx = 2*x - width, dy = 2*y - height;
+            int on;
+
+            switch (pattern) {
+                case 0: /* disc */
+                    on = dx*dx + dy*dy < width*height / 2;
+                    break;
+                case 1: /* stripes */
+                    on = ((x + y) / period) & 1;
+                    break;
+                case 2: /* checkers */
+                    on = ((x / period) ^ (y / period)) & 1;
+                    break;
+                default: /* rings */
+                    on = ((abs(dx) > abs(dy) ? abs(dx) : abs(dy)) / period) & 1;
+                    break;
+            }
+
+            memcpy(rgb + (y*width + x)*3, on ? fg : bg, 3);
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef _SYNTH__H_
+#define _SYNTH__H_
+
+#include <stdint.h>
+
+#define SYNTH_SCHEME "gen:"
+
+/**
+ * Deterministic random numbers shared by megagraph-gen and the
+ * thumbnail generator, so that a seed always gives the same data.
+ **/
+static inline uint64_t synth_hash(uint64_t x) {
+    /* splitmix64 */
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+int synth_is_url(const char *url);
+void synth_thumbnail(const char *url, unsigned char *rgb, int width, int height);
+
+#endif
@@ -0,0 +1,269 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * megagraph-bench-knn, times knn_build() and batched k nearest
+ * neighbour queries over random points at a few sizes, and compares a
+ * sample of the answers with a brute force search.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <argp.h>
+
+#include "synth.h"
+#include "knn.h"
+#include "worker.h"
+
+#define LOG_E(x, ...) fprintf(stderr, x "\n", ##__VA_ARGS__)
+
+#define MAX_SIZES    16
+#define NUM_CLUSTERS 64
+#define NUM_CHECKS   20 /* queries checked against brute force per size */
+
+static struct {
+    size_t sizes[MAX_SIZES];
+    int    num_sizes;
+    int    clustered;
+    int    threads;
+    int    k;
+    size_t queries;
+} arguments;
+
+/* deterministic stream of random numbers */
+struct rng {
+    uint64_t state;
+};
+
+static inline double
+rng_unit(struct rng *r)
+{
+    uint64_t x = synth_hash(r->state);
+    r->state += 0x9e3779b97f4a7c15ULL;
+    return (double)(x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double
+rng_gauss(struct rng *r)
+{
+    double u = rng_unit(r), v = rng_unit(r);
+    return sqrt(-2.0 * log(u + 1e-300)) * cos(2.0 * M_PI * v);
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void
+generate(tvec4 *points, size_t n)
+{
+    struct rng r = {synth_hash(n)};
+    float centers[NUM_CLUSTERS][3];
+
+    for (int c=0; c<NUM_CLUSTERS; c++) {
+        for (int a=0; a<3; a++) {
+            centers[c][a] = (float)(rng_unit(&r) * 2000.0 - 1000.0);
+        }
+    }
+
+    for (size_t x=0; x<n; x++) {
+        float p[3];
+        if (arguments.clustered) {
+            float *c = centers[synth_hash(x) % NUM_CLUSTERS];
+            for (int a=0; a<3; a++) p[a] = c[a] + (float)(rng_gauss(&r) * 40.0);
+        } else {
+            for (int a=0; a<3; a++) p[a] = (float)(rng_unit(&r) * 2000.0 - 1000.0);
+        }
+        points[x] = (tvec4){p[0], p[1], p[2], 0.f};
+    }
+}
+
+/**
+ * Compare the distances of the k neighbours found for query q with a
+ * scan of every point. Indices may differ between equally far points.
+ * Returns 0 if they match.
+ **/
+static int
+check(const tvec4 *points, size_t n, const tvec3 *q, uint32_t skip, int k, const float *distances)
+{
+    float best[KNN_MAX_K];
+    int num = 0;
+
+    for (size_t x=0; x<n; x++) {
+        if (x == skip) continue;
+
+        float dx = points[x].x - q->x, dy = points[x].y - q->y, dz = points[x].z - q->z;
+        float d = sqrtf(dx*dx + dy*dy + dz*dz);
+
+        if (num == k && d >= best[num-1]) continue;
+
+        int y = num < k ? num++ : num - 1;
+        for (; y > 0 && best[y-1] > d; y--) {
+            best[y] = best[y-1];
+        }
+        best[y] = d;
+    }
+
+    for (int x=0; x<k; x++) {
+        float expect = x < num ? best[x] : -1.f;
+        if (distances[x] != expect) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+const char *argp_program_version = "megagraph-bench-knn 0.9";
+const char *argp_program_bug_address = "<megagraph@teorem.se>";
+static char doc[] = "megagraph-bench-knn -- k nearest neighbour build and query rates.\v"
+    "Every query asks for the neighbours of one of the points, leaving the "
+    "point itself out, the same as --knn-dump does for every row.";
+
+static struct argp_option options[] = {
+    {"points", 'n', "N,...", 0, "Point counts to build for (default 1000000,10000000)"},
+    {"distribution", 'd', "NAME", 0, "uniform or clustered (default uniform)"},
+    {"neighbours", 'k', "K", 0, "Neighbours per query (default 10)"},
+    {"queries", 'q', "N", 0, "Queries per size (default 1000000)"},
+    {"threads", 'T', "N", 0, "Worker threads (default one per cpu)"},
+    {0}
+};
+
+static error_t
+parse_opt(int key, char *arg, struct argp_state *state)
+{
+    switch (key) {
+        case 'n':
+            arguments.num_sizes = 0;
+            for (char *s = arg; *s && arguments.num_sizes < MAX_SIZES; ) {
+                char *end;
+                arguments.sizes[arguments.num_sizes++] = strtoull(s, &end, 10);
+                if (end == s) {
+                    argp_error(state, "invalid point counts '%s'", arg);
+                }
+                s = *end == ',' ? end + 1 : end;
+            }
+            break;
+
+        case 'd':
+            if (strcmp(arg, "uniform") == 0) {
+                arguments.clustered = 0;
+            } else if (strcmp(arg, "clustered") == 0) {
+                arguments.clustered = 1;
+            } else {
+                argp_error(state, "unknown distribution '%s'", arg);
+            }
+            break;
+
+        case 'k':
+            arguments.k = atoi(arg);
+            if (arguments.k <= 0 || arguments.k > KNN_MAX_K) {
+                argp_error(state, "neighbours must be 1 to %d", KNN_MAX_K);
+            }
+            break;
+
+        case 'q':
+            arguments.queries = strtoull(arg, 0, 10);
+            break;
+
+        case 'T':
+            arguments.threads = atoi(arg);
+            break;
+
+        case ARGP_KEY_ARG:
+            argp_usage(state);
+            break;
+
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp = {options, parse_opt, 0, doc};
+
+int
+main(int argc, char *argv[])
+{
+    static const size_t default_sizes[] = {1000000, 10000000};
+
+    memcpy(arguments.sizes, default_sizes, sizeof(default_sizes));
+    arguments.num_sizes = 2;
+    arguments.k = 10;
+    arguments.queries = 1000000;
+
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    if (arguments.threads > 0) {
+        worker_set_num_threads(arguments.threads);
+    }
+
+    printf("%12s %8s %4s %10s %12s %12s %10s\n",
+           "points", "threads", "k", "build s", "queries", "queries/s", "mismatch");
+
+    int failed = 0;
+
+    for (int i=0; i<arguments.num_sizes; i++) {
+        size_t n = arguments.sizes[i];
+        size_t nq = arguments.queries;
+        int k = arguments.k;
+        tvec4 *points = malloc(n * sizeof(tvec4));
+        tvec3 *queries = malloc(nq * sizeof(tvec3));
+        uint32_t *skip = malloc(nq * sizeof(uint32_t));
+        uint32_t *indices = malloc(nq * k * sizeof(uint32_t));
+        float *distances = malloc(nq * k * sizeof(float));
+        struct knn t;
+
+        if (!points || !queries || !skip || !indices || !distances || n == 0) {
+            LOG_E("out of mem for %zu points", n);
+            return 1;
+        }
+
+        generate(points, n);
+
+        /* spread the queried points over the whole array */
+        for (size_t x=0; x<nq; x++) {
+            skip[x] = (uint32_t)(synth_hash(x) % n);
+            queries[x] = tvec3f(points[skip[x]].x, points[skip[x]].y, points[skip[x]].z);
+        }
+
+        double start = now();
+        if (knn_build(&t, points, n) != 0) {
+            LOG_E("out of mem building %zu points", n);
+            return 1;
+        }
+        double build = now() - start;
+
+        start = now();
+        knn_query_batch(&t, queries, skip, nq, k, indices, distances);
+        double query = now() - start;
+
+        int mismatch = 0;
+        for (size_t x=0; x<NUM_CHECKS && x<nq; x++) {
+            size_t q = x * (nq / NUM_CHECKS);
+            mismatch += check(points, n, &queries[q], skip[q], k, distances + q * k);
+        }
+        failed |= mismatch;
+
+        printf("%12zu %8d %4d %10.3f %12zu %12.0f %10d\n",
+               n, worker_num_threads(), k, build, nq, nq / query, mismatch);
+        fflush(stdout);
+
+        knn_free(&t);
+        free(points);
+        free(queries);
+        free(skip);
+        free(indices);
+        free(distances);
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,803 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * megagraph-bench-math, times the kernels in src/math and measures
+ * their error against libm, or against double precision versions for
+ * the matrix functions. Every kernel is a row in a table of
+ * name/variant pairs, the libm rows give the baseline the fast-math
+ * rows have to beat, and vectorized variants are added as rows of
+ * their own. The SSE and AVX matrix rows run the same public
+ * functions with another variant selected, and every output they give
+ * is also compared bit for bit with the scalar variant.
+ *
+ * The batched projection is also timed over a few million points with
+ * each variant and a growing number of worker threads, and reported in
+ * points per second.
+ **/
+
+#define _GNU_SOURCE /* sincosf */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <argp.h>
+
+#include "synth.h"
+#include "math/misc.h"
+#include "math/matrix.h"
+#include "math/simd.h"
+#include "math/camera.h"
+#include "project.h"
+#include "worker.h"
+
+#ifndef TMS_FAST_MATH
+#error "bench_math.c must be built with -DTMS_FAST_MATH"
+#endif
+
+#define LOG_I(x, ...) fprintf(stderr, x "\n", ##__VA_ARGS__)
+#define LOG_E(x, ...) fprintf(stderr, x "\n", ##__VA_ARGS__)
+
+#define BATCH      1024 /* operations per call, small enough to stay in cache */
+#define MAX_IN     32   /* floats of input per operation */
+#define MAX_OUT    16   /* floats of output per operation */
+#define NUM_SAMPLE 65536 /* operations checked for error */
+#define NO_SIMD    -1    /* the kernel does not go through tmath_active */
+
+static struct {
+    double      time;
+    const char *filter;
+    int         json;
+    size_t      points;
+    int         threads;
+} arguments;
+
+/* the camera the projection kernels use */
+static struct tcam camera;
+
+/* deterministic stream of random numbers */
+struct rng {
+    uint64_t state;
+};
+
+static inline float
+rng_range(struct rng *r, float min, float max)
+{
+    uint64_t x = synth_hash(r->state);
+    r->state += 0x9e3779b97f4a7c15ULL;
+    return min + (max - min) * (float)((double)(x >> 11) * (1.0 / 9007199254740992.0));
+}
+
+static inline float
+rng_log(struct rng *r, float min, float max)
+{
+    return expf(rng_range(r, logf(min), logf(max)));
+}
+
+/**
+ * A kernel runs n operations with inputs and outputs of a fixed
+ * number of floats each. ref computes the exact answer of one
+ * operation in double precision, and gen makes one random input.
+ **/
+struct kernel {
+    const char *name;
+    const char *variant;
+    int         num_in;
+    int         num_out;
+    int         relative; /* error relative to the size of the answer */
+    int         simd;     /* TMATH_SCALAR etc. to select before running, or NO_SIMD */
+    void      (*run)(float *out, const float *in, int n);
+    void      (*ref)(double *out, const float *in);
+    void      (*gen)(float *in, struct rng *r);
+};
+
+/* inputs */
+
+static void
+gen_angle(float *in, struct rng *r)
+{
+    in[0] = rng_range(r, -2.f * M_PI, 2.f * M_PI);
+}
+
+static void
+gen_atan2(float *in, struct rng *r)
+{
+    in[0] = rng_range(r, -10.f, 10.f);
+    in[1] = rng_range(r, -10.f, 10.f);
+}
+
+static void
+gen_sqrt(float *in, struct rng *r)
+{
+    in[0] = rng_log(r, 1e-4f, 1e4f);
+}
+
+static void
+gen_pow(float *in, struct rng *r)
+{
+    in[0] = rng_log(r, 1e-2f, 1e2f);
+    in[1] = rng_range(r, -2.f, 2.f);
+}
+
+static void
+gen_mat4(float *in, struct rng *r)
+{
+    /* diagonally dominant, so that it is well conditioned */
+    for (int x=0; x<16; x++) {
+        in[x] = rng_range(r, -1.f, 1.f) + (x % 5 == 0 ? 4.f : 0.f);
+    }
+}
+
+static void
+gen_mat4_pair(float *in, struct rng *r)
+{
+    gen_mat4(in, r);
+    gen_mat4(in + 16, r);
+}
+
+static void
+gen_lookat(float *in, struct rng *r)
+{
+    for (int x=0; x<6; x++) {
+        in[x] = rng_range(r, -100.f, 100.f);
+    }
+    in[6] = 0.f;
+    in[7] = 1.f;
+    in[8] = 0.f;
+}
+
+static void
+gen_vec4_mat4(float *in, struct rng *r)
+{
+    for (int x=0; x<4; x++) {
+        in[x] = rng_range(r, -100.f, 100.f);
+    }
+    gen_mat4(in + 4, r);
+}
+
+static void
+gen_point(float *in, struct rng *r)
+{
+    for (int x=0; x<3; x++) {
+        in[x] = rng_range(r, -20.f, 20.f);
+    }
+}
+
+/* references */
+
+static void ref_sin(double *out, const float *in) { out[0] = sin(in[0]); }
+static void ref_sincos(double *out, const float *in) { out[0] = sin(in[0]); out[1] = cos(in[0]); }
+static void ref_atan2(double *out, const float *in) { out[0] = atan2(in[0], in[1]); }
+static void ref_sqrt(double *out, const float *in) { out[0] = sqrt(in[0]); }
+static void ref_pow(double *out, const float *in) { out[0] = pow(in[0], in[1]); }
+
+static void
+ref_multiply(double *out, const float *in)
+{
+    for (int c=0; c<4; c++) {
+        for (int r=0; r<4; r++) {
+            double s = 0.0;
+            for (int k=0; k<4; k++) {
+                s += (double)in[k*4 + r] * (double)in[16 + c*4 + k];
+            }
+            out[c*4 + r] = s;
+        }
+    }
+}
+
+static void
+ref_invert(double *out, const float *in)
+{
+    /* gauss-jordan with partial pivoting on a row-major copy */
+    double a[4][8];
+
+    for (int r=0; r<4; r++) {
+        for (int c=0; c<4; c++) {
+            a[r][c] = in[c*4 + r];
+            a[r][c+4] = r == c;
+        }
+    }
+
+    for (int c=0; c<4; c++) {
+        int p = c;
+        for (int r=c+1; r<4; r++) {
+            if (fabs(a[r][c]) > fabs(a[p][c])) p = r;
+        }
+        for (int k=0; k<8; k++) {
+            double t = a[c][k]; a[c][k] = a[p][k]; a[p][k] = t;
+        }
+
+        double d = a[c][c];
+        for (int k=0; k<8; k++) a[c][k] /= d;
+
+        for (int r=0; r<4; r++) {
+            if (r == c) continue;
+            double f = a[r][c];
+            for (int k=0; k<8; k++) a[r][k] -= f * a[c][k];
+        }
+    }
+
+    for (int r=0; r<4; r++) {
+        for (int c=0; c<4; c++) {
+            out[c*4 + r] = a[r][c+4];
+        }
+    }
+}
+
+static void
+ref_lookat(double *out, const float *in)
+{
+    double f[3] = {in[3] - in[0], in[4] - in[1], in[5] - in[2]};
+    double u[3] = {in[6], in[7], in[8]};
+    double s[3];
+
+    double l = sqrt(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+    for (int x=0; x<3; x++) f[x] /= l;
+
+    s[0] = f[1]*u[2] - f[2]*u[1];
+    s[1] = f[2]*u[0] - f[0]*u[2];
+    s[2] = f[0]*u[1] - f[1]*u[0];
+    l = sqrt(s[0]*s[0] + s[1]*s[1] + s[2]*s[2]);
+    for (int x=0; x<3; x++) s[x] /= l;
+
+    u[0] = s[1]*f[2] - s[2]*f[1];
+    u[1] = s[2]*f[0] - s[0]*f[2];
+    u[2] = s[0]*f[1] - s[1]*f[0];
+
+    memset(out, 0, 16 * sizeof(double));
+    for (int x=0; x<3; x++) {
+        out[x*4 + 0] = s[x];
+        out[x*4 + 1] = u[x];
+        out[x*4 + 2] = -f[x];
+        out[12 + 0] -= s[x] * in[x];
+        out[12 + 1] -= u[x] * in[x];
+        out[12 + 2] += f[x] * in[x];
+    }
+    out[15] = 1.0;
+}
+
+static void
+ref_vec4_mat4(double *out, const float *in)
+{
+    const float *m = in + 4;
+    for (int r=0; r<4; r++) {
+        out[r] = (double)in[0]*m[r] + (double)in[1]*m[4+r]
+               + (double)in[2]*m[8+r] + (double)in[3]*m[12+r];
+    }
+}
+
+static void
+ref_project(double *out, const float *in)
+{
+    const float *m = camera.combined;
+    double v[4];
+
+    for (int r=0; r<4; r++) {
+        v[r] = (double)in[0]*m[r] + (double)in[1]*m[4+r] + (double)in[2]*m[8+r] + m[12+r];
+    }
+
+    out[0] = camera.width * (v[0] / v[3] + 1.0) / 2.0;
+    out[1] = camera.height * (v[1] / v[3] + 1.0) / 2.0;
+    out[2] = (v[2] / v[3] + 1.0) / 2.0;
+}
+
+/* scalar fast-math */
+
+static void
+run_sin(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) out[x] = tmath_sin(in[x]);
+}
+
+static void
+run_sincos(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) tmath_sincos(in[x], &out[x*2], &out[x*2+1]);
+}
+
+static void
+run_atan2(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) out[x] = tmath_atan2(in[x*2], in[x*2+1]);
+}
+
+static void
+run_sqrt(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) out[x] = tmath_sqrt(in[x]);
+}
+
+static void
+run_pow(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) out[x] = tmath_pow(in[x*2], in[x*2+1]);
+}
+
+/* libm */
+
+static void
+run_sinf(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) out[x] = sinf(in[x]);
+}
+
+static void
+run_sincosf(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) sincosf(in[x], &out[x*2], &out[x*2+1]);
+}
+
+static void
+run_atan2f(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) out[x] = atan2f(in[x*2], in[x*2+1]);
+}
+
+static void
+run_sqrtf(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) out[x] = sqrtf(in[x]);
+}
+
+static void
+run_powf(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) out[x] = powf(in[x*2], in[x*2+1]);
+}
+
+/* arrays, interleaved arguments and results are split and merged around the call */
+
+static float lane_a[BATCH], lane_b[BATCH];
+
+static void
+run_sin_n(float *out, const float *in, int n)
+{
+    tmath_sin_n(out, in, n);
+}
+
+static void
+run_sincos_n(float *out, const float *in, int n)
+{
+    tmath_sincos_n(lane_a, lane_b, in, n);
+    for (int x=0; x<n; x++) {
+        out[x*2] = lane_a[x];
+        out[x*2+1] = lane_b[x];
+    }
+}
+
+static void
+run_atan2_n(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) {
+        lane_a[x] = in[x*2];
+        lane_b[x] = in[x*2+1];
+    }
+    tmath_atan2_n(out, lane_a, lane_b, n);
+}
+
+static void
+run_sqrt_n(float *out, const float *in, int n)
+{
+    tmath_sqrt_n(out, in, n);
+}
+
+static void
+run_pow_n(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) {
+        lane_a[x] = in[x*2];
+        lane_b[x] = in[x*2+1];
+    }
+    tmath_pow_n(out, lane_a, lane_b, n);
+}
+
+/* matrices, the functions work in place so the copy is part of the cost */
+
+static void
+run_multiply(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) {
+        memcpy(out + x*16, in + x*32, TMAT4_SIZE);
+        tmat4_multiply(out + x*16, (float*)in + x*32 + 16);
+    }
+}
+
+static void
+run_invert(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) {
+        memcpy(out + x*16, in + x*16, TMAT4_SIZE);
+        tmat4_invert(out + x*16);
+    }
+}
+
+static void
+run_lookat(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) {
+        const float *a = in + x*9;
+        tmat4_lookat(out + x*16, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8]);
+    }
+}
+
+static void
+run_vec4_mat4(float *out, const float *in, int n)
+{
+    for (int x=0; x<n; x++) {
+        memcpy(out + x*4, in + x*20, sizeof(tvec4));
+        tvec4_mul_mat4((tvec4*)(out + x*4), (float*)in + x*20 + 4);
+    }
+}
+
+/* points arrive interleaved, so the cost includes splitting them into streams */
+static void
+run_project(float *out, const float *in, int n)
+{
+    static float x[BATCH], y[BATCH], z[BATCH], sx[BATCH], sy[BATCH], depth[BATCH];
+
+    for (int i=0; i<n; i++) {
+        x[i] = in[i*3];
+        y[i] = in[i*3+1];
+        z[i] = in[i*3+2];
+    }
+
+    tcam_project_points(&camera, x, y, z, n, sx, sy, depth);
+
+    for (int i=0; i<n; i++) {
+        out[i*3] = sx[i];
+        out[i*3+1] = sy[i];
+        out[i*3+2] = depth[i];
+    }
+}
+
+static const struct kernel kernels[] = {
+    {"sin",            "scalar", 1,  1,  0, NO_SIMD,      run_sin,       ref_sin,       gen_angle},
+    {"sin",            "libm",   1,  1,  0, NO_SIMD,      run_sinf,      ref_sin,       gen_angle},
+    {"sin",            "sse",    1,  1,  0, TMATH_SSE,    run_sin_n,     ref_sin,       gen_angle},
+    {"sin",            "avx2",   1,  1,  0, TMATH_AVX2,   run_sin_n,     ref_sin,       gen_angle},
+    {"sin",            "avx512", 1,  1,  0, TMATH_AVX512, run_sin_n,     ref_sin,       gen_angle},
+    {"sincos",         "scalar", 1,  2,  0, NO_SIMD,      run_sincos,    ref_sincos,    gen_angle},
+    {"sincos",         "libm",   1,  2,  0, NO_SIMD,      run_sincosf,   ref_sincos,    gen_angle},
+    {"sincos",         "sse",    1,  2,  0, TMATH_SSE,    run_sincos_n,  ref_sincos,    gen_angle},
+    {"sincos",         "avx2",   1,  2,  0, TMATH_AVX2,   run_sincos_n,  ref_sincos,    gen_angle},
+    {"sincos",         "avx512", 1,  2,  0, TMATH_AVX512, run_sincos_n,  ref_sincos,    gen_angle},
+    {"atan2",          "scalar", 2,  1,  0, NO_SIMD,      run_atan2,     ref_atan2,     gen_atan2},
+    {"atan2",          "libm",   2,  1,  0, NO_SIMD,      run_atan2f,    ref_atan2,     gen_atan2},
+    {"atan2",          "sse",    2,  1,  0, TMATH_SSE,    run_atan2_n,   ref_atan2,     gen_atan2},
+    {"atan2",          "avx2",   2,  1,  0, TMATH_AVX2,   run_atan2_n,   ref_atan2,     gen_atan2},
+    {"atan2",          "avx512", 2,  1,  0, TMATH_AVX512, run_atan2_n,   ref_atan2,     gen_atan2},
+    {"sqrt",           "scalar", 1,  1,  1, NO_SIMD,      run_sqrt,      ref_sqrt,      gen_sqrt},
+    {"sqrt",           "libm",   1,  1,  1, NO_SIMD,      run_sqrtf,     ref_sqrt,      gen_sqrt},
+    {"sqrt",           "sse",    1,  1,  1, TMATH_SSE,    run_sqrt_n,    ref_sqrt,      gen_sqrt},
+    {"sqrt",           "avx2",   1,  1,  1, TMATH_AVX2,   run_sqrt_n,    ref_sqrt,      gen_sqrt},
+    {"sqrt",           "avx512", 1,  1,  1, TMATH_AVX512, run_sqrt_n,    ref_sqrt,      gen_sqrt},
+    {"pow",            "scalar", 2,  1,  1, NO_SIMD,      run_pow,       ref_pow,       gen_pow},
+    {"pow",            "libm",   2,  1,  1, NO_SIMD,      run_powf,      ref_pow,       gen_pow},
+    {"pow",            "sse",    2,  1,  1, TMATH_SSE,    run_pow_n,     ref_pow,       gen_pow},
+    {"pow",            "avx2",   2,  1,  1, TMATH_AVX2,   run_pow_n,     ref_pow,       gen_pow},
+    {"pow",            "avx512", 2,  1,  1, TMATH_AVX512, run_pow_n,     ref_pow,       gen_pow},
+    {"tmat4_multiply", "scalar", 32, 16, 0, TMATH_SCALAR, run_multiply,  ref_multiply,  gen_mat4_pair},
+    {"tmat4_multiply", "sse",    32, 16, 0, TMATH_SSE,    run_multiply,  ref_multiply,  gen_mat4_pair},
+    {"tmat4_multiply", "avx",    32, 16, 0, TMATH_AVX,    run_multiply,  ref_multiply,  gen_mat4_pair},
+    {"tmat4_invert",   "scalar", 16, 16, 0, TMATH_SCALAR, run_invert,    ref_invert,    gen_mat4},
+    {"tmat4_invert",   "sse",    16, 16, 0, TMATH_SSE,    run_invert,    ref_invert,    gen_mat4},
+    {"tmat4_lookat",   "scalar", 9,  16, 0, TMATH_SCALAR, run_lookat,    ref_lookat,    gen_lookat},
+    {"tmat4_lookat",   "sse",    9,  16, 0, TMATH_SSE,    run_lookat,    ref_lookat,    gen_lookat},
+    {"tmat4_lookat",   "avx",    9,  16, 0, TMATH_AVX,    run_lookat,    ref_lookat,    gen_lookat},
+    {"tvec4_mul_mat4", "scalar", 20, 4,  0, TMATH_SCALAR, run_vec4_mat4, ref_vec4_mat4, gen_vec4_mat4},
+    {"tvec4_mul_mat4", "sse",    20, 4,  0, TMATH_SSE,    run_vec4_mat4, ref_vec4_mat4, gen_vec4_mat4},
+    {"project_points", "scalar", 3,  3,  0, TMATH_SCALAR, run_project,   ref_project,   gen_point},
+    {"project_points", "sse",    3,  3,  0, TMATH_SSE,    run_project,   ref_project,   gen_point},
+    {"project_points", "avx",    3,  3,  0, TMATH_AVX,    run_project,   ref_project,   gen_point},
+};
+
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+struct result {
+    double ns;
+    double max_error;
+    double avg_error;
+    long long mismatches; /* outputs that differ in any bit from the scalar variant */
+};
+
+static double
+now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static volatile float sink;
+
+/**
+ * Time the kernel over one batch of inputs until at least
+ * arguments.time seconds have passed, then check its error over
+ * NUM_SAMPLE operations. The kernel's variant must be selected, and
+ * for a vector variant the scalar one is run on the same inputs into
+ * scalar to count mismatching outputs.
+ **/
+static void
+measure(const struct kernel *k, float *in, float *out, float *scalar, struct result *res)
+{
+    struct rng r = {synth_hash(0x6d617468ULL)};
+    double ref[MAX_OUT];
+
+    for (int x=0; x<BATCH; x++) {
+        k->gen(in + x * k->num_in, &r);
+    }
+
+    k->run(out, in, BATCH);
+
+    long long ops = 0;
+    double start = now(), elapsed;
+    do {
+        for (int x=0; x<16; x++) {
+            k->run(out, in, BATCH);
+        }
+        ops += 16 * BATCH;
+    } while ((elapsed = now() - start) < arguments.time);
+
+    sink = out[0];
+    res->ns = elapsed * 1e9 / (double)ops;
+
+    double sum = 0.0, max = 0.0;
+    long long n = 0;
+
+    res->mismatches = 0;
+
+    for (int b=0; b<NUM_SAMPLE/BATCH; b++) {
+        for (int x=0; x<BATCH; x++) {
+            k->gen(in + x * k->num_in, &r);
+        }
+        k->run(out, in, BATCH);
+
+        if (k->simd > TMATH_SCALAR) {
+            tmath_select(TMATH_SCALAR);
+            k->run(scalar, in, BATCH);
+            tmath_select(k->simd);
+
+            for (int x=0; x<BATCH * k->num_out; x++) {
+                res->mismatches += memcmp(&out[x], &scalar[x], sizeof(float)) != 0;
+            }
+        }
+
+        for (int x=0; x<BATCH; x++) {
+            k->ref(ref, in + x * k->num_in);
+            for (int o=0; o<k->num_out; o++) {
+                double e = fabs((double)out[x * k->num_out + o] - ref[o]);
+                if (k->relative && ref[o] != 0.0) {
+                    e /= fabs(ref[o]);
+                }
+                if (e > max || isnan(e)) max = e;
+                sum += e;
+                n ++;
+            }
+        }
+    }
+
+    res->max_error = max;
+    res->avg_error = sum / (double)n;
+}
+
+static const int variants[] = {TMATH_SCALAR, TMATH_SSE, TMATH_AVX};
+
+/**
+ * Time project_points() over arguments.points points with every
+ * variant and 1, 2, 4 and so on up to arguments.threads threads.
+ **/
+static void
+measure_throughput(int *first)
+{
+    size_t n = arguments.points;
+    float *buf = malloc(6 * n * sizeof(float));
+
+    if (!buf) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+
+    struct rng r = {synth_hash(0x70726f6aULL)};
+    for (size_t i=0; i<n; i++) {
+        buf[i] = rng_range(&r, -20.f, 20.f);
+        buf[n + i] = rng_range(&r, -20.f, 20.f);
+        buf[2*n + i] = rng_range(&r, -20.f, 20.f);
+    }
+
+    struct point_streams in = {buf, buf + n, buf + 2*n, n};
+    struct projected out = {buf + 3*n, buf + 4*n, buf + 5*n};
+
+    if (!arguments.json) {
+        printf("\n%-16s %-8s %10s %12s\n", "kernel", "variant", "threads", "Mpoints/s");
+    }
+
+    for (size_t v=0; v<sizeof(variants)/sizeof(variants[0]); v++) {
+        if (tmath_select(variants[v]) != 0) {
+            continue;
+        }
+
+        for (int t=1; ; t = t*2 < arguments.threads ? t*2 : arguments.threads) {
+            worker_set_num_threads(t);
+            project_points(&camera, &in, &out, 1);
+
+            long long passes = 0;
+            double start = now(), elapsed;
+            do {
+                project_points(&camera, &in, &out, 1);
+                passes ++;
+            } while ((elapsed = now() - start) < arguments.time);
+
+            sink = out.sx[n / 2];
+            double rate = (double)passes * (double)n / elapsed;
+            const char *name = tmath_kernels(variants[v])->name;
+
+            if (arguments.json) {
+                printf("%s\n  \"project_points/%s/%d\": {\"points_per_sec\": %.0f}",
+                       *first ? "" : ",", name, t, rate);
+            } else {
+                printf("%-16s %-8s %10d %12.1f\n", "project_points", name, t, rate * 1e-6);
+            }
+            *first = 0;
+
+            if (t == arguments.threads) {
+                break;
+            }
+        }
+    }
+
+    free(buf);
+}
+
+const char *argp_program_version = "megagraph-bench-math 0.9";
+const char *argp_program_bug_address = "<megagraph@teorem.se>";
+static char doc[] = "megagraph-bench-math -- speed and accuracy of the src/math kernels.\v"
+    "Errors are absolute, except for sqrt and pow where they are relative "
+    "to the answer. The reference is libm in double precision for the "
+    "fast-math functions and a double precision version of the same "
+    "computation for the matrix functions. Mismatches count the outputs of "
+    "a vector variant that are not bit-identical to the scalar variant, any "
+    "mismatch makes the exit status 1. Variants the cpu lacks are skipped. "
+    "Projection errors are in pixels, for a 1280x720 viewport.";
+
+static struct argp_option options[] = {
+    {"time", 't', "SECONDS", 0, "Time spent timing each kernel (default 0.2)"},
+    {"kernel", 'k', "NAME", 0, "Only run kernels whose name starts with NAME"},
+    {"json", 'j', 0, 0, "Print the results as JSON"},
+    {"points", 'n', "N", 0, "Points projected per pass in the throughput test (default 4194304)"},
+    {"threads", 'T', "N", 0, "Most worker threads used in the throughput test (default one per cpu)"},
+    {0}
+};
+
+static error_t
+parse_opt(int key, char *arg, struct argp_state *state)
+{
+    switch (key) {
+        case 't':
+            arguments.time = atof(arg);
+            break;
+
+        case 'k':
+            arguments.filter = arg;
+            break;
+
+        case 'j':
+            arguments.json = 1;
+            break;
+
+        case 'n':
+            arguments.points = strtoull(arg, 0, 10);
+            break;
+
+        case 'T':
+            arguments.threads = atoi(arg);
+            break;
+
+        case ARGP_KEY_ARG:
+            argp_usage(state);
+            break;
+
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp = {options, parse_opt, 0, doc};
+
+int
+main(int argc, char *argv[])
+{
+    arguments.time = 0.2;
+    arguments.points = 4194304;
+
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    if (arguments.threads < 1) {
+        arguments.threads = worker_num_threads();
+    }
+
+    tcam_init(&camera);
+    camera.width = 1280.f;
+    camera.height = 720.f;
+    tcam_enable(&camera, TCAM_PERSPECTIVE);
+    tcam_set_position(&camera, 30.f, 20.f, -60.f);
+    tcam_set_lookat(&camera, 0.f, 0.f, 0.f);
+    tcam_enable(&camera, TCAM_LOOKAT);
+    tcam_calculate(&camera);
+
+    float *in = malloc(BATCH * MAX_IN * sizeof(float));
+    float *out = malloc(BATCH * MAX_OUT * sizeof(float));
+    float *scalar = malloc(BATCH * MAX_OUT * sizeof(float));
+
+    if (!in || !out || !scalar) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+
+    if (arguments.json) {
+        printf("{");
+    } else {
+        printf("%-16s %-8s %10s %12s %12s %10s\n", "kernel", "variant", "ns/op", "max error", "avg error", "mismatch");
+    }
+
+    int first = 1, selected = tmath_selected();
+    long long mismatches = 0;
+    for (size_t x=0; x<NUM_KERNELS; x++) {
+        const struct kernel *k = &kernels[x];
+        struct result res;
+
+        if (arguments.filter && strncmp(k->name, arguments.filter, strlen(arguments.filter)) != 0) {
+            continue;
+        }
+
+        if (k->simd != NO_SIMD && tmath_select(k->simd) != 0) {
+            if (!arguments.json) {
+                printf("%-16s %-8s %10s\n", k->name, k->variant, "n/a");
+            }
+            continue;
+        }
+
+        measure(k, in, out, scalar, &res);
+        mismatches += res.mismatches;
+
+        if (arguments.json) {
+            printf("%s\n  \"%s/%s\": {\"ns_per_op\": %.3f, \"max_error\": %.3e, \"avg_error\": %.3e",
+                   first ? "" : ",", k->name, k->variant, res.ns, res.max_error, res.avg_error);
+            if (k->simd > TMATH_SCALAR) {
+                printf(", \"mismatches\": %lld", res.mismatches);
+            }
+            printf("}");
+        } else if (k->simd > TMATH_SCALAR) {
+            printf("%-16s %-8s %10.2f %12.3e %12.3e %10lld\n",
+                   k->name, k->variant, res.ns, res.max_error, res.avg_error, res.mismatches);
+        } else {
+            printf("%-16s %-8s %10.2f %12.3e %12.3e\n",
+                   k->name, k->variant, res.ns, res.max_error, res.avg_error);
+        }
+        first = 0;
+    }
+
+    if (arguments.points > 0 && (!arguments.filter || strncmp("project_points", arguments.filter, strlen(arguments.filter)) == 0)) {
+        measure_throughput(&first);
+    }
+
+    tmath_select(selected);
+
+    if (arguments.json) {
+        printf("\n}\n");
+    }
+
+    free(in);
+    free(out);
+    free(scalar);
+
+    if (mismatches) {
+        LOG_E("%lld outputs of vector variants differ from the scalar variant", mismatches);
+        return 1;
+    }
+
+    return 0;
+}
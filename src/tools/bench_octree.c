@@ -0,0 +1,213 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * megagraph-bench-octree, times octree_build() over random points at
+ * a few sizes, and writing and reading back the octree cache that
+ * warm starts use instead of building.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <argp.h>
+
+#include "synth.h"
+#include "octree.h"
+#include "worker.h"
+
+#define LOG_E(x, ...) fprintf(stderr, x "\n", ##__VA_ARGS__)
+
+#define MAX_SIZES    16
+#define NUM_CLUSTERS 64
+#define PER_TEXTURE  4096 /* sprites per atlas with the default image and texture sizes */
+
+static struct {
+    size_t      sizes[MAX_SIZES];
+    int         num_sizes;
+    int         clustered;
+    int         threads;
+    const char *cache;
+} arguments;
+
+/* deterministic stream of random numbers */
+struct rng {
+    uint64_t state;
+};
+
+static inline double
+rng_unit(struct rng *r)
+{
+    uint64_t x = synth_hash(r->state);
+    r->state += 0x9e3779b97f4a7c15ULL;
+    return (double)(x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double
+rng_gauss(struct rng *r)
+{
+    double u = rng_unit(r), v = rng_unit(r);
+    return sqrt(-2.0 * log(u + 1e-300)) * cos(2.0 * M_PI * v);
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void
+generate(tvec4 *points, size_t n)
+{
+    struct rng r = {synth_hash(n)};
+    float centers[NUM_CLUSTERS][3];
+
+    for (int c=0; c<NUM_CLUSTERS; c++) {
+        for (int a=0; a<3; a++) {
+            centers[c][a] = (float)(rng_unit(&r) * 2000.0 - 1000.0);
+        }
+    }
+
+    for (size_t x=0; x<n; x++) {
+        float p[3];
+        if (arguments.clustered) {
+            float *c = centers[synth_hash(x) % NUM_CLUSTERS];
+            for (int a=0; a<3; a++) p[a] = c[a] + (float)(rng_gauss(&r) * 40.0);
+        } else {
+            for (int a=0; a<3; a++) p[a] = (float)(rng_unit(&r) * 2000.0 - 1000.0);
+        }
+        points[x] = (tvec4){p[0], p[1], p[2], (float)(x % PER_TEXTURE)};
+    }
+}
+
+const char *argp_program_version = "megagraph-bench-octree 0.9";
+const char *argp_program_bug_address = "<megagraph@teorem.se>";
+static char doc[] = "megagraph-bench-octree -- octree build and cache times.\v"
+    "Every size needs about 32 bytes of memory per point while building, "
+    "so 100M points need a little over 3 GB.";
+
+static struct argp_option options[] = {
+    {"points", 'n', "N,...", 0, "Point counts to build for (default 1000000,10000000,100000000)"},
+    {"distribution", 'd', "NAME", 0, "uniform or clustered (default uniform)"},
+    {"threads", 'T', "N", 0, "Worker threads (default one per cpu)"},
+    {"cache", 'c', "FILE", 0, "Where to write the cache while timing it (default megagraph-bench.octree)"},
+    {0}
+};
+
+static error_t
+parse_opt(int key, char *arg, struct argp_state *state)
+{
+    switch (key) {
+        case 'n':
+            arguments.num_sizes = 0;
+            for (char *s = arg; *s && arguments.num_sizes < MAX_SIZES; ) {
+                char *end;
+                arguments.sizes[arguments.num_sizes++] = strtoull(s, &end, 10);
+                if (end == s) {
+                    argp_error(state, "invalid point counts '%s'", arg);
+                }
+                s = *end == ',' ? end + 1 : end;
+            }
+            break;
+
+        case 'd':
+            if (strcmp(arg, "uniform") == 0) {
+                arguments.clustered = 0;
+            } else if (strcmp(arg, "clustered") == 0) {
+                arguments.clustered = 1;
+            } else {
+                argp_error(state, "unknown distribution '%s'", arg);
+            }
+            break;
+
+        case 'T':
+            arguments.threads = atoi(arg);
+            break;
+
+        case 'c':
+            arguments.cache = arg;
+            break;
+
+        case ARGP_KEY_ARG:
+            argp_usage(state);
+            break;
+
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp = {options, parse_opt, 0, doc};
+
+int
+main(int argc, char *argv[])
+{
+    static const size_t default_sizes[] = {1000000, 10000000, 100000000};
+
+    memcpy(arguments.sizes, default_sizes, sizeof(default_sizes));
+    arguments.num_sizes = 3;
+    arguments.cache = "megagraph-bench.octree";
+
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    if (arguments.threads > 0) {
+        worker_set_num_threads(arguments.threads);
+    }
+
+    printf("%12s %8s %10s %10s %10s %12s %10s\n",
+           "points", "threads", "build s", "save s", "load s", "Mpoints/s", "nodes");
+
+    for (int i=0; i<arguments.num_sizes; i++) {
+        size_t n = arguments.sizes[i];
+        tvec4 *points = malloc(n * sizeof(tvec4));
+        struct octree t, l;
+
+        if (!points) {
+            LOG_E("out of mem for %zu points", n);
+            return 1;
+        }
+
+        generate(points, n);
+
+        double start = now();
+        if (octree_build(&t, points, n, PER_TEXTURE) != 0) {
+            LOG_E("out of mem building %zu points", n);
+            return 1;
+        }
+        double build = now() - start;
+
+        start = now();
+        if (octree_save(&t, arguments.cache, points, n, PER_TEXTURE) != 0) {
+            LOG_E("could not write %s", arguments.cache);
+            return 1;
+        }
+        double save = now() - start;
+        size_t num_nodes = t.num_nodes;
+
+        octree_free(&t);
+
+        start = now();
+        if (octree_load(&l, arguments.cache, points, n, PER_TEXTURE) != 0) {
+            LOG_E("could not read %s", arguments.cache);
+            return 1;
+        }
+        double load = now() - start;
+
+        printf("%12zu %8d %10.3f %10.3f %10.3f %12.2f %10zu\n",
+               n, worker_num_threads(), build, save, load, n / build * 1e-6, num_nodes);
+        fflush(stdout);
+
+        unlink(arguments.cache);
+        octree_free(&l);
+        free(points);
+    }
+
+    return 0;
+}
@@ -0,0 +1,324 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * megagraph-gen, writes synthetic manifests for scale testing. Rows
+ * have the same layout as hand-made manifests, three coordinates and
+ * a url, where the url defaults to the in-process gen: scheme so that
+ * no image files are needed. The same arguments and seed always give
+ * the same file.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <argp.h>
+
+#include "synth.h"
+
+#define LOG_I(x, ...) fprintf(stderr, x "\n", ##__VA_ARGS__)
+#define LOG_E(x, ...) fprintf(stderr, x "\n", ##__VA_ARGS__)
+
+#define FILAMENT_POINTS 64 /* control points per filament */
+
+enum {
+    DIST_UNIFORM,
+    DIST_CLUSTERED,
+    DIST_FILAMENT,
+};
+
+static const char *dist_names[] = {"uniform", "clustered", "filament"};
+
+static struct {
+    unsigned long long rows;
+    int                dist;
+    unsigned long long seed;
+    double             extent;
+    int                groups;
+    const char        *url;
+    const char        *output;
+} arguments;
+
+/* deterministic stream of random numbers */
+struct rng {
+    uint64_t state;
+};
+
+static inline double
+rng_uniform(struct rng *r)
+{
+    uint64_t x = synth_hash(r->state);
+    r->state += 0x9e3779b97f4a7c15ULL;
+    return (double)(x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline double
+rng_range(struct rng *r, double min, double max)
+{
+    return min + (max - min) * rng_uniform(r);
+}
+
+static inline double
+rng_gauss(struct rng *r)
+{
+    /* box-muller, the second value is thrown away to keep the stream simple */
+    double u = rng_uniform(r);
+    double v = rng_uniform(r);
+    return sqrt(-2.0 * log(u > 1e-300 ? u : 1e-300)) * cos(2.0 * M_PI * v);
+}
+
+const char *argp_program_version = "megagraph-gen 0.9";
+const char *argp_program_bug_address = "<megagraph@teorem.se>";
+static char doc[] = "megagraph-gen -- synthetic MegaGraph manifests.\v"
+    "Distributions are uniform (a cube), clustered (gaussian blobs of "
+    "varying size and weight) and filament (points scattered along random "
+    "curves). Coordinates are within -EXTENT to EXTENT.";
+
+static struct argp_option options[] = {
+    {"rows", 'n', "N", 0, "Number of rows (default 1000)"},
+    {"distribution", 'd', "NAME", 0, "uniform, clustered or filament (default clustered)"},
+    {"seed", 'S', "SEED", 0, "Random seed (default 1)"},
+    {"extent", 'e', "EXTENT", 0, "Half the edge length of the volume (default 1000)"},
+    {"groups", 'g', "N", 0, "Number of clusters or filaments (default 64)"},
+    {"url", 'u', "PREFIX", 0, "Url prefix, the row number is appended (default gen:)"},
+    {"output", 'o', "FILE", 0, "Write to FILE instead of stdout"},
+    {0}
+};
+
+static error_t
+parse_opt(int key, char *arg, struct argp_state *state)
+{
+    switch (key) {
+        case 'n':
+            arguments.rows = strtoull(arg, 0, 10);
+            break;
+
+        case 'd':
+            for (arguments.dist=0; arguments.dist<3; arguments.dist++) {
+                if (strcmp(arg, dist_names[arguments.dist]) == 0) {
+                    break;
+                }
+            }
+            if (arguments.dist == 3) {
+                argp_error(state, "unknown distribution '%s'", arg);
+            }
+            break;
+
+        case 'S':
+            arguments.seed = strtoull(arg, 0, 10);
+            break;
+
+        case 'e':
+            arguments.extent = atof(arg);
+            break;
+
+        case 'g':
+            arguments.groups = atoi(arg);
+            if (arguments.groups < 1) {
+                argp_error(state, "need at least one group");
+            }
+            break;
+
+        case 'u':
+            arguments.url = arg;
+            break;
+
+        case 'o':
+            arguments.output = arg;
+            break;
+
+        case ARGP_KEY_ARG:
+            argp_usage(state);
+            break;
+
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp = {options, parse_opt, 0, doc};
+
+struct cluster {
+    double center[3];
+    double sigma;
+    double weight; /* cumulative, for picking a cluster */
+};
+
+static struct cluster*
+make_clusters(struct rng *r, int n, double extent)
+{
+    struct cluster *c = malloc(n * sizeof(struct cluster));
+    double total = 0.0;
+
+    if (!c) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+
+    for (int x=0; x<n; x++) {
+        for (int a=0; a<3; a++) {
+            c[x].center[a] = rng_range(r, -extent * 0.8, extent * 0.8);
+        }
+        /* a few big clusters and many small ones */
+        c[x].sigma = extent * 0.15 * pow(rng_uniform(r), 2.0) + extent * 0.005;
+        total += pow(rng_uniform(r), 3.0) + 0.01;
+        c[x].weight = total;
+    }
+
+    for (int x=0; x<n; x++) {
+        c[x].weight /= total;
+    }
+
+    return c;
+}
+
+/* reflect v back into [-extent, extent], for steps shorter than the volume */
+static double
+fold(double v, double extent)
+{
+    if (v > extent) return 2.0 * extent - v;
+    if (v < -extent) return -2.0 * extent - v;
+    return v;
+}
+
+static double*
+make_filaments(struct rng *r, int n, double extent)
+{
+    double *f = malloc(n * FILAMENT_POINTS * 3 * sizeof(double));
+
+    if (!f) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+
+    double step = extent * 2.0 / FILAMENT_POINTS;
+
+    for (int x=0; x<n; x++) {
+        double *p = f + x * FILAMENT_POINTS * 3;
+        double dir[3] = {rng_gauss(r), rng_gauss(r), rng_gauss(r)};
+
+        for (int a=0; a<3; a++) {
+            p[a] = rng_range(r, -extent * 0.5, extent * 0.5);
+        }
+
+        /* a random walk with momentum, folded back into the volume */
+        for (int k=1; k<FILAMENT_POINTS; k++) {
+            double len = 0.0;
+            for (int a=0; a<3; a++) {
+                dir[a] = dir[a] * 0.8 + rng_gauss(r) * 0.4;
+                len += dir[a] * dir[a];
+            }
+            len = sqrt(len) + 1e-9;
+
+            for (int a=0; a<3; a++) {
+                double v = p[(k-1)*3+a] + dir[a] / len * step;
+                if (v > extent || v < -extent) {
+                    /* bounce, and keep heading away from the wall */
+                    dir[a] = -dir[a];
+                    v = fold(v, extent);
+                }
+                p[k*3+a] = v;
+            }
+        }
+    }
+
+    return f;
+}
+
+int
+main(int argc, char *argv[])
+{
+    arguments.rows = 1000;
+    arguments.dist = DIST_CLUSTERED;
+    arguments.seed = 1;
+    arguments.extent = 1000.0;
+    arguments.groups = 64;
+    arguments.url = SYNTH_SCHEME;
+
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    FILE *fp = stdout;
+    if (arguments.output && !(fp = fopen(arguments.output, "w"))) {
+        LOG_E("could not open %s", arguments.output);
+        return 1;
+    }
+
+    /* shapes and points come from separate streams, so that the
+     * shapes do not depend on the number of rows */
+    struct rng shapes = {synth_hash(arguments.seed)};
+    struct rng points = {synth_hash(arguments.seed ^ 0x5bd1e995ULL)};
+
+    double extent = arguments.extent;
+    struct cluster *clusters = 0;
+    double *filaments = 0;
+
+    if (arguments.dist == DIST_CLUSTERED) {
+        clusters = make_clusters(&shapes, arguments.groups, extent);
+    } else if (arguments.dist == DIST_FILAMENT) {
+        filaments = make_filaments(&shapes, arguments.groups, extent);
+    }
+
+    for (unsigned long long row=0; row<arguments.rows; row++) {
+        double p[3];
+
+        switch (arguments.dist) {
+            case DIST_UNIFORM:
+                for (int a=0; a<3; a++) {
+                    p[a] = rng_range(&points, -extent, extent);
+                }
+                break;
+
+            case DIST_CLUSTERED: {
+                double u = rng_uniform(&points);
+                int lo = 0, hi = arguments.groups - 1;
+                while (lo < hi) {
+                    int mid = (lo + hi) / 2;
+                    if (clusters[mid].weight < u) lo = mid + 1; else hi = mid;
+                }
+                for (int a=0; a<3; a++) {
+                    p[a] = clusters[lo].center[a] + rng_gauss(&points) * clusters[lo].sigma;
+                }
+                break;
+            }
+
+            case DIST_FILAMENT: {
+                int f = (int)(rng_uniform(&points) * arguments.groups);
+                double t = rng_uniform(&points) * (FILAMENT_POINTS - 1);
+                int k = (int)t;
+                if (k >= FILAMENT_POINTS - 1) k = FILAMENT_POINTS - 2;
+                t -= k;
+
+                const double *c = filaments + (f * FILAMENT_POINTS + k) * 3;
+                for (int a=0; a<3; a++) {
+                    p[a] = c[a] + (c[a+3] - c[a]) * t + rng_gauss(&points) * extent * 0.005;
+                }
+                break;
+            }
+        }
+
+        /* the few points that spill over are mirrored rather than
+         * clamped, which would stack them on the faces of the volume */
+        for (int a=0; a<3; a++) {
+            p[a] = fold(p[a], extent);
+            if (p[a] > extent) p[a] = extent;
+            if (p[a] < -extent) p[a] = -extent;
+        }
+
+        fprintf(fp, "%15.7e %15.7e %15.7e\t%s%llu\n", p[0], p[1], p[2], arguments.url, row);
+    }
+
+    free(clusters);
+    free(filaments);
+
+    if (fp != stdout && fclose(fp) != 0) {
+        LOG_E("could not write %s", arguments.output);
+        return 1;
+    }
+
+    LOG_I("Wrote %llu %s rows", arguments.rows, dist_names[arguments.dist]);
+
+    return 0;
+}
@@ -0,0 +1,476 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * megagraph-perf-check, compares benchmark results against a stored
+ * baseline. Results are JSON files as written by --load-json,
+ * --bench-json and megagraph-bench-math --json, each given a name on
+ * the command line. A metric is addressed by that name followed by
+ * the keys leading to a number, joined with dots, for example
+ * render.frame_ms.p50. The baseline has the form
+ *
+ *   {
+ *     "tolerance": 0.25,
+ *     "metrics": {
+ *       "render.frame_ms.p50": {"value": 5.1, "tolerance": 0.5},
+ *       "render.points.avg": {"value": 5000, "better": "equal", "tolerance": 0}
+ *     }
+ *   }
+ *
+ * where tolerance is relative and better is lower (the default),
+ * higher or equal. A baseline may also name the "machine" it was
+ * recorded on, and when --machine names another one only the metrics
+ * that must be equal are checked, as timings from elsewhere mean
+ * nothing here. A metric with a null value has not been recorded
+ * yet, it fails the check until --update records it, so that a
+ * benchmark that stopped producing a metric cannot pass unnoticed.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <argp.h>
+
+#define LOG_I(x, ...) fprintf(stderr, x "\n", ##__VA_ARGS__)
+#define LOG_E(x, ...) fprintf(stderr, x "\n", ##__VA_ARGS__)
+
+#define MAX_RESULTS 32
+
+enum {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+};
+
+struct json {
+    int           type;
+    double        number;
+    char         *string;
+    char         *key;      /* set for members of an object */
+    struct json  *children;
+    struct json  *next;
+};
+
+static struct {
+    const char *baseline;
+    const char *update;
+    const char *machine;
+    const char *names[MAX_RESULTS];
+    const char *files[MAX_RESULTS];
+    int         num_results;
+} arguments;
+
+/* results, flattened to name/value pairs */
+static struct metric {
+    char   *name;
+    double  value;
+} *metrics;
+static size_t num_metrics, cap_metrics;
+
+static void*
+xmalloc(size_t size)
+{
+    void *p = calloc(1, size);
+    if (!p) {
+        LOG_E("out of mem");
+        exit(1);
+    }
+    return p;
+}
+
+static void
+skip_space(const char **p)
+{
+    while (isspace((unsigned char)**p)) (*p)++;
+}
+
+static char*
+parse_string(const char **p)
+{
+    const char *s = ++(*p);
+    char *out = xmalloc(strlen(s) + 1), *o = out;
+
+    while (**p && **p != '"') {
+        if (**p == '\\' && (*p)[1]) {
+            (*p)++;
+            switch (**p) {
+                case 'n': *o++ = '\n'; break;
+                case 't': *o++ = '\t'; break;
+                default:  *o++ = **p; break; /* \uXXXX is not needed for our keys */
+            }
+        } else {
+            *o++ = **p;
+        }
+        (*p)++;
+    }
+
+    if (**p != '"') {
+        free(out);
+        return 0;
+    }
+    (*p)++;
+    *o = 0;
+
+    return out;
+}
+
+/**
+ * Parse one value, returns 0 on a syntax error.
+ **/
+static struct json*
+parse_value(const char **p)
+{
+    struct json *v = xmalloc(sizeof(struct json));
+
+    skip_space(p);
+
+    if (**p == '{' || **p == '[') {
+        int object = **p == '{';
+        char close = object ? '}' : ']';
+        struct json **tail = &v->children;
+
+        v->type = object ? JSON_OBJECT : JSON_ARRAY;
+        (*p)++;
+        skip_space(p);
+
+        while (**p != close) {
+            char *key = 0;
+
+            if (object) {
+                if (**p != '"' || !(key = parse_string(p))) return 0;
+                skip_space(p);
+                if (**p != ':') return 0;
+                (*p)++;
+            }
+
+            struct json *c = parse_value(p);
+            if (!c) return 0;
+            c->key = key;
+            *tail = c;
+            tail = &c->next;
+
+            skip_space(p);
+            if (**p == ',') {
+                (*p)++;
+                skip_space(p);
+            } else if (**p != close) {
+                return 0;
+            }
+        }
+        (*p)++;
+    } else if (**p == '"') {
+        v->type = JSON_STRING;
+        if (!(v->string = parse_string(p))) return 0;
+    } else if (strncmp(*p, "null", 4) == 0) {
+        v->type = JSON_NULL;
+        *p += 4;
+    } else if (strncmp(*p, "true", 4) == 0 || strncmp(*p, "false", 5) == 0) {
+        v->type = JSON_BOOL;
+        v->number = **p == 't';
+        *p += v->number ? 4 : 5;
+    } else {
+        char *end;
+        v->type = JSON_NUMBER;
+        v->number = strtod(*p, &end);
+        if (end == *p) return 0;
+        *p = end;
+    }
+
+    return v;
+}
+
+static struct json*
+load_json(const char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        LOG_E("could not open %s", filename);
+        return 0;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+
+    char *text = xmalloc(size + 1);
+    size_t n = fread(text, 1, size, fp);
+    text[n] = 0;
+    fclose(fp);
+
+    const char *p = text;
+    struct json *v = parse_value(&p);
+    if (v) {
+        skip_space(&p);
+    }
+    if (!v || *p) {
+        LOG_E("%s: invalid json near offset %ld", filename, (long)(p - text));
+        v = 0;
+    }
+
+    free(text); /* the tree holds copies of its strings */
+    return v;
+}
+
+static struct json*
+member(const struct json *o, const char *key)
+{
+    for (struct json *c = o ? o->children : 0; c; c = c->next) {
+        if (c->key && strcmp(c->key, key) == 0) {
+            return c;
+        }
+    }
+    return 0;
+}
+
+static void
+add_metric(const char *name, double value)
+{
+    if (num_metrics == cap_metrics) {
+        cap_metrics = cap_metrics ? cap_metrics * 2 : 256;
+        metrics = realloc(metrics, cap_metrics * sizeof(struct metric));
+        if (!metrics) {
+            LOG_E("out of mem");
+            exit(1);
+        }
+    }
+
+    metrics[num_metrics].name = strdup(name);
+    metrics[num_metrics].value = value;
+    num_metrics ++;
+}
+
+static void
+flatten(const struct json *v, char *path, size_t len, size_t size)
+{
+    if (v->type == JSON_NUMBER) {
+        add_metric(path, v->number);
+        return;
+    }
+
+    int index = 0;
+    for (struct json *c = v->children; c; c = c->next, index++) {
+        int n = c->key ? snprintf(path + len, size - len, ".%s", c->key)
+                       : snprintf(path + len, size - len, ".%d", index);
+        if (n > 0 && len + n < size) {
+            flatten(c, path, len + n, size);
+        }
+        path[len] = 0;
+    }
+}
+
+static const struct metric*
+find_metric(const char *name)
+{
+    for (size_t x=0; x<num_metrics; x++) {
+        if (strcmp(metrics[x].name, name) == 0) {
+            return &metrics[x];
+        }
+    }
+    return 0;
+}
+
+static void
+write_number(FILE *fp, double v)
+{
+    if (v == floor(v) && fabs(v) < 1e15) {
+        fprintf(fp, "%.0f", v);
+    } else {
+        fprintf(fp, "%.6g", v);
+    }
+}
+
+const char *argp_program_version = "megagraph-perf-check 0.9";
+const char *argp_program_bug_address = "<megagraph@teorem.se>";
+static char doc[] = "megagraph-perf-check -- compare benchmark results against a baseline.\v"
+    "Exits with status 1 if a metric regressed by more than its tolerance, "
+    "is missing from the results or has no baseline value. With --update, "
+    "exits with status 1 if the new baseline would lack a value.";
+static char args_doc[] = "BASELINE NAME=RESULTS.json...";
+
+static struct argp_option options[] = {
+    {"update", 'u', "FILE", 0, "Write a baseline with the current values and the tolerances of BASELINE to FILE"},
+    {"machine", 'm', "NAME", 0, "Name of this machine, timings are only checked against a baseline recorded on the same one"},
+    {0}
+};
+
+static error_t
+parse_opt(int key, char *arg, struct argp_state *state)
+{
+    switch (key) {
+        case 'u':
+            arguments.update = arg;
+            break;
+
+        case 'm':
+            arguments.machine = arg;
+            break;
+
+        case ARGP_KEY_ARG:
+            if (state->arg_num == 0) {
+                arguments.baseline = arg;
+            } else {
+                char *eq = strchr(arg, '=');
+                if (!eq || eq == arg) {
+                    argp_error(state, "expected NAME=FILE, got '%s'", arg);
+                }
+                if (arguments.num_results == MAX_RESULTS) {
+                    argp_error(state, "too many result files");
+                }
+                *eq = 0;
+                arguments.names[arguments.num_results] = arg;
+                arguments.files[arguments.num_results] = eq + 1;
+                arguments.num_results ++;
+            }
+            break;
+
+        case ARGP_KEY_END:
+            if (state->arg_num < 2) {
+                argp_usage(state);
+            }
+            break;
+
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+
+    return 0;
+}
+
+static struct argp argp = {options, parse_opt, args_doc, doc};
+
+int
+main(int argc, char *argv[])
+{
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    for (int x=0; x<arguments.num_results; x++) {
+        char path[1024];
+        struct json *r = load_json(arguments.files[x]);
+        if (!r) {
+            return 1;
+        }
+        snprintf(path, sizeof(path), "%s", arguments.names[x]);
+        flatten(r, path, strlen(path), sizeof(path));
+    }
+
+    struct json *baseline = load_json(arguments.baseline);
+    struct json *list = member(baseline, "metrics");
+    if (!baseline || !list || list->type != JSON_OBJECT) {
+        LOG_E("%s: no metrics", arguments.baseline);
+        return 1;
+    }
+
+    struct json *t = member(baseline, "tolerance");
+    double default_tolerance = t && t->type == JSON_NUMBER ? t->number : 0.25;
+
+    struct json *machine = member(baseline, "machine");
+    int same_machine = !arguments.machine
+                       || (machine && machine->type == JSON_STRING && strcmp(machine->string, arguments.machine) == 0);
+    if (!same_machine) {
+        LOG_I("%s was recorded on %s, not checking timings on %s, run make perf-baseline to record them here",
+              arguments.baseline, machine && machine->type == JSON_STRING ? machine->string : "another machine",
+              arguments.machine);
+    }
+
+    FILE *out = 0;
+    if (arguments.update) {
+        if (!(out = fopen(arguments.update, "w"))) {
+            LOG_E("could not open %s", arguments.update);
+            return 1;
+        }
+        fprintf(out, "{\n");
+        if (arguments.machine) {
+            fprintf(out, "  \"machine\": \"");
+            for (const char *c = arguments.machine; *c; c++) {
+                if (*c != '"' && *c != '\\' && (unsigned char)*c >= ' ') fputc(*c, out);
+            }
+            fprintf(out, "\",\n");
+        }
+        fprintf(out, "  \"tolerance\": ");
+        write_number(out, default_tolerance);
+        fprintf(out, ",\n  \"metrics\": {");
+    }
+
+    int failed = 0, checked = 0, unset = 0;
+
+    printf("%-40s %12s %12s %8s  %s\n", "metric", "baseline", "current", "change", "status");
+
+    for (struct json *m = list->children; m; m = m->next) {
+        struct json *value = member(m, "value");
+        struct json *tol = member(m, "tolerance");
+        struct json *better = member(m, "better");
+        const struct metric *cur = find_metric(m->key);
+
+        double tolerance = tol && tol->type == JSON_NUMBER ? tol->number : default_tolerance;
+        const char *direction = better && better->type == JSON_STRING ? better->string : "lower";
+        const char *status;
+        double change = 0.0;
+
+        if (!cur) {
+            /* also written as null by --update */
+            status = "MISSING";
+            failed ++;
+            unset ++;
+        } else if (!value || value->type != JSON_NUMBER) {
+            status = out ? "recorded" : "UNSET";
+            unset += !out;
+        } else if (!same_machine && strcmp(direction, "equal") != 0) {
+            status = "skipped";
+        } else {
+            double base = value->number;
+            change = base != 0.0 ? (cur->value - base) / fabs(base) : (cur->value != 0.0 ? INFINITY : 0.0);
+
+            int worse, better_than;
+            if (strcmp(direction, "higher") == 0) {
+                worse = change < -tolerance;
+                better_than = change > tolerance;
+            } else if (strcmp(direction, "equal") == 0) {
+                worse = fabs(change) > tolerance;
+                better_than = 0;
+            } else {
+                worse = change > tolerance;
+                better_than = change < -tolerance;
+            }
+
+            status = worse ? "REGRESSED" : (better_than ? "improved" : "ok");
+            failed += worse;
+            checked ++;
+        }
+
+        printf("%-40s ", m->key);
+        if (value && value->type == JSON_NUMBER) printf("%12.4g ", value->number); else printf("%12s ", "-");
+        if (cur) printf("%12.4g ", cur->value); else printf("%12s ", "-");
+        if (cur && value && value->type == JSON_NUMBER) printf("%+7.1f%%  ", change * 100.0); else printf("%8s  ", "");
+        printf("%s\n", status);
+
+        if (out) {
+            fprintf(out, "%s\n    \"%s\": {\"value\": ", m == list->children ? "" : ",", m->key);
+            if (cur) write_number(out, cur->value); else fprintf(out, "null");
+            if (tol && tol->type == JSON_NUMBER) {
+                fprintf(out, ", \"tolerance\": ");
+                write_number(out, tol->number);
+            }
+            if (better && better->type == JSON_STRING) {
+                fprintf(out, ", \"better\": \"%s\"", better->string);
+            }
+            fprintf(out, "}");
+        }
+    }
+
+    if (out) {
+        fprintf(out, "\n  }\n}\n");
+        fclose(out);
+        LOG_I("Wrote %s", arguments.update);
+    }
+
+    printf("%d metrics checked, %d failed, %d without a baseline\n", checked, failed, unset);
+
+    /* a new baseline is written to replace regressions, not to report
+     * them, but it must have a value for every metric */
+    return (failed && !out) || unset ? 1 : 0;
+}
@@ -0,0 +1,201 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ *
+ * Trace events in the Chrome trace event format, which Perfetto and
+ * chrome://tracing open directly. Every thread records into a ring
+ * buffer of its own, so recording takes no locks. The rings are read
+ * when the trace is written, after the other threads have finished.
+ **/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "trace.h"
+
+struct event {
+    const char *name;
+    uint64_t    start;
+    uint64_t    end;
+};
+
+struct ring {
+    struct ring  *next;
+    int           tid;
+    int           owned; /* a live thread records into the ring */
+    const char   *name;
+    uint64_t      head;  /* number of events ever recorded */
+    struct event  events[TRACE_RING_SIZE];
+};
+
+int trace_on = 0;
+
+static FILE          *trace_fp;
+static const char    *trace_filename;
+static uint64_t       trace_start;
+static struct ring   *rings;
+static int            num_rings;
+static pthread_key_t  ring_key;
+
+static __thread struct ring *ring;
+
+uint64_t
+trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void
+release_ring(void *p)
+{
+    struct ring *r = (struct ring*)p;
+    __atomic_store_n(&r->owned, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Worker threads only live for one parallel loop, so a thread takes
+ * over the ring of one that has exited before a new one is made. A
+ * ring therefore shows up as one track per concurrent thread rather
+ * than one per thread ever started.
+ **/
+static struct ring*
+acquire_ring(void)
+{
+    for (struct ring *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&r->owned, &expected, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            pthread_setspecific(ring_key, r);
+            return r;
+        }
+    }
+
+    struct ring *r = (struct ring*)calloc(1, sizeof(struct ring));
+    if (!r) {
+        return 0;
+    }
+
+    r->owned = 1;
+    r->name = "thread";
+    r->tid = __atomic_add_fetch(&num_rings, 1, __ATOMIC_RELAXED);
+    r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    pthread_setspecific(ring_key, r);
+    return r;
+}
+
+/**
+ * Start recording, the trace is written to filename by trace_close().
+ *
+ * Returns 0 on success.
+ **/
+int
+trace_open(const char *filename)
+{
+    if (!(trace_fp = fopen(filename, "w"))) {
+        LOG_E("could not open %s", filename);
+        return 1;
+    }
+
+    if (pthread_key_create(&ring_key, release_ring) != 0) {
+        fclose(trace_fp);
+        trace_fp = 0;
+        return 1;
+    }
+
+    trace_filename = filename;
+    trace_start = trace_now();
+    trace_on = 1;
+
+    return 0;
+}
+
+/**
+ * Name the track of the calling thread.
+ **/
+void
+trace_thread_name(const char *name)
+{
+    if (trace_on && (ring || (ring = acquire_ring()))) {
+        ring->name = name;
+    }
+}
+
+void
+trace_event(const char *name, uint64_t start, uint64_t end)
+{
+    if (!ring && !(ring = acquire_ring())) {
+        return;
+    }
+
+    uint64_t h = ring->head;
+    struct event *e = &ring->events[h % TRACE_RING_SIZE];
+    e->name = name;
+    e->start = start;
+    e->end = end;
+    __atomic_store_n(&ring->head, h + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Stop recording and write the trace. Must be called when no other
+ * thread is recording.
+ **/
+void
+trace_close(void)
+{
+    if (!trace_fp) {
+        return;
+    }
+
+    trace_on = 0;
+
+    FILE *fp = trace_fp;
+    uint64_t written = 0, dropped = 0;
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(fp, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"%s\"}}", MG_NAME);
+
+    for (struct ring *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r; r = r->next) {
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+        fprintf(fp, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                "\"args\": {\"name\": \"%s %d\"}}", r->tid, r->name, r->tid);
+        fprintf(fp, ",\n  {\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                "\"args\": {\"sort_index\": %d}}", r->tid, r->tid);
+
+        for (uint64_t x=first; x<head; x++) {
+            struct event *e = &r->events[x % TRACE_RING_SIZE];
+            fprintf(fp, ",\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                    "\"ts\": %.3f, \"dur\": %.3f}",
+                    e->name, r->tid, (e->start - trace_start) / 1e3, (e->end - e->start) / 1e3);
+        }
+
+        written += head - first;
+        dropped += first;
+    }
+
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    LOG_I("Trace:\t\t%llu events written to %s, %llu overwritten",
+          (unsigned long long)written, trace_filename, (unsigned long long)dropped);
+
+    struct ring *r = rings;
+    while (r) {
+        struct ring *next = r->next;
+        free(r);
+        r = next;
+    }
+
+    rings = 0;
+    ring = 0;
+    pthread_setspecific(ring_key, 0);
+    trace_fp = 0;
+}
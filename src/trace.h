@@ -0,0 +1,54 @@
+#ifndef _TRACE__H_
+#define _TRACE__H_
+
+#include <stdint.h>
+
+#define TRACE_RING_SIZE 65536 /* events kept per thread, the oldest are overwritten */
+
+/**
+ * An open trace event. name must outlive the trace, in practice it is
+ * always a string literal.
+ **/
+struct trace_scope {
+    const char *name;
+    uint64_t    start;
+};
+
+extern int trace_on;
+
+int trace_open(const char *filename);
+void trace_close(void);
+void trace_thread_name(const char *name);
+uint64_t trace_now(void);
+void trace_event(const char *name, uint64_t start, uint64_t end);
+
+static inline struct trace_scope
+trace_begin(const char *name)
+{
+    struct trace_scope s = {0, 0};
+    if (trace_on) {
+        s.name = name;
+        s.start = trace_now();
+    }
+    return s;
+}
+
+static inline void
+trace_end(struct trace_scope *s)
+{
+    if (s->name) {
+        trace_event(s->name, s->start, trace_now());
+    }
+}
+
+#define TRACE_CAT_(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT_(a, b)
+
+/**
+ * Record an event from here to the end of the enclosing block.
+ **/
+#define TRACE_SCOPE(name) \
+    struct trace_scope TRACE_CAT(trace_scope_, __LINE__) \
+        __attribute__((cleanup(trace_end))) = trace_begin(name)
+
+#endif
@@ -0,0 +1,130 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ **/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "view.h"
+#include "math/camera.h"
+
+/**
+ * Parse a camera specification, either "ANGLE,DIST" to orbit the
+ * origin, "ANGLE,DIST,LX,LY,LZ" to orbit another point, or
+ * "EX,EY,EZ,LX,LY,LZ" for an eye position and lookat point.
+ *
+ * Returns 0 on success.
+ **/
+int
+view_parse(struct view *v, const char *spec)
+{
+    float f[6];
+    int n = sscanf(spec, "%f,%f,%f,%f,%f,%f", &f[0], &f[1], &f[2], &f[3], &f[4], &f[5]);
+
+    memset(v, 0, sizeof(struct view));
+
+    switch (n) {
+        case 2:
+            v->angle = f[0];
+            v->dist = f[1];
+            return 0;
+
+        case 5:
+            v->angle = f[0];
+            v->dist = f[1];
+            v->lookat = (tvec3){f[2], f[3], f[4]};
+            return 0;
+
+        case 6:
+            v->eye = (tvec3){f[0], f[1], f[2]};
+            v->lookat = (tvec3){f[3], f[4], f[5]};
+            v->has_eye = 1;
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Format the view as a specification accepted by view_parse().
+ *
+ * Returns the length of the string, like snprintf().
+ **/
+int
+view_format(const struct view *v, char *buf, size_t size)
+{
+    if (v->has_eye) {
+        return snprintf(buf, size, "%.6g,%.6g,%.6g,%.6g,%.6g,%.6g",
+                        v->eye.x, v->eye.y, v->eye.z,
+                        v->lookat.x, v->lookat.y, v->lookat.z);
+    }
+
+    return snprintf(buf, size, "%.6g,%.6g,%.6g,%.6g,%.6g",
+                    v->angle, v->dist, v->lookat.x, v->lookat.y, v->lookat.z);
+}
+
+/**
+ * Position of the camera.
+ **/
+tvec3
+view_eye(const struct view *v)
+{
+    if (v->has_eye) {
+        return v->eye;
+    }
+
+    return (tvec3){
+        v->lookat.x + cosf(v->angle)*v->dist,
+        v->lookat.y,
+        v->lookat.z + sinf(v->angle)*v->dist
+    };
+}
+
+static inline float
+lerpf(float a, float b, float t)
+{
+    return a + (b - a) * t;
+}
+
+/**
+ * Interpolate between two views. Two orbiting views are interpolated
+ * along the orbit, otherwise the eye positions are interpolated.
+ **/
+void
+view_lerp(struct view *out, const struct view *a, const struct view *b, float t)
+{
+    struct view v;
+
+    memset(&v, 0, sizeof(struct view));
+
+    v.lookat = (tvec3){
+        lerpf(a->lookat.x, b->lookat.x, t),
+        lerpf(a->lookat.y, b->lookat.y, t),
+        lerpf(a->lookat.z, b->lookat.z, t)
+    };
+
+    if (!a->has_eye && !b->has_eye) {
+        v.angle = lerpf(a->angle, b->angle, t);
+        v.dist = lerpf(a->dist, b->dist, t);
+    } else {
+        tvec3 ea = view_eye(a), eb = view_eye(b);
+        v.eye = (tvec3){lerpf(ea.x, eb.x, t), lerpf(ea.y, eb.y, t), lerpf(ea.z, eb.z, t)};
+        v.has_eye = 1;
+    }
+
+    *out = v;
+}
+
+/**
+ * Place the camera and update its matrices.
+ **/
+void
+view_apply(const struct view *v, struct tcam *cam)
+{
+    cam->_position = view_eye(v);
+
+    tcam_set_lookat(cam, TVEC3_INLINE(v->lookat));
+    tcam_enable(cam, TCAM_LOOKAT);
+    tcam_calculate(cam);
+}
@@ -0,0 +1,29 @@
+#ifndef _VIEW__H_
+#define _VIEW__H_
+
+#include <stddef.h>
+
+#include "math/vector.h"
+
+struct tcam;
+
+/**
+ * Camera placement. The camera either orbits the lookat point in the
+ * xz-plane at the given angle and distance, or if has_eye is set,
+ * is placed at the eye position.
+ **/
+struct view {
+    float angle;
+    float dist;
+    tvec3 lookat;
+    tvec3 eye;
+    int   has_eye;
+};
+
+int view_parse(struct view *v, const char *spec);
+void view_apply(const struct view *v, struct tcam *cam);
+tvec3 view_eye(const struct view *v);
+void view_lerp(struct view *out, const struct view *a, const struct view *b, float t);
+int view_format(const struct view *v, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * MegaGraph
+ * Copyright (c) 2017 Teorem AB
+ **/
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "worker.h"
+
+#define MAX_THREADS 64
+
+static int num_threads = 0;
+
+struct chunk {
+    worker_fn  fn;
+    void      *arg;
+    size_t     begin;
+    size_t     end;
+};
+
+/**
+ * Set the number of threads used by worker_parallel_for(), 0 picks
+ * one per online cpu.
+ **/
+void
+worker_set_num_threads(int n)
+{
+    num_threads = n < 0 ? 0 : (n > MAX_THREADS ? MAX_THREADS : n);
+}
+
+int
+worker_num_threads(void)
+{
+    if (num_threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = n < 1 ? 1 : (n > MAX_THREADS ? MAX_THREADS : (int)n);
+    }
+
+    return num_threads;
+}
+
+static void*
+run_chunk(void *p)
+{
+    TRACE_SCOPE("parallel for");
+    struct chunk *c = (struct chunk*)p;
+    c->fn(c->arg, c->begin, c->end);
+    return 0;
+}
+
+static void*
+run_thread(void *p)
+{
+    trace_thread_name("worker");
+    return run_chunk(p);
+}
+
+/**
+ * Call fn over the range [0, count), split into one contiguous chunk
+ * per thread. The calling thread runs the first chunk itself and the
+ * function returns when all chunks are done.
+ **/
+void
+worker_parallel_for(size_t count, worker_fn fn, void *arg)
+{
+    int n = worker_num_threads();
+    pthread_t threads[MAX_THREADS];
+    struct chunk chunks[MAX_THREADS];
+    int started[MAX_THREADS] = {0};
+
+    if ((size_t)n > count) {
+        n = (int)count;
+    }
+
+    if (n <= 1) {
+        if (count > 0) fn(arg, 0, count);
+        return;
+    }
+
+    for (int x=0; x<n; x++) {
+        chunks[x] = (struct chunk){fn, arg, count * x / n, count * (x+1) / n};
+    }
+
+    for (int x=1; x<n; x++) {
+        started[x] = pthread_create(&threads[x], 0, run_thread, &chunks[x]) == 0;
+        if (!started[x]) {
+            /* fall back to running the chunk on this thread */
+            run_chunk(&chunks[x]);
+        }
+    }
+
+    run_chunk(&chunks[0]);
+
+    for (int x=1; x<n; x++) {
+        if (started[x]) {
+            pthread_join(threads[x], 0);
+        }
+    }
+}
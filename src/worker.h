@@ -0,0 +1,12 @@
+#ifndef _WORKER__H_
+#define _WORKER__H_
+
+#include <stddef.h>
+
+typedef void (*worker_fn)(void *arg, size_t begin, size_t end);
+
+void worker_set_num_threads(int n);
+int worker_num_threads(void);
+void worker_parallel_for(size_t count, worker_fn fn, void *arg);
+
+#endif
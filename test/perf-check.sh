@@ -0,0 +1,48 @@
+#!/bin/bash
+#
+# Runs the decode, parse, math and render benchmarks on fixed inputs
+# and compares the results against test/perf-baseline.json, see
+# src/tools/perf_check.c. With --update the baseline is rewritten
+# with the current results instead.
+#
+# Rendering goes through --headless, so no GPU or display is needed
+# as long as EGL has a software renderer such as llvmpipe.
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+OUT=${PERF_OUT:-perf-results}
+BASELINE=test/perf-baseline.json
+DATASET=$OUT/clustered-20k.txt
+
+mkdir -p "$OUT"
+
+if [ ! -f "$DATASET" ]; then
+    ./megagraph-gen -n 20000 -d clustered --seed 1 -o "$DATASET"
+fi
+
+echo "decode: test/data_sample"
+./megagraph test/data_sample --headless --threads 1 --size 256x256 \
+    --output "$OUT/decode.png" --load-json "$OUT/decode.json" > "$OUT/decode.log" 2>&1
+
+echo "parse, render: $DATASET"
+./megagraph "$DATASET" --headless --threads 1 --size 1024x768 --bench test/perf-path.txt \
+    --load-json "$OUT/parse.json" --bench-json "$OUT/render.json" > "$OUT/render.log" 2>&1
+
+echo "math"
+./megagraph-bench-math --json --time 0.1 > "$OUT/math.json"
+
+# timings are only compared with a baseline from the same machine
+MACHINE=${PERF_MACHINE:-"$(uname -n) $(sed -n 's/^model name\s*: //p' /proc/cpuinfo 2>/dev/null | head -1) x$(nproc 2>/dev/null)"}
+
+UPDATE=
+if [ "$1" == "--update" ]; then
+    UPDATE="--update $BASELINE"
+fi
+
+./megagraph-perf-check $UPDATE --machine "$MACHINE" $BASELINE \
+    decode="$OUT/decode.json" \
+    parse="$OUT/parse.json" \
+    render="$OUT/render.json" \
+    math="$OUT/math.json"